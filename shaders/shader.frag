@@ -6,11 +6,23 @@ layout(location = 2) in vec3 fragNormalWorld;
 
 layout(location = 0) out vec4 outColor;
 
+// Set per pipeline by ShaderPermutation. The driver folds every branch on them when it compiles the
+// pipeline, so a permutation only contains the lighting it draws with.
+layout(constant_id = 0) const int LIGHT_COUNT = 1; // of ubo.lights, at most MAX_LIGHTS
+layout(constant_id = 1) const int ATTENUATION = 2; // 0 none, 1 linear, 2 inverse square
+layout(constant_id = 3) const int DEBUG_VIEW = 0;  // 0 lit, 1 normals, 2 vertex color, 3 lighting only
+
+const int MAX_LIGHTS = 4;
+
+struct PointLight {
+    vec4 position; // w unused
+    vec4 color;    // w is intensity
+};
+
 layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 projectionViewMatrix;
     vec4 ambientLightColor;
-    vec3 lightPosition;
-    vec4 lightColor;
+    PointLight lights[MAX_LIGHTS];
 } ubo;
 
 layout(push_constant) uniform Push {
@@ -18,12 +30,32 @@ layout(push_constant) uniform Push {
     mat4 normalMatrix;
 } push;
 
+float attenuate(vec3 directionToLight) {
+    if (ATTENUATION == 1) {
+        return inversesqrt(dot(directionToLight, directionToLight));
+    }
+    if (ATTENUATION == 2) {
+        return 1.0 / dot(directionToLight, directionToLight);
+    }
+    return 1.0;
+}
+
 void main() {
-    vec3 directionToLight = ubo.lightPosition - fragPosWorld;
-    float attenuation = 1.0 / dot(directionToLight, directionToLight);
-
-    vec3 lightColor = ubo.lightColor.xyz * ubo.lightColor.w * attenuation;
-    vec3 ambientLight = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
-    vec3 diffuseLight = lightColor * max(dot(normalize(fragNormalWorld), normalize(directionToLight)), 0);
-    outColor = vec4((diffuseLight + ambientLight) * fragColor, 1.0);
-}
\ No newline at end of file
+    vec3 normal = normalize(fragNormalWorld);
+    if (DEBUG_VIEW == 1) {
+        outColor = vec4(normal * 0.5 + 0.5, 1.0);
+        return;
+    }
+    if (DEBUG_VIEW == 2) {
+        outColor = vec4(fragColor, 1.0);
+        return;
+    }
+
+    vec3 light = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
+    for (int i = 0; i < LIGHT_COUNT; i++) {
+        vec3 directionToLight = ubo.lights[i].position.xyz - fragPosWorld;
+        vec3 lightColor = ubo.lights[i].color.xyz * ubo.lights[i].color.w * attenuate(directionToLight);
+        light += lightColor * max(dot(normal, normalize(directionToLight)), 0);
+    }
+    outColor = vec4(DEBUG_VIEW == 3 ? light : light * fragColor, 1.0);
+}
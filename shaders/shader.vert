@@ -1,19 +1,32 @@
 #version 450
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 color;
-layout(location = 2) in vec3 normal;
-layout(location = 3) in vec3 uv;
+// Inputs are read as vec4 so one shader serves both Model vertex formats, the components a format
+// lacks read as (0, 0, 0, 1). Model::Vertex passes float positions and normals, Model::PackedVertex
+// snorm positions scaled back to model space by push.modelMatrix, which RenderSystem multiplies
+// with Model::getVertexTransform, and octahedral normals.
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec4 normal;
+layout(location = 3) in vec4 uv;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragPosWorld;
 layout(location = 2) out vec3 fragNormalWorld;
 
+// Set per pipeline by ShaderPermutation: 0 Model::VertexFormat::Float, 1 Packed.
+layout(constant_id = 2) const int VERTEX_FORMAT = 0;
+
+const int MAX_LIGHTS = 4;
+
+struct PointLight {
+    vec4 position;
+    vec4 color;
+};
+
 layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 projectionViewMatrix;
     vec4 ambientLightColor;
-    vec3 lightPosition;
-    vec4 lightColor;
+    PointLight lights[MAX_LIGHTS];
 } ubo;
 
 layout(push_constant) uniform Push {
@@ -21,10 +34,19 @@ layout(push_constant) uniform Push {
     mat4 normalMatrix;
 } push;
 
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -fold : fold;
+    n.y += n.y >= 0.0 ? -fold : fold;
+    return normalize(n);
+}
+
 void main() {
-    vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
+    vec4 positionWorld = push.modelMatrix * vec4(position.xyz, 1.0);
     gl_Position = ubo.projectionViewMatrix * positionWorld;
-    fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+    vec3 modelNormal = VERTEX_FORMAT == 1 ? decodeOctahedral(normal.xy) : normal.xyz;
+    fragNormalWorld = normalize(mat3(push.normalMatrix) * modelNormal);
     fragPosWorld = positionWorld.xyz;
-    fragColor = color;
-}
\ No newline at end of file
+    fragColor = color.rgb;
+}
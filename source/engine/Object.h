@@ -41,6 +41,7 @@ namespace engine {
         std::shared_ptr<rendering::Model> model;
         glm::vec3 color{};
         TransformComponent transform{};
+        uint32 lod = 0; // LOD drawn last frame, RenderSystem::selectLod starts from it
 
     private:
         uint32 id;
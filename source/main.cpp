@@ -3,12 +3,23 @@
 #include <stdexcept>
 
 #include "vulkan/Application.h"
+#include "vulkan/Benchmark.h"
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+        return rendering::Benchmark::run(argc, argv);
+    }
+
+    // GPU times of the shader permutations need a device, so they are taken by the Application.
+    uint32_t benchmarkFrames = 0;
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-variants") {
+        benchmarkFrames = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 240;
+    }
 
-int main() {
     rendering::Application application{};
 
     try {
-        application.run();
+        application.run(benchmarkFrames);
     }
     catch (const std::exception &e) {
             std::cerr << e.what() << '\n';
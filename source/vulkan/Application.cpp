@@ -1,55 +1,60 @@
 
 #include "Application.h"
 #include "Camera.h"
+#include "GpuTimer.h"
+#include "PipelineCache.h"
+#include "PipelineCompiler.h"
+#include "ShaderModuleCache.h"
 #include "../engine/MovementController.h"
-#include "Buffer.h"
+
+#include <iomanip>
+#include <iostream>
 
 namespace rendering {
 
+    struct PointLight {
+        glm::vec4 position{}; // w unused
+        glm::vec4 color{};    // w is intensity
+    };
+
+    // The shaders read the first lightCount lights of the RenderSystem's ShaderPermutation.
     struct GlobalUbo {
         glm::mat4 projectionView{1.0f};
         glm::vec4 ambientLightColor{1.0f, 1.0f, 1.0f, 0.2f};
-        glm::vec3 lightPosition{(sin(-1.0f * glfwGetTime())), sin(-1.0f * glfwGetTime() * .05), -1.0f};
-        alignas(16) glm::vec4 lightColor{1.0f};
+        std::array<PointLight, ShaderPermutation::MAX_LIGHTS> lights{};
     };
 
     rendering::Application::Application() {
-        globalPool = DescriptorPool::Builder(device)
-                .setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
-                .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT)
-                .build();
         loadObjects();
     }
 
     rendering::Application::~Application() = default;
 
-    void rendering::Application::run() {
-
-        std::vector<std::unique_ptr<Buffer>> uboBuffers(SwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (auto & uboBuffer : uboBuffers) {
-            uboBuffer = std::make_unique<Buffer>(
-                    device,
-                    sizeof(GlobalUbo),
-                    1,
-                    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-                    );
-            uboBuffer->map();
-        }
-
+/**
+ * Runs until the window is closed.
+ *
+ * @param benchmarkFrames (Optional) Instead times each of benchmarkPermutations() for this many
+ * frames on the GPU, prints the times and returns
+ */
+    void rendering::Application::run(uint32_t benchmarkFrames) {
+        // GlobalUbo is written to the renderer's frame allocator every frame. One dynamic descriptor
+        // covers every frame, the frame's copy is picked with the dynamic offset at bind time.
         auto globalSetLayout = DescriptorSetLayout::Builder(device)
-                .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
+                .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
                 .build();
 
-        std::vector<VkDescriptorSet> globalDescriptorSets(SwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (int i = 0; i < globalDescriptorSets.size(); i++) {
-            auto bufferInfo = uboBuffers[i]->descriptorInfo();
-            DescriptorWriter(*globalSetLayout, *globalPool)
-            .writeBuffer(0, &bufferInfo)
-            .build(globalDescriptorSets[i]);
-        }
+        VkDescriptorBufferInfo bufferInfo{renderer.getFrameAllocator().getBuffer(), 0, sizeof(GlobalUbo)};
+        VkDescriptorSet globalDescriptorSet = DescriptorWriter(*globalSetLayout)
+                .writeBuffer(0, &bufferInfo)
+                .buildCached();
 
         RenderSystem renderSystem{device, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+        PipelineCache::Stats pipelines = device.pipelineCache().getStats();
+        std::cout << "Pipelines: " << pipelines.pipelines << " created " << (pipelines.warm ? "warm" : "cold") << " in "
+                  << pipelines.creationMs << " ms, slowest " << pipelines.slowestMs << " ms\n";
+        ShaderModuleCache::Stats shaders = device.shaderModules().getStats();
+        std::cout << "Shader modules: " << shaders.modules << " alive from " << shaders.mappedBytes << " mapped bytes, "
+                  << shaders.hits << " shared, " << shaders.released << " released\n";
         Camera camera{};
         float aspect = renderer.getAspectRatio();
         camera.setViewTarget(glm::vec3(-1.0f, -2.0f, -2.0f), glm::vec3(0.0f, 0.0f, 2.0f));
@@ -60,8 +65,38 @@ namespace rendering {
 
         auto currentTime = std::chrono::high_resolution_clock::now();
 
+        GpuTimer gpuTimer{device, SwapChain::MAX_FRAMES_IN_FLIGHT};
+        std::vector<ShaderPermutation> variants = benchmarkPermutations();
+        size_t variant = 0;
+        uint32_t variantFrames = 0;
+        if (benchmarkFrames > 0) {
+            renderSystem.setPermutation(variants[variant]);
+        }
+
         while(!window.shouldCLose()) {
             glfwPollEvents();
+            if (benchmarkFrames > 0 && variantFrames == benchmarkFrames) {
+                if (++variant == variants.size()) {
+                    break;
+                }
+                renderSystem.setPermutation(variants[variant]);
+                variantFrames = 0;
+            }
+            if (streamer.update(objects) > 0 && streamer.getPendingCount() == 0) {
+                ModelRegistry::Stats stats = modelRegistry.getStats();
+                std::cout << "Models resident: " << stats.residentModels << " (" << stats.residentBytes << " bytes), registry hits "
+                          << stats.hits << ", misses " << stats.misses << '\n';
+                PipelineCompiler::Stats compiler = device.pipelineCompiler().getStats();
+                std::cout << "Pipelines compiled in the background: " << compiler.compiled << ", queued " << compiler.queueDepth
+                          << ", slowest " << compiler.maxLatencyMs << " ms from request to ready\n";
+                MemoryBudget::Snapshot memory = device.memoryAllocator().getBudget();
+                for (size_t i = 0; i < memory.heaps.size(); i++) {
+                    if (memory.heaps[i].deviceLocal) {
+                        std::cout << "Device local heap " << i << ": " << memory.heaps[i].usage << " of " << memory.heaps[i].budget
+                                  << " budget bytes, geometry " << memory.categories[static_cast<uint32_t>(MemoryBudget::Category::Geometry)].bytes << '\n';
+                    }
+                }
+            }
 
             auto newTime = std::chrono::high_resolution_clock::now();
             float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
@@ -74,41 +109,106 @@ namespace rendering {
             camera.setPerspectiveProjection(glm::radians(50.0f), aspect, 0.1f, 1000.0f);
 
             if (auto commandBuffer = renderer.beginFrame()) {
+                // beginFrame waited for this frame slot's fence, geometry freed two frames ago is idle now.
+                device.geometryArena().nextFrame();
                 int frameIndex = renderer.getFrameIndex();
+
+                GlobalUbo ubo{};
+                ubo.projectionView = camera.getProjection() * camera.getView();
+                ubo.lights[0].position = {sin(-1.0f * glfwGetTime()), sin(-1.0f * glfwGetTime() * .05), -1.0f, 0.0f};
+                ubo.lights[0].color = glm::vec4{1.0f};
+                FrameAllocator::Allocation uboAllocation = renderer.getFrameAllocator().write(ubo);
+
                 FrameInfo frameInfo {
                     frameIndex,
                     frameTime,
                     commandBuffer,
                     camera,
-                    globalDescriptorSets[frameIndex],
-                    objects
+                    globalDescriptorSet,
+                    uboAllocation.offset,
+                    renderer.getFrameAllocator(),
+                    objects,
+                    renderer.getExtent()
                 };
 
-                GlobalUbo ubo{};
-                ubo.projectionView = camera.getProjection() * camera.getView();
-                uboBuffers[frameIndex]->writeToBuffer(&ubo);
-                uboBuffers[frameIndex]->flush();
-
+                // Only frames drawing the whole scene with the compiled permutation are timed.
+                bool timed = benchmarkFrames > 0 && streamer.getPendingCount() == 0 && renderSystem.isPermutationReady();
+                if (timed) {
+                    gpuTimer.begin(commandBuffer, frameIndex, renderSystem.getPermutation().key());
+                    variantFrames++;
+                }
                 renderer.beginSwapChainRenderPass(commandBuffer);
                 renderSystem.renderObjects(frameInfo);
                 renderer.endSwapChainRenderPass(commandBuffer);
+                if (timed) {
+                    gpuTimer.end(commandBuffer, frameIndex);
+                }
                 renderer.endFrame();
             }
         }
         vkDeviceWaitIdle(device.device());
+
+        if (benchmarkFrames > 0) {
+            gpuTimer.collectAll();
+            printVariantTimings(gpuTimer, variants);
+        }
+    }
+
+/**
+ * Every light count, each attenuation model and each debug view, the other switches at their
+ * defaults.
+ */
+    std::vector<ShaderPermutation> rendering::Application::benchmarkPermutations() {
+        std::vector<ShaderPermutation> variants{};
+        for (uint32_t lights = 0; lights <= ShaderPermutation::MAX_LIGHTS; lights++) {
+            ShaderPermutation variant{};
+            variant.lightCount = lights;
+            variants.push_back(variant);
+        }
+        for (auto attenuation : {ShaderPermutation::Attenuation::None, ShaderPermutation::Attenuation::Linear}) {
+            ShaderPermutation variant{};
+            variant.attenuation = attenuation;
+            variants.push_back(variant);
+        }
+        for (auto debugView : {ShaderPermutation::DebugView::Normals, ShaderPermutation::DebugView::VertexColor,
+                               ShaderPermutation::DebugView::Lighting}) {
+            ShaderPermutation variant{};
+            variant.debugView = debugView;
+            variants.push_back(variant);
+        }
+        return variants;
+    }
+
+    void rendering::Application::printVariantTimings(const GpuTimer& gpuTimer, const std::vector<ShaderPermutation>& variants) {
+        std::cout << "== Shader permutations (GPU time of the scene pass)\n";
+        if (!gpuTimer.isSupported()) {
+            std::cout << "  the graphics queue has no timestamps\n";
+            return;
+        }
+        const auto& timings = gpuTimer.getTimings();
+        for (const auto& variant : variants) {
+            auto timing = timings.find(variant.key());
+            if (timing == timings.end() || timing->second.frames == 0) {
+                std::cout << "  " << variant.name() << ": not timed\n";
+                continue;
+            }
+            std::cout << std::fixed << std::setprecision(3) << "  " << variant.name() << ": "
+                      << timing->second.totalMs / timing->second.frames << " ms average, min " << timing->second.minMs
+                      << ", max " << timing->second.maxMs << " over " << timing->second.frames << " frames\n";
+        }
     }
 
     void rendering::Application::loadObjects() {
-        std::shared_ptr<Model> model = Model::createModelFromFile(device, "../models/smooth_vase.obj");
+        Model::LoadOptions packed{};
+        packed.vertexFormat = Model::VertexFormat::Packed;
         auto smoothVase = engine::Object::createObject();
-        smoothVase.model = model;
+        streamer.assign(smoothVase, streamer.load("../models/smooth_vase.obj", packed));
         smoothVase.transform.translation = {0.0f, 0.5f, 0.0f};
         smoothVase.transform.scale = {glm::vec3(3.0f)};
         objects.emplace(smoothVase.getId(), std::move(smoothVase));
 
-        model = Model::createModelFromFile(device, "../models/quad.obj");
         auto floor = engine::Object::createObject();
-        floor.model = model;
+        streamer.assign(floor, streamer.load("../models/quad.obj"));
         floor.transform.translation = {0.0f, 0.5f, 0.0f};
         floor.transform.scale = {glm::vec3(3.0f, 1.0f, 3.0f)};
         objects.emplace(floor.getId(), std::move(floor));
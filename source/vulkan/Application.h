@@ -9,6 +9,9 @@
 #include "RenderSystem.h"
 #include "FrameInfo.h"
 #include "Descriptor.h"
+#include "ModelRegistry.h"
+#include "ModelStreamer.h"
+#include "ShaderPermutation.h"
 
 #include "../engine/Object.h"
 
@@ -16,10 +19,13 @@
 #include <stdexcept>
 #include <array>
 #include <chrono>
+#include <vector>
 
 #include <glm/gtc/constants.hpp>
 
 namespace rendering {
+    class GpuTimer;
+
     class Application {
     public:
         static constexpr int WIDTH = 800, HEIGHT = 600;
@@ -30,16 +36,19 @@ namespace rendering {
         Application(const Application&) = delete;
         Application &operator = (const Application&) = delete;
 
-        void run();
+        void run(uint32_t benchmarkFrames = 0);
 
     private:
         void loadObjects();
+        static std::vector<ShaderPermutation> benchmarkPermutations();
+        static void printVariantTimings(const GpuTimer& gpuTimer, const std::vector<ShaderPermutation>& variants);
 
         Window window{WIDTH, HEIGHT, "Vulkan"};
         Device device{window};
         Renderer renderer{window, device};
+        ModelRegistry modelRegistry{};
+        ModelStreamer streamer{device, &modelRegistry};
 
-        std::unique_ptr<DescriptorPool> globalPool{};
         engine::Object::Map objects;
     };
 }
@@ -0,0 +1,824 @@
+
+#include "Benchmark.h"
+#include "FreeListAllocator.h"
+#include "GeometryArena.h"
+#include "Model.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "TlsfAllocator.h"
+#include "RenderSystem.h"
+#include "ObjParser.h"
+#include "VertexTable.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include <glm/gtx/hash.hpp>
+
+namespace rendering {
+
+    namespace {
+        constexpr int RUNS = 5;
+
+        bool nearlyEqual(float a, float b) {
+            return std::abs(a - b) <= 1e-6f * std::max(1.0f, std::max(std::abs(a), std::abs(b)));
+        }
+
+        bool nearlyEqual(const Model::Vertex &a, const Model::Vertex &b) {
+            for (int i = 0; i < 3; i++) {
+                if (!nearlyEqual(a.position[i], b.position[i]) || !nearlyEqual(a.color[i], b.color[i]) ||
+                    !nearlyEqual(a.normal[i], b.normal[i])) {
+                    return false;
+                }
+            }
+            return nearlyEqual(a.uv.x, b.uv.x) && nearlyEqual(a.uv.y, b.uv.y);
+        }
+
+        // Same hash the std::unordered_map weld in Model.cpp uses.
+        struct NodeVertexHash {
+            size_t operator () (const Model::Vertex &vertex) const {
+                size_t seed = 0;
+                hashCombine(seed, vertex.position, vertex.color, vertex.normal, vertex.uv);
+                return seed;
+            }
+        };
+
+        // Triangles as vertex contents, rotated to start at their smallest vertex and sorted, so two
+        // index buffers can be compared independently of triangle order and vertex numbering.
+        std::vector<std::array<Model::Vertex, 3>> canonicalTriangles(const Model::Builder &builder) {
+            auto less = [](const Model::Vertex &a, const Model::Vertex &b) { return memcmp(&a, &b, sizeof(a)) < 0; };
+            std::vector<std::array<Model::Vertex, 3>> triangles(builder.indices.size() / 3);
+            for (size_t t = 0; t < triangles.size(); t++) {
+                auto &triangle = triangles[t];
+                for (size_t k = 0; k < 3; k++) {
+                    triangle[k] = builder.vertices[builder.indices[t * 3 + k]];
+                }
+                auto first = std::min_element(triangle.begin(), triangle.end(), less);
+                std::rotate(triangle.begin(), first, triangle.end());
+            }
+            std::sort(triangles.begin(), triangles.end(), [&](const auto &a, const auto &b) {
+                return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), less);
+            });
+            return triangles;
+        }
+
+        bool sameWeld(const std::vector<Model::Vertex> &aVertices, const std::vector<uint32_t> &aIndices,
+                      const std::vector<Model::Vertex> &bVertices, const std::vector<uint32_t> &bIndices) {
+            return aIndices == bIndices && aVertices.size() == bVertices.size() &&
+                   memcmp(aVertices.data(), bVertices.data(), aVertices.size() * sizeof(Model::Vertex)) == 0;
+        }
+    }
+
+    int Benchmark::run(int argc, char **argv) {
+        std::vector<std::string> models{};
+        for (int i = 2; i < argc; i++) {
+            models.emplace_back(argv[i]);
+        }
+        if (models.empty()) {
+            models = {"../models/smooth_vase.obj", "../models/flat_vase.obj", "../models/colored_cube.obj"};
+        }
+
+        bool passed = true;
+        try {
+            passed &= objLoading(models);
+            passed &= meshCache(models);
+            passed &= vertexDedup(models);
+            passed &= meshOptimization(models);
+            passed &= lodSelection(models);
+            passed &= vertexFormats(models);
+            passed &= meshletCulling(models);
+            passed &= geometryArena(models);
+            passed &= memoryAllocator();
+        }
+        catch (const std::exception &e) {
+            std::cerr << e.what() << '\n';
+            return EXIT_FAILURE;
+        }
+
+        std::cout << (passed ? "benchmark: all checks passed" : "benchmark: CHECKS FAILED") << '\n';
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+/**
+ * Times the memory mapped parallel OBJ parser against the tinyobj reference path and checks that
+ * both produce the same welded vertices and indices.
+ */
+    bool Benchmark::objLoading(const std::vector<std::string> &models) {
+        std::cout << "== OBJ loading (best of " << RUNS << ")\n";
+        bool passed = true;
+
+        for (const auto &model: models) {
+            Model::Builder reference{};
+            Model::Builder parsed{};
+            double tinyObjMs = bestOf(RUNS, [&] { reference.loadModelTinyObj(model); });
+            double parserMs = bestOf(RUNS, [&] { parsed.loadModel(model); });
+
+            bool same = reference.indices == parsed.indices && reference.vertices.size() == parsed.vertices.size();
+            for (size_t i = 0; same && i < parsed.vertices.size(); i++) {
+                same = nearlyEqual(reference.vertices[i], parsed.vertices[i]);
+            }
+            passed &= same;
+
+            std::cout << std::fixed << std::setprecision(2)
+                      << "  " << model << ": " << parsed.vertices.size() << " vertices, "
+                      << parsed.indices.size() / 3 << " triangles | tinyobj " << tinyObjMs << " ms, parallel "
+                      << parserMs << " ms (" << tinyObjMs / std::max(parserMs, 1e-3) << "x) "
+                      << (same ? "[match]" : "[MISMATCH]") << '\n';
+        }
+        return passed;
+    }
+
+/**
+ * Compares a cold load (parse, weld, optimize, LODs and store) against a warm load from the binary mesh cache. The
+ * warm path copies into a plain vector here, standing in for the staging buffer.
+ */
+    bool Benchmark::meshCache(const std::vector<std::string> &models) {
+        std::cout << "== Mesh cache (best of " << RUNS << ")\n";
+        std::string previousDirectory = MeshCache::getDirectory();
+        auto directory = std::filesystem::temp_directory_path() / "vulkanlearn-benchmark-cache";
+        std::filesystem::remove_all(directory);
+        MeshCache::setDirectory(directory.string());
+
+        bool passed = true;
+        for (const auto &model: models) {
+            Model::Builder builder{};
+            Model::LoadOptions options{};
+            double coldMs = bestOf(RUNS, [&] {
+                builder.loadModel(model);
+                MeshOptimizer::optimize(builder);
+                MeshSimplifier::generateLods(builder);
+                MeshCache::store(model, options.cacheVariant(), builder.data());
+            });
+
+            std::vector<Model::Vertex> staging{};
+            bool hit = true;
+            double warmMs = bestOf(RUNS, [&] {
+                MeshCache::Entry entry{};
+                hit &= MeshCache::load(model, options.cacheVariant(), entry);
+                if (hit) {
+                    staging.resize(entry.mesh.vertexCount);
+                    memcpy(staging.data(), entry.mesh.vertices, entry.mesh.vertexCount * sizeof(Model::Vertex));
+                }
+            });
+
+            MeshCache::Entry entry{};
+            bool same = hit && MeshCache::load(model, options.cacheVariant(), entry) &&
+                        entry.mesh.vertexCount == builder.vertices.size() &&
+                        entry.mesh.indexCount == builder.indices.size() &&
+                        memcmp(entry.mesh.vertices, builder.vertices.data(), builder.vertices.size() * sizeof(Model::Vertex)) == 0 &&
+                        memcmp(entry.mesh.indices, builder.indices.data(), builder.indices.size() * sizeof(uint32_t)) == 0 &&
+                        entry.mesh.lodCount == builder.lods.size() &&
+                        memcmp(entry.mesh.lods, builder.lods.data(), builder.lods.size() * sizeof(Model::Lod)) == 0;
+            passed &= same;
+
+            std::cout << std::fixed << std::setprecision(3)
+                      << "  " << model << ": cold " << coldMs << " ms, warm " << warmMs << " ms ("
+                      << coldMs / std::max(warmMs, 1e-3) << "x) " << (same ? "[match]" : "[MISMATCH]") << '\n';
+        }
+
+        MeshCache::setDirectory(previousDirectory);
+        std::filesystem::remove_all(directory);
+        return passed;
+    }
+
+/**
+ * Welds the corners of each model with the node based std::unordered_map, the flat table and the
+ * sharded flat table, and checks all three agree exactly. A second row repeats every model 64 times
+ * with shifted positions so the sharded path has enough work to amortize its threads.
+ */
+    bool Benchmark::vertexDedup(const std::vector<std::string> &models) {
+        std::cout << "== Vertex dedup (best of " << RUNS << ")\n";
+        constexpr uint32_t COPIES = 64;
+        uint32_t threads = std::max(2u, std::thread::hardware_concurrency());
+        bool passed = true;
+
+        for (const auto &model: models) {
+            ObjData obj{};
+            ObjParser::parse(model, obj);
+
+            for (uint32_t copies: {1u, COPIES}) {
+                size_t cornerCount = obj.indices.size() * copies;
+                auto makeVertex = [&](size_t corner) {
+                    size_t copy = corner / obj.indices.size();
+                    Model::Vertex vertex = Model::Builder::makeVertex(obj, obj.indices[corner % obj.indices.size()]);
+                    vertex.position.x += static_cast<float>(copy) * 16.0f;
+                    return vertex;
+                };
+
+                std::vector<Model::Vertex> nodeVertices{}, flatVertices{}, shardedVertices{};
+                std::vector<uint32_t> nodeIndices{}, flatIndices{}, shardedIndices{};
+
+                double nodeMs = bestOf(RUNS, [&] {
+                    std::unordered_map<Model::Vertex, uint32_t, NodeVertexHash> unique{};
+                    unique.reserve(cornerCount);
+                    nodeVertices.clear();
+                    nodeIndices.resize(cornerCount);
+                    for (size_t corner = 0; corner < cornerCount; corner++) {
+                        Model::Vertex vertex = makeVertex(corner);
+                        auto [it, inserted] = unique.try_emplace(vertex, static_cast<uint32_t>(nodeVertices.size()));
+                        if (inserted) {
+                            nodeVertices.push_back(vertex);
+                        }
+                        nodeIndices[corner] = it->second;
+                    }
+                });
+                double flatMs = bestOf(RUNS, [&] { weldVertices(cornerCount, makeVertex, flatVertices, flatIndices, 1); });
+                double shardedMs = bestOf(RUNS, [&] {
+                    weldVertices(cornerCount, makeVertex, shardedVertices, shardedIndices, threads);
+                });
+
+                bool same = sameWeld(nodeVertices, nodeIndices, flatVertices, flatIndices) &&
+                            sameWeld(flatVertices, flatIndices, shardedVertices, shardedIndices);
+                passed &= same;
+
+                std::cout << std::fixed << std::setprecision(2)
+                          << "  " << model << (copies > 1 ? " x" + std::to_string(copies) : std::string{}) << ": "
+                          << cornerCount << " corners -> " << flatVertices.size() << " vertices | unordered_map "
+                          << nodeMs << " ms, flat " << flatMs << " ms (" << nodeMs / std::max(flatMs, 1e-3)
+                          << "x), sharded/" << threads << " " << shardedMs << " ms ("
+                          << nodeMs / std::max(shardedMs, 1e-3) << "x) " << (same ? "[match]" : "[MISMATCH]") << '\n';
+            }
+        }
+        return passed;
+    }
+
+/**
+ * Runs the MeshOptimizer passes on each model and reports ACMR/ATVR before and after. Checks that
+ * the optimized mesh draws exactly the same triangles and that vertex reuse did not get worse.
+ */
+    bool Benchmark::meshOptimization(const std::vector<std::string> &models) {
+        std::cout << "== Mesh optimization (FIFO cache of " << MeshOptimizer::CACHE_SIZE << ", best of " << RUNS << ")\n";
+        bool passed = true;
+
+        for (const auto &model: models) {
+            Model::Builder original{};
+            original.loadModel(model);
+
+            Model::Builder optimized{};
+            MeshOptimizer::Report report{};
+            double optimizeMs = bestOf(RUNS, [&] {
+                optimized = original;
+                report = MeshOptimizer::optimize(optimized);
+            });
+
+            bool same = canonicalTriangles(original) == canonicalTriangles(optimized) &&
+                        report.after.acmr <= report.before.acmr;
+            passed &= same;
+
+            std::cout << std::fixed << std::setprecision(3)
+                      << "  " << model << ": ACMR " << report.before.acmr << " -> " << report.after.acmr
+                      << ", ATVR " << report.before.atvr << " -> " << report.after.atvr << " | "
+                      << std::setprecision(2) << optimizeMs << " ms " << (same ? "[match]" : "[MISMATCH]") << '\n';
+        }
+        return passed;
+    }
+
+/**
+ * Builds the LOD chain of each model and draws a distant crowd through RenderSystem's LOD selection:
+ * a 32x32 grid of instances from 20 to 144 units in front of a 1080p, 50 degree camera. Reports the
+ * triangle count against drawing LOD 0 everywhere, then walks one instance back and forth across a
+ * switching distance to check that hysteresis keeps it from popping.
+ */
+    bool Benchmark::lodSelection(const std::vector<std::string> &models) {
+        std::cout << "== LOD selection (" << LOD_GRID << "x" << LOD_GRID << " crowd, 1920x1080)\n";
+        const VkExtent2D extent{1920, 1080};
+        Camera camera{};
+        camera.setPerspectiveProjection(glm::radians(50.0f), 1920.0f / 1080.0f, 0.1f, 1000.0f);
+        camera.setViewYXZ(glm::vec3{0.0f}, glm::vec3{0.0f});
+        bool passed = true;
+
+        for (const auto &model: models) {
+            Model::Builder builder{};
+            builder.loadModel(model);
+            MeshOptimizer::optimize(builder);
+            double lodMs = bestOf(1, [&] { MeshSimplifier::generateLods(builder); });
+
+            bool valid = builder.lods[0].firstIndex == 0 && builder.lods[0].error == 0.0f;
+            for (size_t i = 1; i < builder.lods.size(); i++) {
+                valid &= builder.lods[i].indexCount < builder.lods[i - 1].indexCount &&
+                         builder.lods[i].error >= builder.lods[i - 1].error &&
+                         builder.lods[i].firstIndex + builder.lods[i].indexCount <= builder.indices.size();
+            }
+            for (size_t i = builder.lods[0].indexCount; i < builder.indices.size(); i++) {
+                valid &= builder.indices[i] < builder.vertices.size();
+            }
+
+            uint64_t fullTriangles = 0;
+            uint64_t lodTriangles = 0;
+            for (uint32_t x = 0; x < LOD_GRID; x++) {
+                for (uint32_t z = 0; z < LOD_GRID; z++) {
+                    engine::TransformComponent transform{};
+                    transform.translation = {(static_cast<float>(x) - LOD_GRID / 2.0f) * 4.0f, 0.0f,
+                                             20.0f + static_cast<float>(z) * 4.0f};
+                    float pixelsPerUnit = RenderSystem::lodPixelsPerUnit(camera, extent, transform,
+                                                                         builder.boundsMin, builder.boundsMax);
+                    uint32_t lod = RenderSystem::selectLod(builder.lods, 0, pixelsPerUnit);
+                    fullTriangles += builder.lods[0].indexCount / 3;
+                    lodTriangles += builder.lods[lod].indexCount / 3;
+                }
+            }
+
+            // Find the distance where each coarser LOD kicks in, then walk back and forth by +-1%
+            // around it; without hysteresis every step would switch.
+            uint32_t switches = 0;
+            for (uint32_t i = 1; i < builder.lods.size(); i++) {
+                engine::TransformComponent transform{};
+                auto lodAt = [&](float distance, uint32_t current) {
+                    transform.translation.z = distance;
+                    return RenderSystem::selectLod(builder.lods, current, RenderSystem::lodPixelsPerUnit(
+                            camera, extent, transform, builder.boundsMin, builder.boundsMax));
+                };
+
+                float distance = 0.5f;
+                while (distance < 1e5f && lodAt(distance, 0) < i) {
+                    distance *= 1.01f;
+                }
+                uint32_t lod = lodAt(distance, 0);
+                for (int step = 0; step < 100; step++) {
+                    uint32_t next = lodAt(distance * (step % 2 ? 1.01f : 0.99f), lod);
+                    switches += next != lod;
+                    lod = next;
+                }
+            }
+            passed &= valid && switches == 0;
+
+            std::cout << std::fixed << std::setprecision(2) << "  " << model << ": " << builder.lods.size() << " LODs (";
+            for (size_t i = 0; i < builder.lods.size(); i++) {
+                std::cout << (i ? ", " : "") << builder.lods[i].indexCount / 3;
+            }
+            std::cout << " triangles) in " << lodMs << " ms | crowd " << fullTriangles << " -> " << lodTriangles
+                      << " triangles (" << static_cast<double>(fullTriangles) / static_cast<double>(std::max<uint64_t>(lodTriangles, 1))
+                      << "x), " << switches << " pops " << (valid && switches == 0 ? "[ok]" : "[FAILED]") << '\n';
+        }
+        return passed;
+    }
+
+/**
+ * Packs every model into Model::PackedVertex the way the Model constructor does, reports the
+ * geometry memory of both layouts and checks the decoded attributes against the float originals:
+ * positions within half a quantization step, normals within 0.05 degrees, uvs within half precision.
+ */
+    bool Benchmark::vertexFormats(const std::vector<std::string> &models) {
+        std::cout << "== Vertex formats (" << sizeof(Model::Vertex) << " -> " << sizeof(Model::PackedVertex) << " bytes per vertex)\n";
+        bool passed = true;
+
+        for (const auto &model: models) {
+            Model::Builder builder{};
+            builder.loadModel(model);
+            Model::MeshData mesh = builder.data();
+
+            glm::vec3 offset = (builder.boundsMin + builder.boundsMax) * 0.5f;
+            glm::vec3 scale = (builder.boundsMax - builder.boundsMin) * 0.5f;
+            for (int i = 0; i < 3; i++) {
+                scale[i] = scale[i] > 0.0f ? scale[i] : 1.0f;
+            }
+
+            float positionError = 0.0f;
+            float normalError = 0.0f;
+            float uvError = 0.0f;
+            float colorError = 0.0f;
+            bool valid = true;
+            for (const auto &vertex: builder.vertices) {
+                Model::Vertex decoded = Model::PackedVertex::pack(vertex, offset, scale).unpack(offset, scale);
+                for (int i = 0; i < 3; i++) {
+                    float step = scale[i] / 32767.0f;
+                    float error = std::abs(decoded.position[i] - vertex.position[i]);
+                    valid &= error <= step * 0.5f + std::abs(vertex.position[i]) * 1e-6f;
+                    positionError = std::max(positionError, error / scale[i]);
+                    colorError = std::max(colorError, std::abs(decoded.color[i] - glm::clamp(vertex.color[i], 0.0f, 1.0f)));
+                }
+                if (glm::length(vertex.normal) > 0.0f) {
+                    float cosine = glm::clamp(glm::dot(glm::normalize(vertex.normal), decoded.normal), -1.0f, 1.0f);
+                    normalError = std::max(normalError, glm::degrees(std::acos(cosine)));
+                }
+                for (int i = 0; i < 2; i++) {
+                    float error = std::abs(decoded.uv[i] - vertex.uv[i]);
+                    valid &= error <= std::max(std::abs(vertex.uv[i]) * 0x1p-11f, 0x1p-25f);
+                    uvError = std::max(uvError, error);
+                }
+            }
+            valid &= normalError <= 0.05f && colorError <= 0.5f / 255.0f + 1e-6f;
+            passed &= valid;
+
+            VkDeviceSize floatBytes = Model::unpackedGeometryBytes(mesh);
+            VkDeviceSize indexBytes = VkDeviceSize{mesh.indexCount} * (mesh.vertexCount < 65536 ? sizeof(uint16_t) : sizeof(uint32_t));
+            VkDeviceSize packedBytes = VkDeviceSize{mesh.vertexCount} * sizeof(Model::PackedVertex) + indexBytes;
+
+            std::cout << std::setprecision(2) << "  " << model << ": " << floatBytes << " -> " << packedBytes << " bytes ("
+                      << 100.0 * static_cast<double>(floatBytes - packedBytes) / static_cast<double>(floatBytes)
+                      << "% saved) | max error: position " << std::scientific << positionError << " of extent, normal "
+                      << std::fixed << std::setprecision(4) << normalError << " deg, uv " << std::scientific << uvError
+                      << std::fixed << " " << (valid ? "[ok]" : "[FAILED]") << '\n';
+        }
+        return passed;
+    }
+
+/**
+ * Builds the meshlets of each model (optimized, with LODs) and checks them: every LOD is tiled in
+ * order, no meshlet exceeds the vertex and triangle limits, spheres contain their vertices and cones
+ * their triangle normals. Then culls a 32x32 crowd of rotated instances around the camera, some of
+ * them behind it, and verifies every rejected meshlet really is invisible: all vertices outside one
+ * frustum plane, or every triangle facing away from the camera.
+ */
+    bool Benchmark::meshletCulling(const std::vector<std::string> &models) {
+        std::cout << "== Meshlet culling (" << MeshletBuilder::MAX_VERTICES << " vertices, " << MeshletBuilder::MAX_TRIANGLES
+                  << " triangles, " << LOD_GRID << "x" << LOD_GRID << " crowd)\n";
+        Camera camera{};
+        camera.setPerspectiveProjection(glm::radians(50.0f), 1920.0f / 1080.0f, 0.1f, 1000.0f);
+        camera.setViewYXZ(glm::vec3{0.0f}, glm::vec3{0.0f});
+        bool passed = true;
+
+        for (const auto &model: models) {
+            Model::Builder builder{};
+            builder.loadModel(model);
+            MeshOptimizer::optimize(builder);
+            MeshSimplifier::generateLods(builder);
+            Model::MeshData mesh = builder.data();
+
+            Model::Meshlets meshlets{};
+            double buildMs = bestOf(RUNS, [&] { meshlets = MeshletBuilder::build(mesh); });
+
+            bool valid = meshlets.lodOffsets.size() == builder.lods.size() + 1 && meshlets.lodOffsets.front() == 0 &&
+                         meshlets.lodOffsets.back() == meshlets.size();
+            uint64_t meshletVertices = 0;
+            for (size_t lod = 0; valid && lod < builder.lods.size(); lod++) {
+                uint32_t next = builder.lods[lod].firstIndex;
+                for (uint32_t i = meshlets.lodOffsets[lod]; i < meshlets.lodOffsets[lod + 1]; i++) {
+                    valid &= meshlets.firstIndex[i] == next && meshlets.indexCount[i] > 0 && meshlets.indexCount[i] % 3 == 0 &&
+                             meshlets.indexCount[i] / 3 <= MeshletBuilder::MAX_TRIANGLES;
+                    next = meshlets.firstIndex[i] + meshlets.indexCount[i];
+
+                    const uint32_t *indices = builder.indices.data() + meshlets.firstIndex[i];
+                    std::vector<uint32_t> unique(indices, indices + meshlets.indexCount[i]);
+                    std::sort(unique.begin(), unique.end());
+                    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+                    valid &= unique.size() <= MeshletBuilder::MAX_VERTICES;
+                    meshletVertices += unique.size();
+
+                    const glm::vec4 &sphere = meshlets.bounds[i];
+                    const glm::vec4 &cone = meshlets.cones[i];
+                    for (uint32_t vertex: unique) {
+                        valid &= glm::distance(builder.vertices[vertex].position, glm::vec3{sphere}) <= sphere.w;
+                    }
+                    float cosine = cone.w < 1.0f ? std::sqrt(1.0f - cone.w * cone.w) : -1.0f;
+                    for (uint32_t k = 0; k < meshlets.indexCount[i]; k += 3) {
+                        const glm::vec3 &a = builder.vertices[indices[k]].position;
+                        glm::vec3 normal = glm::cross(builder.vertices[indices[k + 1]].position - a,
+                                                      builder.vertices[indices[k + 2]].position - a);
+                        if (glm::length(normal) > 0.0f) {
+                            valid &= glm::dot(glm::normalize(normal), glm::vec3{cone}) >= cosine;
+                        }
+                    }
+                }
+                valid &= next == builder.lods[lod].firstIndex + builder.lods[lod].indexCount;
+            }
+
+            std::vector<glm::mat4> instances{};
+            for (uint32_t x = 0; x < LOD_GRID; x++) {
+                for (uint32_t z = 0; z < LOD_GRID; z++) {
+                    engine::TransformComponent transform{};
+                    transform.translation = {(static_cast<float>(x) - LOD_GRID / 2.0f) * 2.0f, 0.0f,
+                                             (static_cast<float>(z) - LOD_GRID / 4.0f) * 2.0f};
+                    transform.rotation = {static_cast<float>(x) * 0.7f, static_cast<float>(z) * 1.3f, 0.0f};
+                    instances.push_back(transform.mat4());
+                }
+            }
+
+            uint32_t lodMeshlets = meshlets.lodOffsets[1];
+            uint64_t frustumVisible = 0;
+            uint64_t visible = 0;
+            uint64_t triangles = 0;
+            std::vector<Model::IndexRange> ranges{};
+            for (const auto &instance: instances) {
+                RenderSystem::ClusterView view = RenderSystem::clusterView(camera, instance, false);
+                frustumVisible += RenderSystem::cullMeshlets(meshlets, 0, view, ranges);
+                view.coneCulling = true;
+                visible += RenderSystem::cullMeshlets(meshlets, 0, view, ranges);
+                for (const auto &range: ranges) {
+                    triangles += range.indexCount / 3;
+                }
+
+                // Every triangle outside the surviving ranges has to be invisible.
+                std::vector<bool> drawn(lodMeshlets, false);
+                for (const auto &range: ranges) {
+                    for (uint32_t i = 0; i < lodMeshlets; i++) {
+                        drawn[i] = drawn[i] || (meshlets.firstIndex[i] >= range.firstIndex &&
+                                                meshlets.firstIndex[i] < range.firstIndex + range.indexCount);
+                    }
+                }
+                for (uint32_t i = 0; i < lodMeshlets; i++) {
+                    if (drawn[i]) {
+                        continue;
+                    }
+                    const uint32_t *indices = builder.indices.data() + meshlets.firstIndex[i];
+                    bool outside = false;
+                    for (const auto &plane: view.planes) {
+                        bool allOutside = true;
+                        for (uint32_t k = 0; k < meshlets.indexCount[i]; k++) {
+                            allOutside &= glm::dot(glm::vec3{plane}, builder.vertices[indices[k]].position) + plane.w < 0.0f;
+                        }
+                        outside |= allOutside;
+                    }
+                    bool backFacing = true;
+                    for (uint32_t k = 0; k < meshlets.indexCount[i]; k += 3) {
+                        const glm::vec3 &a = builder.vertices[indices[k]].position;
+                        glm::vec3 normal = glm::cross(builder.vertices[indices[k + 1]].position - a,
+                                                      builder.vertices[indices[k + 2]].position - a);
+                        backFacing &= glm::dot(normal, a - view.cameraPosition) >= 0.0f;
+                    }
+                    valid &= outside || backFacing;
+                }
+            }
+
+            double cullMs = bestOf(RUNS, [&] {
+                for (const auto &instance: instances) {
+                    RenderSystem::cullMeshlets(meshlets, 0, RenderSystem::clusterView(camera, instance, true), ranges);
+                }
+            });
+            passed &= valid;
+
+            uint64_t total = uint64_t{lodMeshlets} * instances.size();
+            std::cout << std::fixed << std::setprecision(2) << "  " << model << ": " << meshlets.size() << " meshlets ("
+                      << static_cast<double>(meshletVertices) / std::max(meshlets.size(), 1u) << " vertices, "
+                      << static_cast<double>(builder.indices.size()) / 3.0 / std::max(meshlets.size(), 1u)
+                      << " triangles avg) in " << buildMs << " ms | crowd " << total << " -> frustum " << frustumVisible
+                      << " -> cone " << visible << " meshlets, " << builder.lods[0].indexCount / 3 * instances.size()
+                      << " -> " << triangles << " triangles, culled in " << cullMs << " ms "
+                      << (valid ? "[ok]" : "[FAILED]") << '\n';
+        }
+        return passed;
+    }
+
+/**
+ * Streams the models in and out of GeometryArena sized free lists in both vertex formats, the way
+ * ModelStreamer and ModelRegistry churn the arena, and checks every range: aligned to its stride,
+ * overlapping no other live range, the used byte count matching, and a single free range spanning
+ * the whole capacity once everything is released again.
+ */
+    bool Benchmark::geometryArena(const std::vector<std::string> &models) {
+        constexpr uint32_t OPERATIONS = 100000;
+        std::cout << "== Geometry arena (" << (GeometryArena::VERTEX_CAPACITY >> 20) << " MiB vertices, "
+                  << (GeometryArena::INDEX_CAPACITY >> 20) << " MiB indices, " << OPERATIONS << " operations)\n";
+
+        struct Placement {
+            uint64_t size;
+            uint32_t alignment;
+        };
+        std::vector<std::array<Placement, 2>> shapes{};
+        for (const auto &model: models) {
+            Model::Builder builder{};
+            builder.loadModel(model);
+            uint32_t indexSize = builder.vertices.size() < 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+            uint64_t indexBytes = std::max<uint64_t>(builder.indices.size(), 1) * indexSize;
+            shapes.push_back({{{builder.vertices.size() * sizeof(Model::Vertex), sizeof(Model::Vertex)}, {indexBytes, indexSize}}});
+            shapes.push_back({{{builder.vertices.size() * sizeof(Model::PackedVertex), sizeof(Model::PackedVertex)}, {indexBytes, indexSize}}});
+        }
+
+        FreeListAllocator vertices{GeometryArena::VERTEX_CAPACITY};
+        FreeListAllocator indices{GeometryArena::INDEX_CAPACITY};
+        std::array<FreeListAllocator*, 2> allocators{&vertices, &indices};
+        std::array<std::map<uint64_t, uint64_t>, 2> live{};  // offset -> end
+        std::array<uint64_t, 2> liveBytes{};
+        std::vector<std::array<uint64_t, 2>> resident{};
+        std::mt19937 random{7};
+        bool valid = true;
+        uint32_t failed = 0;
+        size_t peakResident = 0;
+
+        auto release = [&](size_t slot) {
+            for (int i = 0; i < 2; i++) {
+                auto range = live[i].find(resident[slot][i]);
+                liveBytes[i] -= range->second - range->first;
+                live[i].erase(range);
+                allocators[i]->free(resident[slot][i]);
+            }
+            resident[slot] = resident.back();
+            resident.pop_back();
+        };
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t operation = 0; operation < OPERATIONS; operation++) {
+            // Mostly loads while the arena is empty, mostly evictions once models stop fitting.
+            if (!resident.empty() && random() % 100 < 45) {
+                release(random() % resident.size());
+                continue;
+            }
+            const auto &shape = shapes[random() % shapes.size()];
+            std::array<uint64_t, 2> offsets{};
+            for (int i = 0; i < 2; i++) {
+                offsets[i] = allocators[i]->allocate(shape[i].size, shape[i].alignment);
+            }
+            if (offsets[0] == FreeListAllocator::INVALID || offsets[1] == FreeListAllocator::INVALID) {
+                for (int i = 0; i < 2; i++) {
+                    if (offsets[i] != FreeListAllocator::INVALID) {
+                        allocators[i]->free(offsets[i]);
+                    }
+                }
+                failed++;
+                if (!resident.empty()) {
+                    release(random() % resident.size());
+                }
+                continue;
+            }
+            for (int i = 0; i < 2; i++) {
+                uint64_t end = offsets[i] + shape[i].size;
+                auto next = live[i].lower_bound(offsets[i]);
+                valid &= offsets[i] % shape[i].alignment == 0 && end <= allocators[i]->getCapacity();
+                valid &= next == live[i].end() || next->first >= end;
+                valid &= next == live[i].begin() || std::prev(next)->second <= offsets[i];
+                live[i].emplace(offsets[i], end);
+                liveBytes[i] += shape[i].size;
+            }
+            resident.push_back(offsets);
+            peakResident = std::max(peakResident, resident.size());
+        }
+        valid &= vertices.getUsed() == liveBytes[0] && indices.getUsed() == liveBytes[1];
+
+        uint64_t freeBytes = vertices.getCapacity() - vertices.getUsed();
+        double fragmentation = freeBytes ? 1.0 - static_cast<double>(vertices.getLargestFree()) / static_cast<double>(freeBytes) : 0.0;
+        size_t freeRanges = vertices.getFreeRangeCount();
+        while (!resident.empty()) {
+            release(resident.size() - 1);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double churnMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+        for (auto allocator: allocators) {
+            valid &= allocator->getUsed() == 0 && allocator->getFreeRangeCount() == 1 &&
+                     allocator->getLargestFree() == allocator->getCapacity();
+        }
+
+        std::cout << std::fixed << std::setprecision(2) << "  " << shapes.size() << " model variants: peak " << peakResident
+                  << " resident, " << failed << " loads did not fit, " << freeRanges << " free vertex ranges ("
+                  << fragmentation * 100.0 << "% fragmented) | " << churnMs * 1e6 / OPERATIONS << " ns per operation "
+                  << (valid ? "[ok]" : "[FAILED]") << '\n';
+        return valid;
+    }
+
+/**
+ * Checks TlsfAllocator, the sub-allocator behind MemoryAllocator, without a GPU: fixed cases for
+ * alignment, bufferImageGranularity padding, exhaustion and coalescing, then a long random churn of
+ * buffer and image sized allocations validated against a shadow map. The same churn is timed on
+ * FreeListAllocator for comparison.
+ */
+    bool Benchmark::memoryAllocator() {
+        constexpr uint64_t CAPACITY = 64ull << 20;
+        constexpr uint64_t GRANULARITY = 1024;
+        constexpr uint32_t OPERATIONS = 200000;
+        using Kind = TlsfAllocator::Kind;
+        std::cout << "== Memory allocator (" << (CAPACITY >> 20) << " MiB block, " << GRANULARITY << " byte granularity, "
+                  << OPERATIONS << " operations)\n";
+
+        bool valid = true;
+        {
+            TlsfAllocator block{4096, GRANULARITY};
+            auto buffer = block.allocate(100, 4, Kind::Linear);
+            auto image = block.allocate(100, 4, Kind::Optimal);
+            valid &= buffer.offset == 0 && image.offset == GRANULARITY;
+
+            // The gap after the buffer shares its page, so only buffers may go there.
+            auto secondBuffer = block.allocate(100, 4, Kind::Linear);
+            auto secondImage = block.allocate(100, 4, Kind::Optimal);
+            auto thirdBuffer = block.allocate(100, 4, Kind::Linear);
+            valid &= secondBuffer.offset == 100 && secondImage.offset == GRANULARITY + 100 && thirdBuffer.offset == 200;
+            auto pageBuffer = block.allocate(2 * GRANULARITY, 1, Kind::Linear);
+            valid &= pageBuffer.offset == 2 * GRANULARITY;
+            valid &= block.allocate(GRANULARITY, 1, Kind::Linear).offset == TlsfAllocator::INVALID;
+            valid &= block.getUsed() == 500 + 2 * GRANULARITY;
+
+            for (auto allocation: {buffer, image, secondBuffer, secondImage, thirdBuffer, pageBuffer}) {
+                block.free(allocation.handle);
+            }
+            valid &= block.empty() && block.getFreeRangeCount() == 1 && block.getLargestFree() == 4096;
+
+            TlsfAllocator exact{1000};
+            auto first = exact.allocate(600, 8, Kind::Linear);
+            auto second = exact.allocate(400, 8, Kind::Optimal);
+            valid &= first.offset == 0 && second.offset == 600 && exact.getFreeRangeCount() == 0;
+            exact.free(first.handle);
+            exact.free(second.handle);
+            valid &= exact.getFreeRangeCount() == 1 && exact.getLargestFree() == 1000 && exact.empty();
+        }
+        bool fixedCases = valid;
+
+        struct Request {
+            uint64_t size;
+            uint64_t alignment;
+            Kind kind;
+            bool release;
+            uint32_t victim;
+        };
+        std::mt19937 random{11};
+        std::vector<Request> requests(OPERATIONS);
+        for (auto &request: requests) {
+            request.size = uint64_t{256} << (random() % 13);
+            request.size += random() % request.size;
+            request.alignment = uint64_t{16} << (random() % 9);
+            request.kind = random() % 4 == 0 ? Kind::Optimal : Kind::Linear;
+            request.release = random() % 100 < 48;
+            request.victim = random();
+        }
+
+        TlsfAllocator tlsf{CAPACITY, GRANULARITY};
+        std::map<uint64_t, std::pair<uint64_t, Kind>> live{}; // offset -> end, kind
+        std::vector<TlsfAllocator::Allocation> resident{};
+        uint32_t failed = 0;
+        double peakFragmentation = 0.0;
+        for (const auto &request: requests) {
+            if (request.release && !resident.empty()) {
+                size_t slot = request.victim % resident.size();
+                live.erase(resident[slot].offset);
+                tlsf.free(resident[slot].handle);
+                resident[slot] = resident.back();
+                resident.pop_back();
+                continue;
+            }
+            auto allocation = tlsf.allocate(request.size, request.alignment, request.kind);
+            if (allocation.offset == TlsfAllocator::INVALID) {
+                failed++;
+                uint64_t freeBytes = tlsf.getCapacity() - tlsf.getUsed();
+                peakFragmentation = std::max(peakFragmentation, 1.0 - static_cast<double>(tlsf.getLargestFree()) / static_cast<double>(freeBytes));
+                continue;
+            }
+            uint64_t end = allocation.offset + request.size;
+            valid &= allocation.offset % request.alignment == 0 && end <= CAPACITY;
+            auto next = live.lower_bound(allocation.offset);
+            if (next != live.end()) {
+                valid &= next->first >= end;
+                valid &= next->second.second == request.kind || (end - 1) / GRANULARITY < next->first / GRANULARITY;
+            }
+            if (next != live.begin()) {
+                auto previous = std::prev(next);
+                valid &= previous->second.first <= allocation.offset;
+                valid &= previous->second.second == request.kind ||
+                         (previous->second.first - 1) / GRANULARITY < allocation.offset / GRANULARITY;
+            }
+            live.emplace(allocation.offset, std::make_pair(end, request.kind));
+            resident.push_back(allocation);
+        }
+        for (const auto &allocation: resident) {
+            tlsf.free(allocation.handle);
+        }
+        resident.clear();
+        valid &= tlsf.empty() && tlsf.getUsed() == 0 && tlsf.getFreeRangeCount() == 1 && tlsf.getLargestFree() == CAPACITY;
+
+        // Timed again without the shadow map.
+        double tlsfMs = bestOf(1, [&] {
+            for (const auto &request: requests) {
+                if (request.release && !resident.empty()) {
+                    size_t slot = request.victim % resident.size();
+                    tlsf.free(resident[slot].handle);
+                    resident[slot] = resident.back();
+                    resident.pop_back();
+                    continue;
+                }
+                auto allocation = tlsf.allocate(request.size, request.alignment, request.kind);
+                if (allocation.offset != TlsfAllocator::INVALID) {
+                    resident.push_back(allocation);
+                }
+            }
+            for (const auto &allocation: resident) {
+                tlsf.free(allocation.handle);
+            }
+        });
+
+        FreeListAllocator freeList{CAPACITY};
+        std::vector<uint64_t> offsets{};
+        double freeListMs = bestOf(1, [&] {
+            for (const auto &request: requests) {
+                if (request.release && !offsets.empty()) {
+                    size_t slot = request.victim % offsets.size();
+                    freeList.free(offsets[slot]);
+                    offsets[slot] = offsets.back();
+                    offsets.pop_back();
+                    continue;
+                }
+                uint64_t offset = freeList.allocate(request.size, request.alignment);
+                if (offset != FreeListAllocator::INVALID) {
+                    offsets.push_back(offset);
+                }
+            }
+            for (uint64_t offset: offsets) {
+                freeList.free(offset);
+            }
+        });
+
+        std::cout << std::fixed << std::setprecision(2) << "  fixed cases " << (fixedCases ? "ok" : "FAILED") << ", churn: "
+                  << failed << " allocations did not fit (" << peakFragmentation * 100.0 << "% peak fragmentation) | tlsf "
+                  << tlsfMs * 1e6 / OPERATIONS << " ns, free list " << freeListMs * 1e6 / OPERATIONS << " ns per operation "
+                  << (valid ? "[ok]" : "[FAILED]") << '\n';
+        return valid;
+    }
+}
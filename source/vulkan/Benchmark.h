@@ -0,0 +1,46 @@
+#ifndef VULKANLEARN_BENCHMARK_H
+#define VULKANLEARN_BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rendering {
+    // CPU side benchmarks and cross checks, run with `VulkanLearn --benchmark [model.obj ...]`.
+    // Nothing in here opens a window or creates a Vulkan device; GPU times of the shader
+    // permutations are taken by the Application with `VulkanLearn --benchmark-variants [frames]`.
+    class Benchmark {
+    public:
+        static int run(int argc, char** argv);
+
+    private:
+        static bool objLoading(const std::vector<std::string>& models);
+        static bool meshCache(const std::vector<std::string>& models);
+        static bool vertexDedup(const std::vector<std::string>& models);
+        static bool meshOptimization(const std::vector<std::string>& models);
+        static bool lodSelection(const std::vector<std::string>& models);
+        static bool vertexFormats(const std::vector<std::string>& models);
+        static bool meshletCulling(const std::vector<std::string>& models);
+        static bool geometryArena(const std::vector<std::string>& models);
+        static bool memoryAllocator();
+
+        static constexpr uint32_t LOD_GRID = 32;
+
+        // Best wall time of `runs` invocations, in milliseconds.
+        template <typename F>
+        static double bestOf(int runs, F&& f) {
+            double best = 1e30;
+            for (int i = 0; i < runs; i++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                f();
+                auto end = std::chrono::high_resolution_clock::now();
+                best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+            }
+            return best;
+        }
+    };
+}
+
+#endif //VULKANLEARN_BENCHMARK_H
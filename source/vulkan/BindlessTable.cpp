@@ -0,0 +1,135 @@
+
+#include "BindlessTable.h"
+#include "Device.hpp"
+#include "SwapChain.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+namespace rendering {
+
+    BindlessTable::BindlessTable(Device &_device) {
+        const VkPhysicalDeviceDescriptorIndexingProperties &limits = _device.descriptorIndexingProperties;
+        // combined image samplers count against both the sampled image and the sampler limits
+        images.capacity = std::min({MAX_IMAGES, limits.maxDescriptorSetUpdateAfterBindSampledImages,
+                                    limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                    limits.maxDescriptorSetUpdateAfterBindSamplers,
+                                    limits.maxPerStageDescriptorUpdateAfterBindSamplers});
+        buffers.capacity = std::min({MAX_BUFFERS, limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                     limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+        // both arrays are visible to the same stages, so together they share the per-stage resource
+        // limit; shrink them in proportion when it is smaller than their sum
+        uint64_t total = static_cast<uint64_t>(images.capacity) + buffers.capacity;
+        if (total > limits.maxPerStageUpdateAfterBindResources) {
+            images.capacity = static_cast<uint32_t>(
+                    images.capacity * static_cast<uint64_t>(limits.maxPerStageUpdateAfterBindResources) / total);
+            buffers.capacity = limits.maxPerStageUpdateAfterBindResources - images.capacity;
+        }
+
+        VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                                         VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                         VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        setLayout = DescriptorSetLayout::Builder(_device)
+                .addBinding(IMAGE_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, STAGES, images.capacity, flags)
+                .addBinding(BUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, STAGES, buffers.capacity, flags)
+                .build();
+        pool = DescriptorPool::Builder(_device)
+                .setMaxSets(1)
+                .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT)
+                .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, images.capacity)
+                .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffers.capacity)
+                .build();
+        if (!pool->allocateDescriptor(setLayout->getDescriptorSetLayout(), descriptorSet)) {
+            throw std::runtime_error("failed to allocate bindless descriptor set!");
+        }
+    }
+
+/**
+ * Writes an image to a free slot and returns the slot, the index shaders sample it with. Throws
+ * once every slot is taken.
+ */
+    uint32_t BindlessTable::addImage(VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout) {
+        VkDescriptorImageInfo imageInfo{sampler, imageView, imageLayout};
+        std::lock_guard<std::mutex> lock{mutex};
+        uint32_t slot = images.allocate();
+        if (slot == INVALID) {
+            throw std::runtime_error("bindless table is out of image slots");
+        }
+        VkDescriptorSet set = descriptorSet;
+        DescriptorWriter(*setLayout, *pool).writeImage(IMAGE_BINDING, &imageInfo, slot).overwrite(set);
+        return slot;
+    }
+
+    uint32_t BindlessTable::addBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+        VkDescriptorBufferInfo bufferInfo{buffer, offset, range};
+        std::lock_guard<std::mutex> lock{mutex};
+        uint32_t slot = buffers.allocate();
+        if (slot == INVALID) {
+            throw std::runtime_error("bindless table is out of buffer slots");
+        }
+        VkDescriptorSet set = descriptorSet;
+        DescriptorWriter(*setLayout, *pool).writeBuffer(BUFFER_BINDING, &bufferInfo, slot).overwrite(set);
+        return slot;
+    }
+
+    // The descriptor is left as it is, frames in flight may still read it and no later draw indexes it.
+    void BindlessTable::removeImage(uint32_t slot) {
+        retire(images, slot);
+    }
+
+    void BindlessTable::removeBuffer(uint32_t slot) {
+        retire(buffers, slot);
+    }
+
+/**
+ * Makes slots removed MAX_FRAMES_IN_FLIGHT frames ago available again. Call once per frame after
+ * the renderer waited for the frame's fence.
+ */
+    void BindlessTable::nextFrame() {
+        std::lock_guard<std::mutex> lock{mutex};
+        frame++;
+        auto reusable = std::stable_partition(retired.begin(), retired.end(), [this](const Retired &slot) {
+            return slot.frame + SwapChain::MAX_FRAMES_IN_FLIGHT > frame;
+        });
+        for (auto it = reusable; it != retired.end(); ++it) {
+            it->slots->free.push_back(it->slot);
+            it->slots->used--;
+        }
+        retired.erase(reusable, retired.end());
+    }
+
+    void BindlessTable::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setIndex,
+                             VkPipelineBindPoint bindPoint) const {
+        vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, setIndex, 1, &descriptorSet, 0, nullptr);
+    }
+
+    BindlessTable::Stats BindlessTable::getStats() {
+        std::lock_guard<std::mutex> lock{mutex};
+        return {images.used, buffers.used, images.capacity, buffers.capacity};
+    }
+
+    void BindlessTable::retire(Slots &slots, uint32_t slot) {
+        if (slot == INVALID) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock{mutex};
+        retired.push_back({&slots, slot, frame});
+    }
+
+    uint32_t BindlessTable::Slots::allocate() {
+        uint32_t slot;
+        if (!free.empty()) {
+            slot = free.back();
+            free.pop_back();
+        }
+        else if (next < capacity) {
+            slot = next++;
+        }
+        else {
+            return INVALID;
+        }
+        used++;
+        return slot;
+    }
+}
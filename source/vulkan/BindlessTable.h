@@ -0,0 +1,87 @@
+#ifndef VULKANLEARN_BINDLESSTABLE_H
+#define VULKANLEARN_BINDLESSTABLE_H
+
+#include "VulkanCommon.h"
+#include "Descriptor.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rendering {
+    class Device;
+
+    // One descriptor set, bound once per frame, with every sampled image at IMAGE_BINDING and every
+    // storage buffer at BUFFER_BINDING. Both are large partially bound, update after bind arrays,
+    // and a resource keeps its slot until it is removed, so draws pass slot indices through push
+    // constants or instance data instead of binding their own sets. Removed slots are reused once
+    // nextFrame() has been called MAX_FRAMES_IN_FLIGHT times. The Device creates it only when it has
+    // descriptor indexing, see Device::bindless(). Thread safe.
+    class BindlessTable {
+    public:
+        static constexpr uint32_t IMAGE_BINDING = 0;
+        static constexpr uint32_t BUFFER_BINDING = 1;
+        static constexpr uint32_t MAX_IMAGES = 16384;
+        static constexpr uint32_t MAX_BUFFERS = 16384;
+        static constexpr uint32_t INVALID = ~0u;
+        static constexpr VkShaderStageFlags STAGES =
+                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+        struct Stats {
+            uint32_t images = 0;
+            uint32_t buffers = 0;
+            uint32_t imageCapacity = 0;
+            uint32_t bufferCapacity = 0;
+        };
+
+        explicit BindlessTable(Device& _device);
+
+        BindlessTable(const BindlessTable&) = delete;
+        BindlessTable &operator = (const BindlessTable&) = delete;
+
+        uint32_t addImage(VkImageView imageView, VkSampler sampler,
+                          VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        uint32_t addBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+        void removeImage(uint32_t slot);
+        void removeBuffer(uint32_t slot);
+        void nextFrame();
+
+        void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setIndex,
+                  VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) const;
+
+        [[nodiscard]] VkDescriptorSet getDescriptorSet() const { return descriptorSet; }
+        [[nodiscard]] VkDescriptorSetLayout getDescriptorSetLayout() const { return setLayout->getDescriptorSetLayout(); }
+        [[nodiscard]] Stats getStats();
+
+    private:
+        // Slot indices of one array, freed ones are handed out again before new ones.
+        struct Slots {
+            uint32_t capacity = 0;
+            uint32_t next = 0;
+            uint32_t used = 0;
+            std::vector<uint32_t> free{};
+
+            uint32_t allocate();
+        };
+
+        struct Retired {
+            Slots* slots;
+            uint32_t slot;
+            uint64_t frame;
+        };
+
+        void retire(Slots& slots, uint32_t slot);
+
+        std::shared_ptr<DescriptorSetLayout> setLayout;
+        std::unique_ptr<DescriptorPool> pool;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+        std::mutex mutex;
+        Slots images{};
+        Slots buffers{};
+        std::vector<Retired> retired{};
+        uint64_t frame = 0;
+    };
+}
+
+#endif //VULKANLEARN_BINDLESSTABLE_H
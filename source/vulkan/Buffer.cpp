@@ -1,5 +1,6 @@
 
 #include "Buffer.h"
+#include "Descriptor.h"
 
 #include <cassert>
 #include <cstring>
@@ -28,7 +29,8 @@ namespace rendering {
             uint32_t instanceCount,
             VkBufferUsageFlags usageFlags,
             VkMemoryPropertyFlags memoryPropertyFlags,
-            VkDeviceSize minOffsetAlignment)
+            VkDeviceSize minOffsetAlignment,
+            MemoryBudget::Category category)
             : lveDevice{device},
               instanceSize{instanceSize},
               instanceCount{instanceCount},
@@ -36,66 +38,85 @@ namespace rendering {
               memoryPropertyFlags{memoryPropertyFlags} {
         alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
         bufferSize = alignmentSize * instanceCount;
-        device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory);
+        device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory, category);
     }
 
     Buffer::~Buffer() {
         unmap();
+        lveDevice.descriptorSets().invalidate(reinterpret_cast<uint64_t>(buffer));
         vkDestroyBuffer(lveDevice.device(), buffer, nullptr);
-        vkFreeMemory(lveDevice.device(), memory, nullptr);
+        lveDevice.memoryAllocator().free(memory);
     }
 
 /**
  * Map a memory range of this buffer. If successful, mapped points to the specified buffer range.
+ * Host visible memory stays mapped by the MemoryAllocator, so this only points into it.
  *
- * @param size (Optional) Size of the memory range to map. Pass VK_WHOLE_SIZE to map the complete
- * buffer range.
+ * @param size (Optional) Unused, the whole allocation stays mapped whatever range is asked for. Kept
+ * so callers can still state the range they intend to touch.
  * @param offset (Optional) Byte offset from beginning
  *
  * @return VkResult of the buffer mapping call
  */
-    VkResult Buffer::map(VkDeviceSize size, VkDeviceSize offset) {
-        assert(buffer && memory && "Called map on buffer before create");
-        return vkMapMemory(lveDevice.device(), memory, offset, size, 0, &mapped);
+    VkResult Buffer::map([[maybe_unused]] VkDeviceSize size, VkDeviceSize offset) {
+        assert(buffer && memory.memory && "Called map on buffer before create");
+        if (memory.mapped == nullptr) {
+            return VK_ERROR_MEMORY_MAP_FAILED;
+        }
+        mapped = static_cast<char *>(memory.mapped) + offset;
+        return VK_SUCCESS;
     }
 
 /**
  * Unmap a mapped memory range
  *
- * @note Does not return a result as vkUnmapMemory can't fail
+ * @note The memory itself stays mapped until its block is released
  */
     void Buffer::unmap() {
-        if (mapped) {
-            vkUnmapMemory(lveDevice.device(), memory);
-            mapped = nullptr;
-        }
+        mapped = nullptr;
     }
 
 /**
- * Copies the specified data to the mapped buffer. Default value writes whole buffer range
+ * Copies the specified data to the mapped buffer and marks the range dirty, see markDirty()
  *
  * @param data Pointer to the data to copy
- * @param size (Optional) Size of the data to copy. Pass VK_WHOLE_SIZE to flush the complete buffer
- * range.
+ * @param size (Optional) Size of the data to copy. Pass VK_WHOLE_SIZE to copy everything from
+ * offset to the end of the mapped region, data must be that large.
  * @param offset (Optional) Byte offset from beginning of mapped region
  *
  */
     void Buffer::writeToBuffer(void *data, VkDeviceSize size, VkDeviceSize offset) {
         assert(mapped && "Cannot copy to unmapped buffer");
 
+        VkDeviceSize mappedOffset = static_cast<char *>(mapped) - static_cast<char *>(memory.mapped);
         if (size == VK_WHOLE_SIZE) {
-            memcpy(mapped, data, bufferSize);
-        } else {
-            char *memOffset = (char *)mapped;
-            memOffset += offset;
-            memcpy(memOffset, data, size);
+            size = bufferSize - mappedOffset - offset;
         }
+        memcpy(static_cast<char *>(mapped) + offset, data, size);
+        markDirty(size, offset);
     }
 
 /**
- * Flush a memory range of the buffer to make it visible to the device
+ * Records that the host wrote a range of the mapped region, for callers writing through
+ * getMappedMemory() directly. On non coherent memory the range is flushed by the next
+ * MemoryAllocator::flushDirty() together with those of every other buffer, once per frame by the
+ * Renderer; on coherent memory this does nothing.
  *
- * @note Only required for non-coherent memory
+ * @param size (Optional) Size of the written range. Pass VK_WHOLE_SIZE for everything from offset
+ * to the end of the mapped region.
+ * @param offset (Optional) Byte offset from beginning of mapped region
+ */
+    void Buffer::markDirty(VkDeviceSize size, VkDeviceSize offset) {
+        assert(mapped && "Cannot write to unmapped buffer");
+        VkDeviceSize mappedOffset = static_cast<char *>(mapped) - static_cast<char *>(memory.mapped);
+        lveDevice.memoryAllocator().markDirty(memory, size, mappedOffset + offset);
+    }
+
+/**
+ * Flush a memory range of the buffer to make it visible to the device right away, instead of with
+ * the next MemoryAllocator::flushDirty()
+ *
+ * @note Only required for non-coherent memory, does nothing otherwise
  *
  * @param size (Optional) Size of the memory range to flush. Pass VK_WHOLE_SIZE to flush the
  * complete buffer range.
@@ -104,18 +125,17 @@ namespace rendering {
  * @return VkResult of the flush call
  */
     VkResult Buffer::flush(VkDeviceSize size, VkDeviceSize offset) {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
+        if (isCoherent()) {
+            return VK_SUCCESS;
+        }
+        VkMappedMemoryRange mappedRange = lveDevice.memoryAllocator().mappedRange(memory, size, offset);
         return vkFlushMappedMemoryRanges(lveDevice.device(), 1, &mappedRange);
     }
 
 /**
  * Invalidate a memory range of the buffer to make it visible to the host
  *
- * @note Only required for non-coherent memory
+ * @note Only required for non-coherent memory, does nothing otherwise
  *
  * @param size (Optional) Size of the memory range to invalidate. Pass VK_WHOLE_SIZE to invalidate
  * the complete buffer range.
@@ -124,11 +144,10 @@ namespace rendering {
  * @return VkResult of the invalidate call
  */
     VkResult Buffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
+        if (isCoherent()) {
+            return VK_SUCCESS;
+        }
+        VkMappedMemoryRange mappedRange = lveDevice.memoryAllocator().mappedRange(memory, size, offset);
         return vkInvalidateMappedMemoryRanges(lveDevice.device(), 1, &mappedRange);
     }
 
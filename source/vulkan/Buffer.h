@@ -14,7 +14,8 @@ namespace rendering {
                 uint32_t instanceCount,
                 VkBufferUsageFlags usageFlags,
                 VkMemoryPropertyFlags memoryPropertyFlags,
-                VkDeviceSize minOffsetAlignment = 1);
+                VkDeviceSize minOffsetAlignment = 1,
+                MemoryBudget::Category category = MemoryBudget::Category::Other);
         ~Buffer();
 
         Buffer(const Buffer&) = delete;
@@ -24,6 +25,9 @@ namespace rendering {
         void unmap();
 
         void writeToBuffer(void* data, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+        template<typename T>
+        void write(const T& value, VkDeviceSize offset = 0) { writeToBuffer((void*) &value, sizeof(T), offset); }
+        void markDirty(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
         VkResult flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
         VkDescriptorBufferInfo descriptorInfo(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
         VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
@@ -37,18 +41,21 @@ namespace rendering {
         [[nodiscard]] void* getMappedMemory() const { return mapped; }
         [[nodiscard]] uint32_t getInstanceCount() const { return instanceCount; }
         [[nodiscard]] VkDeviceSize getInstanceSize() const { return instanceSize; }
-        [[nodiscard]] VkDeviceSize getAlignmentSize() const { return instanceSize; }
+        [[nodiscard]] VkDeviceSize getAlignmentSize() const { return alignmentSize; }
         [[nodiscard]] VkBufferUsageFlags getUsageFlags() const { return usageFlags; }
         [[nodiscard]] VkMemoryPropertyFlags getMemoryPropertyFlags() const { return memoryPropertyFlags; }
         [[nodiscard]] VkDeviceSize getBufferSize() const { return bufferSize; }
 
-    private:
+        [[nodiscard]] bool isCoherent() const { return lveDevice.memoryAllocator().isCoherent(memory); }
+
         static VkDeviceSize getAlignment(VkDeviceSize instanceSize, VkDeviceSize minOffsetAlignment);
 
+    private:
+
         Device& lveDevice;
         void* mapped = nullptr;
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation memory{};
 
         VkDeviceSize bufferSize;
         uint32_t instanceCount;
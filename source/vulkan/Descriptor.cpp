@@ -1,6 +1,9 @@
 
 #include "Descriptor.h"
+#include "renderingutility.h"
+#include "SwapChain.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 
@@ -12,7 +15,8 @@ namespace rendering {
             uint32_t binding,
             VkDescriptorType descriptorType,
             VkShaderStageFlags stageFlags,
-            uint32_t count) {
+            uint32_t count,
+            VkDescriptorBindingFlags flags) {
         assert(bindings.count(binding) == 0 && "Binding already in use");
         VkDescriptorSetLayoutBinding layoutBinding{};
         layoutBinding.binding = binding;
@@ -20,27 +24,49 @@ namespace rendering {
         layoutBinding.descriptorCount = count;
         layoutBinding.stageFlags = stageFlags;
         bindings[binding] = layoutBinding;
+        if (flags != 0) {
+            assert(device.hasDescriptorIndexing() && "Binding flags need descriptor indexing");
+            bindingFlags[binding] = flags;
+        }
         return *this;
     }
 
-    std::unique_ptr<DescriptorSetLayout> DescriptorSetLayout::Builder::build() const {
-        return std::make_unique<DescriptorSetLayout>(device, bindings);
+    std::shared_ptr<DescriptorSetLayout> DescriptorSetLayout::Builder::build() const {
+        return device.descriptorLayouts().get(bindings, bindingFlags);
     }
 
 // *************** Descriptor Set Layout *********************
 
     DescriptorSetLayout::DescriptorSetLayout(
-            Device &device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings)
+            Device &device,
+            std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings,
+            const std::unordered_map<uint32_t, VkDescriptorBindingFlags> &bindingFlags)
             : device{device}, bindings{bindings} {
         std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+        std::vector<VkDescriptorBindingFlags> setLayoutFlags{};
+        VkDescriptorSetLayoutCreateFlags layoutFlags = 0;
         for (auto kv: bindings) {
             setLayoutBindings.push_back(kv.second);
+            auto flags = bindingFlags.find(kv.first);
+            setLayoutFlags.push_back(flags != bindingFlags.end() ? flags->second : 0);
+            if (setLayoutFlags.back() & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) {
+                layoutFlags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+            }
         }
 
         VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
         descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
         descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
         descriptorSetLayoutInfo.pBindings = setLayoutBindings.data();
+        descriptorSetLayoutInfo.flags = layoutFlags;
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        if (!bindingFlags.empty()) {
+            bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+            bindingFlagsInfo.bindingCount = static_cast<uint32_t>(setLayoutFlags.size());
+            bindingFlagsInfo.pBindingFlags = setLayoutFlags.data();
+            descriptorSetLayoutInfo.pNext = &bindingFlagsInfo;
+        }
 
         if (vkCreateDescriptorSetLayout(
                 device.device(),
@@ -49,12 +75,101 @@ namespace rendering {
                 &descriptorSetLayout) != VK_SUCCESS) {
             throw std::runtime_error("failed to create descriptor set layout!");
         }
+        createUpdateTemplate();
     }
 
     DescriptorSetLayout::~DescriptorSetLayout() {
+        if (updateTemplate != VK_NULL_HANDLE) {
+            vkDestroyDescriptorUpdateTemplate(device.device(), updateTemplate, nullptr);
+        }
         vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayout, nullptr);
     }
 
+    // One template entry per binding, in binding order, each reading one TemplateEntry.
+    void DescriptorSetLayout::createUpdateTemplate() {
+        if (device.properties.apiVersion < VK_API_VERSION_1_1 || bindings.empty()) {
+            return;
+        }
+        std::vector<uint32_t> order{};
+        for (const auto &kv: bindings) {
+            const VkDescriptorSetLayoutBinding &binding = kv.second;
+            if (binding.descriptorCount != 1 ||
+                binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER ||
+                binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER) {
+                return;
+            }
+            order.push_back(kv.first);
+        }
+        std::sort(order.begin(), order.end());
+
+        std::vector<VkDescriptorUpdateTemplateEntry> entries{};
+        for (uint32_t binding: order) {
+            templateSlots[binding] = static_cast<uint32_t>(entries.size());
+            VkDescriptorUpdateTemplateEntry entry{};
+            entry.dstBinding = binding;
+            entry.dstArrayElement = 0;
+            entry.descriptorCount = 1;
+            entry.descriptorType = bindings[binding].descriptorType;
+            entry.offset = entries.size() * sizeof(TemplateEntry);
+            entry.stride = sizeof(TemplateEntry);
+            entries.push_back(entry);
+        }
+
+        VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+        templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+        templateInfo.pDescriptorUpdateEntries = entries.data();
+        templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        templateInfo.descriptorSetLayout = descriptorSetLayout;
+        if (vkCreateDescriptorUpdateTemplate(device.device(), &templateInfo, nullptr, &updateTemplate) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor update template!");
+        }
+    }
+
+// *************** Descriptor Layout Cache *********************
+
+/**
+ * Returns the layout of these bindings, creating it the first time they are asked for.
+ */
+    std::shared_ptr<DescriptorSetLayout> DescriptorLayoutCache::get(
+            const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> &bindings,
+            const std::unordered_map<uint32_t, VkDescriptorBindingFlags> &bindingFlags) {
+        // Normalized: sorted by binding, immutable samplers are not supported by the builder.
+        std::vector<const VkDescriptorSetLayoutBinding *> sorted{};
+        for (const auto &kv: bindings) {
+            sorted.push_back(&kv.second);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) { return a->binding < b->binding; });
+        std::vector<uint64_t> key{};
+        for (const VkDescriptorSetLayoutBinding *binding: sorted) {
+            key.push_back(binding->binding);
+            key.push_back(binding->descriptorType);
+            key.push_back(binding->descriptorCount);
+            key.push_back(binding->stageFlags);
+            auto flags = bindingFlags.find(binding->binding);
+            key.push_back(flags != bindingFlags.end() ? flags->second : 0);
+        }
+
+        std::lock_guard<std::mutex> lock{mutex};
+        auto cached = layouts.find(key);
+        if (cached != layouts.end()) {
+            hits++;
+            return cached->second;
+        }
+        auto layout = std::make_shared<DescriptorSetLayout>(device, bindings, bindingFlags);
+        layouts.emplace(std::move(key), layout);
+        return layout;
+    }
+
+    DescriptorLayoutCache::Stats DescriptorLayoutCache::getStats() {
+        std::lock_guard<std::mutex> lock{mutex};
+        return {static_cast<uint32_t>(layouts.size()), hits};
+    }
+
+    size_t DescriptorLayoutCache::KeyHash::operator()(const std::vector<uint64_t> &key) const {
+        return hashBytes(key.data(), key.size() * sizeof(uint64_t));
+    }
+
 // *************** Descriptor Pool Builder *********************
 
     DescriptorPool::Builder &DescriptorPool::Builder::addPoolSize(
@@ -111,8 +226,7 @@ namespace rendering {
         allocInfo.pSetLayouts = &descriptorSetLayout;
         allocInfo.descriptorSetCount = 1;
 
-        // Might want to create a "DescriptorPoolManager" class that handles this case, and builds
-        // a new pool whenever an old pool fills up. But this is beyond our current scope
+        // Fails once the pool is full, DescriptorPoolManager grows by chaining pools instead.
         if (vkAllocateDescriptorSets(device.device(), &allocInfo, &descriptor) != VK_SUCCESS) {
             return false;
         }
@@ -131,25 +245,164 @@ namespace rendering {
         vkResetDescriptorPool(device.device(), descriptorPool, 0);
     }
 
+// *************** Descriptor Pool Manager *********************
+
+    DescriptorPoolManager::DescriptorPoolManager(
+            Device &device, uint32_t frameCount, std::vector<PoolSizeRatio> ratios)
+            : device{device}, ratios{std::move(ratios)}, frames(frameCount) {}
+
+    DescriptorPoolManager::~DescriptorPoolManager() {
+        std::vector<Chain *> chains{&persistent};
+        for (Chain &chain: frames) {
+            chains.push_back(&chain);
+        }
+        std::vector<VkDescriptorPool> pools = unusedPools;
+        for (Chain *chain: chains) {
+            pools.insert(pools.end(), chain->full.begin(), chain->full.end());
+            pools.push_back(chain->current);
+        }
+        for (VkDescriptorPool pool: pools) {
+            if (pool != VK_NULL_HANDLE) {
+                vkDestroyDescriptorPool(device.device(), pool, nullptr);
+            }
+        }
+    }
+
+/**
+ * Makes frameIndex the frame that allocateForFrame() serves and releases every set allocated for it
+ * the last time it was current. Its pools are reset; the filled ones go back to be reused by any
+ * chain, the last one stays with the frame.
+ */
+    void DescriptorPoolManager::beginFrame(uint32_t frameIndex) {
+        currentFrame = frameIndex;
+        Chain &chain = frames[frameIndex];
+        for (VkDescriptorPool pool: chain.full) {
+            vkResetDescriptorPool(device.device(), pool, 0);
+            unusedPools.push_back(pool);
+        }
+        poolResets += static_cast<uint32_t>(chain.full.size());
+        chain.full.clear();
+        if (chain.current != VK_NULL_HANDLE && chain.sets > 0) {
+            vkResetDescriptorPool(device.device(), chain.current, 0);
+            poolResets++;
+        }
+        chain.sets = 0;
+    }
+
+    // A set that lives as long as the manager.
+    VkDescriptorSet DescriptorPoolManager::allocate(VkDescriptorSetLayout descriptorSetLayout) {
+        return allocate(persistent, descriptorSetLayout);
+    }
+
+    // A set that is released by the next beginFrame() for the current frame.
+    VkDescriptorSet DescriptorPoolManager::allocateForFrame(VkDescriptorSetLayout descriptorSetLayout) {
+        return allocate(frames[currentFrame], descriptorSetLayout);
+    }
+
+    DescriptorPoolManager::Stats DescriptorPoolManager::getStats() const {
+        Stats stats{};
+        stats.pools = poolCount;
+        stats.persistentSets = persistent.sets;
+        for (const Chain &chain: frames) {
+            stats.frameSets += chain.sets;
+        }
+        stats.poolResets = poolResets;
+        stats.exhaustedPools = exhaustedPools;
+        return stats;
+    }
+
+    // Enough for uniform and storage buffers and sampled textures, the types our sets use.
+    std::vector<DescriptorPoolManager::PoolSizeRatio> DescriptorPoolManager::defaultRatios() {
+        return {
+                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f},
+                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f},
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f},
+                {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.0f},
+                {VK_DESCRIPTOR_TYPE_SAMPLER, 1.0f},
+                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f},
+        };
+    }
+
+    // Allocates from the chain's current pool and moves on to another pool when it is full.
+    VkDescriptorSet DescriptorPoolManager::allocate(Chain &chain, VkDescriptorSetLayout descriptorSetLayout) {
+        if (chain.current == VK_NULL_HANDLE) {
+            chain.current = acquirePool();
+        }
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = chain.current;
+        allocInfo.pSetLayouts = &descriptorSetLayout;
+        allocInfo.descriptorSetCount = 1;
+
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        VkResult result = vkAllocateDescriptorSets(device.device(), &allocInfo, &set);
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+            chain.full.push_back(chain.current);
+            chain.current = acquirePool();
+            exhaustedPools++;
+            allocInfo.descriptorPool = chain.current;
+            result = vkAllocateDescriptorSets(device.device(), &allocInfo, &set);
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate descriptor set!");
+        }
+        chain.sets++;
+        return set;
+    }
+
+    // Reuses a pool that was reset, or creates one twice as large as the previous, up to MAX_SETS.
+    VkDescriptorPool DescriptorPoolManager::acquirePool() {
+        if (!unusedPools.empty()) {
+            VkDescriptorPool pool = unusedPools.back();
+            unusedPools.pop_back();
+            return pool;
+        }
+        std::vector<VkDescriptorPoolSize> poolSizes{};
+        for (const PoolSizeRatio &ratio: ratios) {
+            poolSizes.push_back({ratio.type, std::max(1u, static_cast<uint32_t>(ratio.ratio * setsPerPool))});
+        }
+        VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+        descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        descriptorPoolInfo.pPoolSizes = poolSizes.data();
+        descriptorPoolInfo.maxSets = setsPerPool;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(device.device(), &descriptorPoolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
+        poolCount++;
+        setsPerPool = std::min(setsPerPool * 2, MAX_SETS);
+        return pool;
+    }
+
 // *************** Descriptor Writer *********************
 
     DescriptorWriter::DescriptorWriter(DescriptorSetLayout &setLayout, DescriptorPool &pool)
-            : setLayout{setLayout}, pool{pool} {}
+            : setLayout{setLayout}, pool{&pool} {}
+
+    DescriptorWriter::DescriptorWriter(DescriptorSetLayout &setLayout) : setLayout{setLayout} {}
+
+    DescriptorWriter::DescriptorWriter(DescriptorSetLayout &setLayout, DescriptorPoolManager &pools, bool perFrame)
+            : setLayout{setLayout}, pools{&pools}, perFrame{perFrame} {}
 
     DescriptorWriter &DescriptorWriter::writeBuffer(
-            uint32_t binding, VkDescriptorBufferInfo *bufferInfo) {
+            uint32_t binding, VkDescriptorBufferInfo *bufferInfo, uint32_t arrayElement) {
         assert(setLayout.bindings.count(binding) == 1 && "Layout does not contain specified binding");
 
         auto &bindingDescription = setLayout.bindings[binding];
 
         assert(
-                bindingDescription.descriptorCount == 1 &&
-                "Binding single descriptor info, but binding expects multiple");
+                arrayElement < bindingDescription.descriptorCount &&
+                "Array element out of range of the binding");
 
         VkWriteDescriptorSet write{};
         write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         write.descriptorType = bindingDescription.descriptorType;
         write.dstBinding = binding;
+        write.dstArrayElement = arrayElement;
         write.pBufferInfo = bufferInfo;
         write.descriptorCount = 1;
 
@@ -158,19 +411,20 @@ namespace rendering {
     }
 
     DescriptorWriter &DescriptorWriter::writeImage(
-            uint32_t binding, VkDescriptorImageInfo *imageInfo) {
+            uint32_t binding, VkDescriptorImageInfo *imageInfo, uint32_t arrayElement) {
         assert(setLayout.bindings.count(binding) == 1 && "Layout does not contain specified binding");
 
         auto &bindingDescription = setLayout.bindings[binding];
 
         assert(
-                bindingDescription.descriptorCount == 1 &&
-                "Binding single descriptor info, but binding expects multiple");
+                arrayElement < bindingDescription.descriptorCount &&
+                "Array element out of range of the binding");
 
         VkWriteDescriptorSet write{};
         write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         write.descriptorType = bindingDescription.descriptorType;
         write.dstBinding = binding;
+        write.dstArrayElement = arrayElement;
         write.pImageInfo = imageInfo;
         write.descriptorCount = 1;
 
@@ -179,18 +433,177 @@ namespace rendering {
     }
 
     bool DescriptorWriter::build(VkDescriptorSet &set) {
-        bool success = pool.allocateDescriptor(setLayout.getDescriptorSetLayout(), set);
-        if (!success) {
+        assert((pool != nullptr || pools != nullptr) && "Writer has no pool, use buildCached");
+        if (pools != nullptr) {
+            set = perFrame ? pools->allocateForFrame(setLayout.getDescriptorSetLayout())
+                           : pools->allocate(setLayout.getDescriptorSetLayout());
+        }
+        else if (!pool->allocateDescriptor(setLayout.getDescriptorSetLayout(), set)) {
             return false;
         }
         overwrite(set);
         return true;
     }
 
+/**
+ * Returns a set with these writes from the Device's DescriptorSetCache, written only the first time
+ * this layout and these resources are asked for. Do not overwrite it, other writers share it.
+ */
+    VkDescriptorSet DescriptorWriter::buildCached() {
+        return setLayout.device.descriptorSets().get(*this);
+    }
+
+    // With an update template, when the writes cover every binding of the layout.
     void DescriptorWriter::overwrite(VkDescriptorSet &set) {
+        if (setLayout.updateTemplate != VK_NULL_HANDLE && writes.size() == setLayout.templateSlots.size()) {
+            std::vector<DescriptorSetLayout::TemplateEntry> data(writes.size());
+            std::vector<bool> written(writes.size(), false);
+            for (const auto &write: writes) {
+                uint32_t slot = setLayout.templateSlots[write.dstBinding];
+                written[slot] = true;
+                if (write.pBufferInfo != nullptr) {
+                    data[slot].buffer = *write.pBufferInfo;
+                }
+                else {
+                    data[slot].image = *write.pImageInfo;
+                }
+            }
+            if (std::find(written.begin(), written.end(), false) == written.end()) {
+                vkUpdateDescriptorSetWithTemplate(setLayout.device.device(), set, setLayout.updateTemplate, data.data());
+                return;
+            }
+        }
         for (auto &write: writes) {
             write.dstSet = set;
         }
-        vkUpdateDescriptorSets(pool.device.device(), writes.size(), writes.data(), 0, nullptr);
+        vkUpdateDescriptorSets(setLayout.device.device(), writes.size(), writes.data(), 0, nullptr);
+    }
+
+    // The layout and, per write in binding order, what it writes.
+    std::vector<uint64_t> DescriptorWriter::cacheKey() const {
+        std::vector<const VkWriteDescriptorSet *> sorted{};
+        for (const auto &write: writes) {
+            sorted.push_back(&write);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) {
+            return a->dstBinding != b->dstBinding ? a->dstBinding < b->dstBinding
+                                                  : a->dstArrayElement < b->dstArrayElement;
+        });
+        std::vector<uint64_t> key{reinterpret_cast<uint64_t>(setLayout.getDescriptorSetLayout())};
+        for (const VkWriteDescriptorSet *write: sorted) {
+            key.push_back(write->dstBinding);
+            key.push_back(write->dstArrayElement);
+            if (write->pBufferInfo != nullptr) {
+                key.push_back(reinterpret_cast<uint64_t>(write->pBufferInfo->buffer));
+                key.push_back(write->pBufferInfo->offset);
+                key.push_back(write->pBufferInfo->range);
+            }
+            else {
+                key.push_back(reinterpret_cast<uint64_t>(write->pImageInfo->sampler));
+                key.push_back(reinterpret_cast<uint64_t>(write->pImageInfo->imageView));
+                key.push_back(write->pImageInfo->imageLayout);
+            }
+        }
+        return key;
+    }
+
+    // Handles whose destruction invalidates a set with these writes.
+    std::vector<uint64_t> DescriptorWriter::resources() const {
+        std::vector<uint64_t> handles{};
+        for (const auto &write: writes) {
+            if (write.pBufferInfo != nullptr) {
+                handles.push_back(reinterpret_cast<uint64_t>(write.pBufferInfo->buffer));
+            }
+            else {
+                if (write.pImageInfo->sampler != VK_NULL_HANDLE) {
+                    handles.push_back(reinterpret_cast<uint64_t>(write.pImageInfo->sampler));
+                }
+                if (write.pImageInfo->imageView != VK_NULL_HANDLE) {
+                    handles.push_back(reinterpret_cast<uint64_t>(write.pImageInfo->imageView));
+                }
+            }
+        }
+        return handles;
+    }
+
+// *************** Descriptor Set Cache *********************
+
+    DescriptorSetCache::DescriptorSetCache(Device &device) : pools{device, 0} {}
+
+    VkDescriptorSet DescriptorSetCache::get(DescriptorWriter &writer) {
+        std::vector<uint64_t> key = writer.cacheKey();
+        std::lock_guard<std::mutex> lock{mutex};
+        auto cached = sets.find(key);
+        if (cached != sets.end()) {
+            stats.hits++;
+            return cached->second;
+        }
+        stats.misses++;
+
+        VkDescriptorSetLayout layout = writer.setLayout.getDescriptorSetLayout();
+        VkDescriptorSet set;
+        auto &spare = spareSets[layout];
+        if (!spare.empty()) {
+            set = spare.back();
+            spare.pop_back();
+        }
+        else {
+            set = pools.allocate(layout);
+            stats.sets++;
+        }
+        writer.overwrite(set);
+        for (uint64_t resource: writer.resources()) {
+            users[resource].push_back(key);
+        }
+        sets.emplace(std::move(key), set);
+        return set;
+    }
+
+/**
+ * Drops every cached set that references a buffer, image view or sampler about to be destroyed.
+ * Their sets are kept for reuse by their layout.
+ */
+    void DescriptorSetCache::invalidate(uint64_t resource) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto found = users.find(resource);
+        if (found == users.end()) {
+            return;
+        }
+        for (const auto &key: found->second) {
+            auto cached = sets.find(key);
+            if (cached == sets.end()) {
+                continue; // already dropped through another of its resources
+            }
+            auto layout = reinterpret_cast<VkDescriptorSetLayout>(key.front());
+            retired.push_back({layout, cached->second, frame});
+            sets.erase(cached);
+            stats.invalidated++;
+        }
+        users.erase(found);
+    }
+
+/**
+ * Makes sets invalidated MAX_FRAMES_IN_FLIGHT frames ago available again. Call once per frame after
+ * the renderer waited for the frame's fence.
+ */
+    void DescriptorSetCache::nextFrame() {
+        std::lock_guard<std::mutex> lock{mutex};
+        frame++;
+        auto reusable = std::stable_partition(retired.begin(), retired.end(), [this](const Retired &set) {
+            return set.frame + SwapChain::MAX_FRAMES_IN_FLIGHT > frame;
+        });
+        for (auto it = reusable; it != retired.end(); ++it) {
+            spareSets[it->layout].push_back(it->set);
+        }
+        retired.erase(reusable, retired.end());
+    }
+
+    DescriptorSetCache::Stats DescriptorSetCache::getStats() {
+        std::lock_guard<std::mutex> lock{mutex};
+        return stats;
+    }
+
+    size_t DescriptorSetCache::KeyHash::operator()(const std::vector<uint64_t> &key) const {
+        return hashBytes(key.data(), key.size() * sizeof(uint64_t));
     }
-}
\ No newline at end of file
+}
@@ -5,6 +5,7 @@
 #include "Device.hpp"
 
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -20,17 +21,23 @@ namespace rendering {
                     uint32_t binding,
                     VkDescriptorType descriptorType,
                     VkShaderStageFlags stageFlags,
-                    uint32_t count = 1);
+                    uint32_t count = 1,
+                    VkDescriptorBindingFlags flags = 0);
 
-            std::unique_ptr<DescriptorSetLayout> build() const;
+            // Shared with every other layout of the same bindings, see DescriptorLayoutCache.
+            std::shared_ptr<DescriptorSetLayout> build() const;
 
         private:
             Device &device;
             std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings{};
+            // VK_EXT_descriptor_indexing flags, only for bindings that have any.
+            std::unordered_map<uint32_t, VkDescriptorBindingFlags> bindingFlags{};
         };
 
         DescriptorSetLayout(
-                Device &device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings);
+                Device &device,
+                std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings,
+                const std::unordered_map<uint32_t, VkDescriptorBindingFlags> &bindingFlags = {});
 
         ~DescriptorSetLayout();
 
@@ -41,13 +48,57 @@ namespace rendering {
         VkDescriptorSetLayout getDescriptorSetLayout() const { return descriptorSetLayout; }
 
     private:
+        // What a descriptor update template reads for one binding.
+        union TemplateEntry {
+            VkDescriptorBufferInfo buffer;
+            VkDescriptorImageInfo image;
+        };
+
+        void createUpdateTemplate();
+
         Device &device;
         VkDescriptorSetLayout descriptorSetLayout;
         std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings;
+        // Writes every binding at once from an array of TemplateEntry, indexed by templateSlots.
+        // Null before Vulkan 1.1 or when a binding is an array or a texel buffer.
+        VkDescriptorUpdateTemplate updateTemplate = VK_NULL_HANDLE;
+        std::unordered_map<uint32_t, uint32_t> templateSlots{};
 
         friend class DescriptorWriter;
     };
 
+    // Every layout built with the same bindings, in whatever order they were added, is one shared
+    // DescriptorSetLayout. Layouts stay alive as long as the cache, which the Device owns. Thread safe.
+    class DescriptorLayoutCache {
+    public:
+        struct Stats {
+            uint32_t layouts = 0;
+            uint32_t hits = 0;
+        };
+
+        explicit DescriptorLayoutCache(Device &device) : device{device} {}
+
+        DescriptorLayoutCache(const DescriptorLayoutCache &) = delete;
+
+        DescriptorLayoutCache &operator=(const DescriptorLayoutCache &) = delete;
+
+        std::shared_ptr<DescriptorSetLayout> get(
+                const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> &bindings,
+                const std::unordered_map<uint32_t, VkDescriptorBindingFlags> &bindingFlags = {});
+
+        [[nodiscard]] Stats getStats();
+
+    private:
+        struct KeyHash {
+            size_t operator()(const std::vector<uint64_t> &key) const;
+        };
+
+        Device &device;
+        std::mutex mutex;
+        std::unordered_map<std::vector<uint64_t>, std::shared_ptr<DescriptorSetLayout>, KeyHash> layouts{};
+        uint32_t hits = 0;
+    };
+
     class DescriptorPool {
     public:
         class Builder {
@@ -95,22 +146,157 @@ namespace rendering {
         friend class DescriptorWriter;
     };
 
+    // Hands out descriptor sets without an upper bound: a chain of pools grows by another pool when
+    // its current one runs out, where DescriptorPool would fail. Persistent sets live as long as the
+    // manager. Frame sets come from the pools of one frame in flight and are all released together
+    // by beginFrame() for that frame, which resets the pools instead of freeing sets one by one; call
+    // it only once the frame's previous submission has finished. Pools that were reset are reused by
+    // every chain before new ones are created. Not thread safe.
+    class DescriptorPoolManager {
+    public:
+        static constexpr uint32_t INITIAL_SETS = 64;
+        static constexpr uint32_t MAX_SETS = 4096;
+
+        // Descriptors of a type per set, a pool for n sets holds ratio * n of them.
+        struct PoolSizeRatio {
+            VkDescriptorType type;
+            float ratio;
+        };
+
+        struct Stats {
+            uint32_t pools = 0;
+            uint32_t persistentSets = 0;
+            uint32_t frameSets = 0; // of every frame in flight, since their last beginFrame()
+            uint32_t poolResets = 0;
+            uint32_t exhaustedPools = 0; // times a chain moved on to another pool
+        };
+
+        DescriptorPoolManager(Device &device, uint32_t frameCount, std::vector<PoolSizeRatio> ratios = defaultRatios());
+
+        ~DescriptorPoolManager();
+
+        DescriptorPoolManager(const DescriptorPoolManager &) = delete;
+
+        DescriptorPoolManager &operator=(const DescriptorPoolManager &) = delete;
+
+        void beginFrame(uint32_t frameIndex);
+
+        VkDescriptorSet allocate(VkDescriptorSetLayout descriptorSetLayout);
+
+        VkDescriptorSet allocateForFrame(VkDescriptorSetLayout descriptorSetLayout);
+
+        [[nodiscard]] Stats getStats() const;
+
+        static std::vector<PoolSizeRatio> defaultRatios();
+
+    private:
+        struct Chain {
+            VkDescriptorPool current = VK_NULL_HANDLE;
+            std::vector<VkDescriptorPool> full{};
+            uint32_t sets = 0;
+        };
+
+        VkDescriptorSet allocate(Chain &chain, VkDescriptorSetLayout descriptorSetLayout);
+
+        VkDescriptorPool acquirePool();
+
+        Device &device;
+        std::vector<PoolSizeRatio> ratios;
+        uint32_t setsPerPool = INITIAL_SETS;
+        Chain persistent{};
+        std::vector<Chain> frames;
+        uint32_t currentFrame = 0;
+        std::vector<VkDescriptorPool> unusedPools{};
+        uint32_t poolCount = 0;
+        uint32_t poolResets = 0;
+        uint32_t exhaustedPools = 0;
+    };
+
     class DescriptorWriter {
     public:
         DescriptorWriter(DescriptorSetLayout &setLayout, DescriptorPool &pool);
 
-        DescriptorWriter &writeBuffer(uint32_t binding, VkDescriptorBufferInfo *bufferInfo);
+        // Only for buildCached(), which allocates from the Device's DescriptorSetCache.
+        explicit DescriptorWriter(DescriptorSetLayout &setLayout);
+
+        // Allocates from the manager, for the current frame only when perFrame is set.
+        DescriptorWriter(DescriptorSetLayout &setLayout, DescriptorPoolManager &pools, bool perFrame = false);
 
-        DescriptorWriter &writeImage(uint32_t binding, VkDescriptorImageInfo *imageInfo);
+        // arrayElement selects the descriptor of an array binding.
+        DescriptorWriter &writeBuffer(uint32_t binding, VkDescriptorBufferInfo *bufferInfo, uint32_t arrayElement = 0);
+
+        DescriptorWriter &writeImage(uint32_t binding, VkDescriptorImageInfo *imageInfo, uint32_t arrayElement = 0);
 
         bool build(VkDescriptorSet &set);
 
+        VkDescriptorSet buildCached();
+
         void overwrite(VkDescriptorSet &set);
 
     private:
+        [[nodiscard]] std::vector<uint64_t> cacheKey() const;
+
+        [[nodiscard]] std::vector<uint64_t> resources() const;
+
         DescriptorSetLayout &setLayout;
-        DescriptorPool &pool;
+        DescriptorPool *pool = nullptr;
+        DescriptorPoolManager *pools = nullptr;
+        bool perFrame = false;
         std::vector<VkWriteDescriptorSet> writes;
+
+        friend class DescriptorSetCache;
+    };
+
+    // Reuses descriptor sets across DescriptorWriter::buildCached calls that write the same
+    // resources to the same layout, so unchanged materials and passes cost neither an allocation nor
+    // a vkUpdateDescriptorSets. Destroying a resource invalidates the sets that reference it: whoever
+    // destroys a buffer, image view or sampler calls invalidate() first, as Buffer and SwapChain do,
+    // or a recycled handle would hit a stale set. Invalidated sets are rewritten for another key of
+    // their layout once nextFrame() has been called MAX_FRAMES_IN_FLIGHT times, since frames still
+    // executing may read them. The Device owns the cache. Thread safe.
+    class DescriptorSetCache {
+    public:
+        struct Stats {
+            uint32_t sets = 0;
+            uint32_t hits = 0;
+            uint32_t misses = 0;
+            uint32_t invalidated = 0;
+        };
+
+        explicit DescriptorSetCache(Device &device);
+
+        DescriptorSetCache(const DescriptorSetCache &) = delete;
+
+        DescriptorSetCache &operator=(const DescriptorSetCache &) = delete;
+
+        VkDescriptorSet get(DescriptorWriter &writer);
+
+        void invalidate(uint64_t resource);
+
+        void nextFrame();
+
+        [[nodiscard]] Stats getStats();
+
+    private:
+        struct KeyHash {
+            size_t operator()(const std::vector<uint64_t> &key) const;
+        };
+
+        struct Retired {
+            VkDescriptorSetLayout layout;
+            VkDescriptorSet set;
+            uint64_t frame;
+        };
+
+        DescriptorPoolManager pools;
+        std::mutex mutex;
+        std::unordered_map<std::vector<uint64_t>, VkDescriptorSet, KeyHash> sets{};
+        // Keys of the cached sets that reference each resource handle.
+        std::unordered_map<uint64_t, std::vector<std::vector<uint64_t>>> users{};
+        std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSet>> spareSets{};
+        std::vector<Retired> retired{};
+        uint64_t frame = 0;
+        Stats stats{};
     };
 }
 
@@ -1,4 +1,13 @@
 #include "Device.hpp"
+#include "BindlessTable.h"
+#include "Descriptor.h"
+#include "GeometryArena.h"
+#include "PipelineCache.h"
+#include "PipelineCompiler.h"
+#include "PipelineRegistry.h"
+#include "ShaderModuleCache.h"
+#include "StagingRing.h"
+#include "TransferBatch.h"
 
 #include <cstring>
 #include <iostream>
@@ -52,11 +61,36 @@ Device::Device(Window &window) : window{window} {
   createSurface();
   pickPhysicalDevice();
   createLogicalDevice();
+  memoryAllocator_ = std::make_unique<MemoryAllocator>(device_, physicalDevice, memoryBudget_);
   createCommandPool();
+  descriptorLayouts_ = std::make_unique<DescriptorLayoutCache>(*this);
+  descriptorSets_ = std::make_unique<DescriptorSetCache>(*this);
+  pipelineCache_ = std::make_unique<PipelineCache>(*this);
+  shaderModules_ = std::make_unique<ShaderModuleCache>(*this);
+  pipelines_ = std::make_unique<PipelineRegistry>(*this);
+  pipelineCompiler_ = std::make_unique<PipelineCompiler>(*this);
+  if (descriptorIndexing_) {
+    bindless_ = std::make_unique<BindlessTable>(*this);
+  }
+  stagingRing_ = std::make_unique<StagingRing>(*this);
+  transfers_ = std::make_unique<TransferQueue>(*this);
+  geometryArena_ = std::make_unique<GeometryArena>(*this);
 }
 
 Device::~Device() {
+  geometryArena_.reset();
+  transfers_.reset();
+  stagingRing_.reset();
+  bindless_.reset();
+  pipelineCompiler_.reset();
+  pipelines_.reset();
+  shaderModules_.reset();
+  pipelineCache_.reset();
+  descriptorSets_.reset();
+  descriptorLayouts_.reset();
+  memoryAllocator_.reset();
   vkDestroyCommandPool(device_, commandPool, nullptr);
+  vkDestroyCommandPool(device_, computeCommandPool, nullptr);
   vkDestroyDevice(device_, nullptr);
 
   if (enableValidationLayers) {
@@ -78,7 +112,7 @@ void Device::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  appInfo.apiVersion = VK_API_VERSION_1_1;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -136,7 +170,8 @@ void Device::createLogicalDevice() {
   QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-  std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+  std::set<uint32_t> uniqueQueueFamilies = {
+      indices.graphicsFamily, indices.presentFamily, indices.transferFamily, indices.computeFamily};
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -157,9 +192,55 @@ void Device::createLogicalDevice() {
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
+  // Optional, the budget is queried with vkGetPhysicalDeviceMemoryProperties2 which is core since 1.1.
+  std::vector<const char *> extensions = deviceExtensions;
+  memoryBudget_ = properties.apiVersion >= VK_API_VERSION_1_1 &&
+                  hasDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (memoryBudget_) {
+    extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+
+  // Optional, for the BindlessTable. VK_KHR_maintenance3, which the extension needs, is core since 1.1.
+  VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+  indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  descriptorIndexing_ = properties.apiVersion >= VK_API_VERSION_1_1 &&
+                        hasDeviceExtension(physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+  if (descriptorIndexing_) {
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &indexingFeatures;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+    descriptorIndexing_ = indexingFeatures.descriptorBindingPartiallyBound &&
+                          indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+                          indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind &&
+                          indexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+                          indexingFeatures.shaderSampledImageArrayNonUniformIndexing &&
+                          indexingFeatures.runtimeDescriptorArray;
+  }
+  if (descriptorIndexing_) {
+    VkPhysicalDeviceDescriptorIndexingFeatures enabled{};
+    enabled.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    enabled.descriptorBindingPartiallyBound = VK_TRUE;
+    enabled.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    enabled.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    enabled.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    enabled.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    enabled.shaderStorageBufferArrayNonUniformIndexing = indexingFeatures.shaderStorageBufferArrayNonUniformIndexing;
+    enabled.runtimeDescriptorArray = VK_TRUE;
+    indexingFeatures = enabled;
+    createInfo.pNext = &indexingFeatures;
+    extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
+    descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &descriptorIndexingProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+  }
+
   createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
 
   // might not really be necessary anymore because device specific validation layers
   // have been deprecated
@@ -176,6 +257,8 @@ void Device::createLogicalDevice() {
 
   vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
   vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+  vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+  vkGetDeviceQueue(device_, indices.computeFamily, 0, &computeQueue_);
 }
 
 void Device::createCommandPool() {
@@ -190,6 +273,12 @@ void Device::createCommandPool() {
   if (vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
     throw std::runtime_error("failed to create command pool!");
   }
+
+  // Transfers have a pool of their own in TransferQueue.
+  poolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily;
+  if (vkCreateCommandPool(device_, &poolInfo, nullptr, &computeCommandPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute command pool!");
+  }
 }
 
 void Device::createSurface() { window.createWindowSurface(instance, &surface_); }
@@ -316,6 +405,25 @@ bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+bool Device::hasDeviceExtension(VkPhysicalDevice device, const char *extension) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(
+      device,
+      nullptr,
+      &extensionCount,
+      availableExtensions.data());
+
+  for (const auto &available : availableExtensions) {
+    if (strcmp(available.extensionName, extension) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -327,22 +435,43 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
 
   int i = 0;
   for (const auto &queueFamily : queueFamilies) {
-    if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+    if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT &&
+        !indices.graphicsFamilyHasValue) {
       indices.graphicsFamily = i;
       indices.graphicsFamilyHasValue = true;
     }
     VkBool32 presentSupport = false;
     vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-    if (queueFamily.queueCount > 0 && presentSupport) {
+    if (queueFamily.queueCount > 0 && presentSupport && !indices.presentFamilyHasValue) {
       indices.presentFamily = i;
       indices.presentFamilyHasValue = true;
     }
-    if (indices.isComplete()) {
-      break;
-    }
 
     i++;
   }
+  if (!indices.graphicsFamilyHasValue) {
+    return indices;
+  }
+
+  // Dedicated families run alongside the graphics queue: a transfer only family is the DMA
+  // engine, a compute family without graphics is async compute. Transfers make do with the
+  // latter when there is no DMA family.
+  auto findFamily = [&queueFamilies](VkQueueFlags required, VkQueueFlags excluded) -> int {
+    for (uint32_t family = 0; family < queueFamilies.size(); family++) {
+      VkQueueFlags flags = queueFamilies[family].queueFlags;
+      if (queueFamilies[family].queueCount > 0 && (flags & required) == required && !(flags & excluded)) {
+        return static_cast<int>(family);
+      }
+    }
+    return -1;
+  };
+  int transfer = findFamily(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+  int compute = findFamily(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+  if (transfer < 0) {
+    transfer = findFamily(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT);
+  }
+  indices.transferFamily = transfer < 0 ? indices.graphicsFamily : static_cast<uint32_t>(transfer);
+  indices.computeFamily = compute < 0 ? indices.graphicsFamily : static_cast<uint32_t>(compute);
 
   return indices;
 }
@@ -389,17 +518,9 @@ VkFormat Device::findSupportedFormat(
   throw std::runtime_error("failed to find supported format!");
 }
 
+// Prefers memory types whose heap still has budget, see MemoryAllocator::findMemoryType.
 uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-  VkPhysicalDeviceMemoryProperties memProperties;
-  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-    if ((typeFilter & (1 << i)) &&
-        (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-      return i;
-    }
-  }
-
-  throw std::runtime_error("failed to find suitable memory type!");
+  return memoryAllocator_->findMemoryType(typeFilter, properties);
 }
 
 void Device::createBuffer(
@@ -407,7 +528,8 @@ void Device::createBuffer(
     VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties,
     VkBuffer &buffer,
-    VkDeviceMemory &bufferMemory) {
+    MemoryAllocator::Allocation &bufferMemory,
+    MemoryBudget::Category category) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
@@ -421,94 +543,42 @@ void Device::createBuffer(
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate vertex buffer memory!");
+  try {
+    bufferMemory = memoryAllocator_->allocate(memRequirements, properties, MemoryAllocator::Kind::Linear, category);
+  } catch (...) {
+    vkDestroyBuffer(device_, buffer, nullptr);
+    throw;
   }
 
-  vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+  vkBindBufferMemory(device_, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
-VkCommandBuffer Device::beginSingleTimeCommands() {
-  VkCommandBufferAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandPool = commandPool;
-  allocInfo.commandBufferCount = 1;
-
-  VkCommandBuffer commandBuffer;
-  vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer);
-
-  VkCommandBufferBeginInfo beginInfo{};
-  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-  vkBeginCommandBuffer(commandBuffer, &beginInfo);
-  return commandBuffer;
+void Device::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset) {
+  TransferBatch batch{*this};
+  batch.copyBuffer(srcBuffer, dstBuffer, size, 0, dstOffset);
+  transfers_->wait(batch.submit());
 }
 
-void Device::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-  vkEndCommandBuffer(commandBuffer);
-
-  VkSubmitInfo submitInfo{};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &commandBuffer;
-
-  vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphicsQueue_);
-
-  vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
-}
-
-void Device::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-  VkBufferCopy copyRegion{};
-  copyRegion.srcOffset = 0;  // Optional
-  copyRegion.dstOffset = 0;  // Optional
-  copyRegion.size = size;
-  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-  endSingleTimeCommands(commandBuffer);
+// Copies host data into a device local buffer through the staging ring and waits for it.
+void Device::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size) {
+  TransferBatch batch{*this};
+  batch.uploadBuffer(dstBuffer, dstOffset, data, size);
+  transfers_->wait(batch.submit());
 }
 
 void Device::copyBufferToImage(
     VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-  VkBufferImageCopy region{};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
-
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = layerCount;
-
-  region.imageOffset = {0, 0, 0};
-  region.imageExtent = {width, height, 1};
-
-  vkCmdCopyBufferToImage(
-      commandBuffer,
-      buffer,
-      image,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      1,
-      &region);
-  endSingleTimeCommands(commandBuffer);
+  TransferBatch batch{*this};
+  batch.copyBufferToImage(buffer, image, width, height, layerCount);
+  transfers_->wait(batch.submit());
 }
 
 void Device::createImageWithInfo(
     const VkImageCreateInfo &imageInfo,
     VkMemoryPropertyFlags properties,
     VkImage &image,
-    VkDeviceMemory &imageMemory) {
+    MemoryAllocator::Allocation &imageMemory,
+    MemoryBudget::Category category) {
   if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
     throw std::runtime_error("failed to create image!");
   }
@@ -516,16 +586,11 @@ void Device::createImageWithInfo(
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
-  }
+  MemoryAllocator::Kind kind = imageInfo.tiling == VK_IMAGE_TILING_LINEAR ? MemoryAllocator::Kind::Linear
+                                                                          : MemoryAllocator::Kind::Optimal;
+  imageMemory = memoryAllocator_->allocate(memRequirements, properties, kind, category);
 
-  if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+  if (vkBindImageMemory(device_, image, imageMemory.memory, imageMemory.offset) != VK_SUCCESS) {
     throw std::runtime_error("failed to bind image memory!");
   }
 }
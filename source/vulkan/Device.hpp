@@ -1,25 +1,44 @@
 #pragma once
 #include "VulkanCommon.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "MemoryAllocator.h"
 #include "Window.h"
 
 namespace rendering {
 
+class BindlessTable;
+class DescriptorLayoutCache;
+class DescriptorSetCache;
+class GeometryArena;
+class PipelineCache;
+class PipelineCompiler;
+class PipelineRegistry;
+class ShaderModuleCache;
+class StagingRing;
+class TransferQueue;
+
 struct SwapChainSupportDetails {
   VkSurfaceCapabilitiesKHR capabilities;
   std::vector<VkSurfaceFormatKHR> formats;
   std::vector<VkPresentModeKHR> presentModes;
 };
 
+// Transfer and compute fall back to the graphics family on devices without families dedicated to
+// them, so they are always valid once isComplete().
 struct QueueFamilyIndices {
   uint32_t graphicsFamily;
   uint32_t presentFamily;
+  uint32_t transferFamily;
+  uint32_t computeFamily;
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
   bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
+  bool hasDedicatedTransfer() const { return transferFamily != graphicsFamily; }
+  bool hasDedicatedCompute() const { return computeFamily != graphicsFamily; }
 };
 
 class Device {
@@ -40,10 +59,30 @@ class Device {
   Device &operator=(Device &&) = delete;
 
   VkCommandPool getCommandPool() { return commandPool; }
+  VkCommandPool getComputeCommandPool() { return computeCommandPool; }
   VkDevice device() { return device_; }
   VkSurfaceKHR surface() { return surface_; }
   VkQueue graphicsQueue() { return graphicsQueue_; }
   VkQueue presentQueue() { return presentQueue_; }
+  // The graphics queue unless the device has a dedicated family for the work.
+  VkQueue transferQueue() { return transferQueue_; }
+  VkQueue computeQueue() { return computeQueue_; }
+  GeometryArena &geometryArena() { return *geometryArena_; }
+  MemoryAllocator &memoryAllocator() { return *memoryAllocator_; }
+  StagingRing &stagingRing() { return *stagingRing_; }
+  TransferQueue &transfers() { return *transfers_; }
+  DescriptorLayoutCache &descriptorLayouts() { return *descriptorLayouts_; }
+  DescriptorSetCache &descriptorSets() { return *descriptorSets_; }
+  PipelineCache &pipelineCache() { return *pipelineCache_; }
+  ShaderModuleCache &shaderModules() { return *shaderModules_; }
+  PipelineRegistry &pipelines() { return *pipelines_; }
+  PipelineCompiler &pipelineCompiler() { return *pipelineCompiler_; }
+  // Null without descriptor indexing, then resources are bound with regular descriptor sets.
+  BindlessTable *bindless() { return bindless_.get(); }
+  // Whether VK_EXT_memory_budget is enabled, else the MemoryBudget estimates heap budgets.
+  bool hasMemoryBudget() const { return memoryBudget_; }
+  // Whether VK_EXT_descriptor_indexing is enabled with what the BindlessTable needs.
+  bool hasDescriptorIndexing() const { return descriptorIndexing_; }
 
   SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
   uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -57,10 +96,12 @@ class Device {
       VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties,
       VkBuffer &buffer,
-      VkDeviceMemory &bufferMemory);
-  VkCommandBuffer beginSingleTimeCommands();
-  void endSingleTimeCommands(VkCommandBuffer commandBuffer);
-  void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+      MemoryAllocator::Allocation &bufferMemory,
+      MemoryBudget::Category category = MemoryBudget::Category::Other);
+  // Blocking one-off transfers, each waits for its own submission only. Record many copies into
+  // a TransferBatch instead to submit them together and wait later, if at all.
+  void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+  void uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size);
   void copyBufferToImage(
       VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
@@ -68,9 +109,12 @@ class Device {
       const VkImageCreateInfo &imageInfo,
       VkMemoryPropertyFlags properties,
       VkImage &image,
-      VkDeviceMemory &imageMemory);
+      MemoryAllocator::Allocation &imageMemory,
+      MemoryBudget::Category category = MemoryBudget::Category::Other);
 
   VkPhysicalDeviceProperties properties;
+  // Limits of update after bind descriptors, zero unless hasDescriptorIndexing().
+  VkPhysicalDeviceDescriptorIndexingProperties descriptorIndexingProperties{};
 
  private:
   void createInstance();
@@ -88,6 +132,7 @@ class Device {
   void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
   void hasGflwRequiredInstanceExtensions();
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+  bool hasDeviceExtension(VkPhysicalDevice device, const char *extension);
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
   VkInstance instance;
@@ -95,11 +140,37 @@ class Device {
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
   Window &window;
   VkCommandPool commandPool;
+  VkCommandPool computeCommandPool;
 
   VkDevice device_;
   VkSurfaceKHR surface_;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
+  VkQueue transferQueue_;
+  VkQueue computeQueue_;
+  bool memoryBudget_ = false;
+  bool descriptorIndexing_ = false;
+
+  // Sub-allocates the memory of every buffer and image, see MemoryAllocator.
+  std::unique_ptr<MemoryAllocator> memoryAllocator_;
+  // Shared descriptor set layouts and sets, see DescriptorLayoutCache and DescriptorSetCache.
+  std::unique_ptr<DescriptorLayoutCache> descriptorLayouts_;
+  std::unique_ptr<DescriptorSetCache> descriptorSets_;
+  // Shared by every Pipeline and persisted across runs, see PipelineCache.
+  std::unique_ptr<PipelineCache> pipelineCache_;
+  // Shared shader modules and pipeline variants, see ShaderModuleCache and PipelineRegistry.
+  std::unique_ptr<ShaderModuleCache> shaderModules_;
+  std::unique_ptr<PipelineRegistry> pipelines_;
+  // Compiles pipelines of the registry in the background, see PipelineCompiler.
+  std::unique_ptr<PipelineCompiler> pipelineCompiler_;
+  // Every sampled image and storage buffer at a stable index, see BindlessTable.
+  std::unique_ptr<BindlessTable> bindless_;
+  // Staging memory of every upload, see StagingRing.
+  std::unique_ptr<StagingRing> stagingRing_;
+  // Submits and tracks every TransferBatch.
+  std::unique_ptr<TransferQueue> transfers_;
+  // Shared vertex and index buffers of every Model, see GeometryArena.
+  std::unique_ptr<GeometryArena> geometryArena_;
 
   const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
   const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
@@ -0,0 +1,53 @@
+
+#include "FrameAllocator.h"
+#include "Device.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace rendering {
+
+    FrameAllocator::FrameAllocator(Device &_device, uint32_t frameCount, VkDeviceSize _frameSize) {
+        const VkPhysicalDeviceLimits &limits = _device.properties.limits;
+        alignment = std::max<VkDeviceSize>({limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment, 1});
+        frameSize = Buffer::getAlignment(_frameSize, alignment);
+        buffer = std::make_unique<Buffer>(
+                _device,
+                frameSize,
+                frameCount,
+                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                alignment,
+                MemoryBudget::Category::Uniform
+                );
+        buffer->map();
+    }
+
+/**
+ * Starts handing out the region of a frame slot again. Call once the GPU finished the frame that
+ * last used the slot, e.g. right after the renderer waited for its fence.
+ */
+    void FrameAllocator::beginFrame(uint32_t frameIndex) {
+        peak = std::max(peak, head - frameStart);
+        frameStart = frameIndex * frameSize;
+        head = frameStart;
+    }
+
+/**
+ * Takes `size` bytes from the current frame, rounded up to the offset alignment so the next
+ * allocation stays aligned. Valid until beginFrame() comes back to this frame slot.
+ *
+ * @return Mapped pointer and offset into getBuffer()
+ */
+    FrameAllocator::Allocation FrameAllocator::allocate(VkDeviceSize size) {
+        VkDeviceSize alignedSize = Buffer::getAlignment(size, alignment);
+        if (head + alignedSize > frameStart + frameSize) {
+            throw std::runtime_error("failed to allocate " + std::to_string(size) + " bytes of frame data, " +
+                                     std::to_string(head - frameStart) + " of " + std::to_string(frameSize) + " in use");
+        }
+        Allocation allocation{static_cast<char *>(buffer->getMappedMemory()) + head, static_cast<uint32_t>(head), size};
+        head += alignedSize;
+        return allocation;
+    }
+}
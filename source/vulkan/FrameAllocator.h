@@ -0,0 +1,65 @@
+#ifndef VULKANLEARN_FRAMEALLOCATOR_H
+#define VULKANLEARN_FRAMEALLOCATOR_H
+
+#include "VulkanCommon.h"
+#include "Buffer.h"
+
+#include <cstring>
+#include <memory>
+
+namespace rendering {
+    class Device;
+
+    // Bump allocator for data that lives for one frame, like uniforms and per-draw parameters. One
+    // persistently mapped, host coherent buffer is split into a region per frame in flight;
+    // allocations advance through the current frame's region and beginFrame() rewinds it once the
+    // frame that last used it has finished. Nothing is allocated or freed per allocation.
+    //
+    // Offsets are aligned for dynamic uniform and storage buffer descriptors: point a
+    // VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor at getBuffer() with offset 0 and bind it
+    // with the allocation's offset. Not thread safe, use it from the thread recording the frame.
+    class FrameAllocator {
+    public:
+        static constexpr VkDeviceSize FRAME_SIZE = 1ull << 20;
+
+        struct Allocation {
+            void* mapped = nullptr;
+            uint32_t offset = 0; // dynamic offset into getBuffer()
+            VkDeviceSize size = 0;
+        };
+
+        FrameAllocator(Device& _device, uint32_t frameCount, VkDeviceSize frameSize = FRAME_SIZE);
+
+        FrameAllocator(const FrameAllocator&) = delete;
+        FrameAllocator &operator = (const FrameAllocator&) = delete;
+
+        void beginFrame(uint32_t frameIndex);
+        Allocation allocate(VkDeviceSize size);
+
+        // Allocates room for `value` and copies it there.
+        template <typename T>
+        Allocation write(const T& value) {
+            Allocation allocation = allocate(sizeof(T));
+            memcpy(allocation.mapped, &value, sizeof(T));
+            return allocation;
+        }
+
+        [[nodiscard]] VkBuffer getBuffer() const { return buffer->getBuffer(); }
+        [[nodiscard]] VkDeviceSize getAlignment() const { return alignment; }
+        [[nodiscard]] VkDeviceSize getFrameSize() const { return frameSize; }
+        // Bytes handed out in the current frame, and the most any frame has used.
+        [[nodiscard]] VkDeviceSize getUsed() const { return head - frameStart; }
+        [[nodiscard]] VkDeviceSize getPeak() const { return peak; }
+
+    private:
+        VkDeviceSize alignment;
+        VkDeviceSize frameSize;
+        std::unique_ptr<Buffer> buffer;
+
+        VkDeviceSize frameStart = 0;
+        VkDeviceSize head = 0;
+        VkDeviceSize peak = 0;
+    };
+}
+
+#endif //VULKANLEARN_FRAMEALLOCATOR_H
@@ -4,6 +4,7 @@
 
 #include "VulkanCommon.h"
 #include "Camera.h"
+#include "FrameAllocator.h"
 #include "../engine/Object.h"
 
 namespace rendering {
@@ -13,7 +14,10 @@ namespace rendering {
         VkCommandBuffer commandBuffer;
         Camera &camera;
         VkDescriptorSet globalDescriptorSet;
+        uint32_t globalUboOffset; // dynamic offset of the frame's GlobalUbo in frameAllocator
+        FrameAllocator &frameAllocator;
         engine::Object::Map &objects;
+        VkExtent2D extent;
     };
 }
 class FrameInfo {
@@ -0,0 +1,93 @@
+
+#include "FreeListAllocator.h"
+
+#include <cassert>
+
+namespace rendering {
+
+    FreeListAllocator::FreeListAllocator(uint64_t _capacity) : capacity{_capacity} {
+        if (capacity > 0) {
+            insertFree(0, capacity);
+        }
+    }
+
+/**
+ * Takes the smallest free range that still fits the request after aligning its start. Padding in
+ * front of the aligned offset and the unused tail stay free.
+ *
+ * @param size Bytes to allocate, must not be 0
+ * @param alignment Offset multiple, any positive value
+ *
+ * @return Offset of the allocation or INVALID when no free range is large enough
+ */
+    uint64_t FreeListAllocator::allocate(uint64_t size, uint64_t alignment) {
+        assert(size > 0 && alignment > 0 && "Allocation size and alignment must be positive");
+
+        for (auto candidate = freeBySize.lower_bound(size); candidate != freeBySize.end(); ++candidate) {
+            uint64_t rangeOffset = candidate->second;
+            uint64_t rangeSize = candidate->first;
+            uint64_t offset = (rangeOffset + alignment - 1) / alignment * alignment;
+            if (offset + size > rangeOffset + rangeSize) {
+                continue;
+            }
+
+            eraseFree(freeByOffset.find(rangeOffset));
+            if (offset > rangeOffset) {
+                insertFree(rangeOffset, offset - rangeOffset);
+            }
+            if (offset + size < rangeOffset + rangeSize) {
+                insertFree(offset + size, rangeOffset + rangeSize - offset - size);
+            }
+
+            allocated.emplace(offset, size);
+            used += size;
+            return offset;
+        }
+        return INVALID;
+    }
+
+    // Returns an allocation and merges it with free neighbours on both sides.
+    void FreeListAllocator::free(uint64_t offset) {
+        auto allocation = allocated.find(offset);
+        assert(allocation != allocated.end() && "Freeing an offset that was not allocated");
+        uint64_t size = allocation->second;
+        allocated.erase(allocation);
+        used -= size;
+
+        auto next = freeByOffset.lower_bound(offset);
+        if (next != freeByOffset.end() && next->first == offset + size) {
+            size += next->second;
+            eraseFree(next);
+        }
+        auto previous = freeByOffset.lower_bound(offset);
+        if (previous != freeByOffset.begin()) {
+            --previous;
+            if (previous->first + previous->second == offset) {
+                offset = previous->first;
+                size += previous->second;
+                eraseFree(previous);
+            }
+        }
+        insertFree(offset, size);
+    }
+
+    uint64_t FreeListAllocator::getLargestFree() const {
+        return freeBySize.empty() ? 0 : freeBySize.rbegin()->first;
+    }
+
+    void FreeListAllocator::insertFree(uint64_t offset, uint64_t size) {
+        freeByOffset.emplace(offset, size);
+        freeBySize.emplace(size, offset);
+    }
+
+    void FreeListAllocator::eraseFree(std::map<uint64_t, uint64_t>::iterator range) {
+        auto sized = freeBySize.equal_range(range->second);
+        for (auto it = sized.first; it != sized.second; ++it) {
+            if (it->second == range->first) {
+                freeBySize.erase(it);
+                break;
+            }
+        }
+        freeByOffset.erase(range);
+    }
+}
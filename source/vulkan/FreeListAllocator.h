@@ -0,0 +1,39 @@
+#ifndef VULKANLEARN_FREELISTALLOCATOR_H
+#define VULKANLEARN_FREELISTALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+namespace rendering {
+    // Hands out ranges of a fixed size address space, best fit, with neighbouring free ranges merged
+    // on release. Only does the bookkeeping, the memory itself lives elsewhere (see GeometryArena).
+    // Alignments do not have to be powers of two, which lets vertex ranges align to their stride.
+    // Not thread safe.
+    class FreeListAllocator {
+    public:
+        static constexpr uint64_t INVALID = ~0ull;
+
+        explicit FreeListAllocator(uint64_t _capacity);
+
+        uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+        void free(uint64_t offset);
+
+        [[nodiscard]] uint64_t getCapacity() const { return capacity; }
+        [[nodiscard]] uint64_t getUsed() const { return used; }
+        [[nodiscard]] uint64_t getLargestFree() const;
+        [[nodiscard]] size_t getFreeRangeCount() const { return freeByOffset.size(); }
+
+    private:
+        void insertFree(uint64_t offset, uint64_t size);
+        void eraseFree(std::map<uint64_t, uint64_t>::iterator range);
+
+        uint64_t capacity;
+        uint64_t used = 0;
+        std::map<uint64_t, uint64_t> freeByOffset{};     // offset -> size
+        std::multimap<uint64_t, uint64_t> freeBySize{};  // size -> offset
+        std::map<uint64_t, uint64_t> allocated{};        // offset -> size
+    };
+}
+
+#endif //VULKANLEARN_FREELISTALLOCATOR_H
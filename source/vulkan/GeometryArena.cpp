@@ -0,0 +1,100 @@
+
+#include "GeometryArena.h"
+#include "Device.hpp"
+#include "SwapChain.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace rendering {
+
+    GeometryArena::GeometryArena(Device &_device, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity)
+            : vertexRanges{vertexCapacity}, indexRanges{indexCapacity} {
+        vertexBuffer = std::make_unique<Buffer>(
+                _device,
+                1,
+                static_cast<uint32_t>(vertexCapacity),
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                1,
+                MemoryBudget::Category::Geometry
+                );
+        indexBuffer = std::make_unique<Buffer>(
+                _device,
+                1,
+                static_cast<uint32_t>(indexCapacity),
+                VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                1,
+                MemoryBudget::Category::Geometry
+                );
+    }
+
+    GeometryArena::Range GeometryArena::allocateVertices(VkDeviceSize size, uint32_t vertexSize) {
+        return allocate(vertexRanges, size, vertexSize, "vertex");
+    }
+
+    GeometryArena::Range GeometryArena::allocateIndices(VkDeviceSize size, uint32_t indexSize) {
+        return allocate(indexRanges, size, indexSize, "index");
+    }
+
+    void GeometryArena::freeVertices(const Range &range) {
+        std::lock_guard<std::mutex> lock{mutex};
+        retired.push_back({&vertexRanges, range.offset, frame});
+    }
+
+    void GeometryArena::freeIndices(const Range &range) {
+        std::lock_guard<std::mutex> lock{mutex};
+        retired.push_back({&indexRanges, range.offset, frame});
+    }
+
+/**
+ * Advances the frame counter and reuses ranges freed at least MAX_FRAMES_IN_FLIGHT frames ago, by
+ * then no command buffer that could read them is still executing. Call once per frame after the
+ * renderer waited for the frame's fence.
+ */
+    void GeometryArena::nextFrame() {
+        std::lock_guard<std::mutex> lock{mutex};
+        frame++;
+        auto reusable = std::stable_partition(retired.begin(), retired.end(), [this](const Retired &range) {
+            return range.frame + SwapChain::MAX_FRAMES_IN_FLIGHT > frame;
+        });
+        for (auto it = reusable; it != retired.end(); ++it) {
+            it->allocator->free(it->offset);
+        }
+        retired.erase(reusable, retired.end());
+    }
+
+    void GeometryArena::bindVertexBuffer(VkCommandBuffer commandBuffer) const {
+        VkBuffer buffers[] = {vertexBuffer->getBuffer()};
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+    }
+
+    void GeometryArena::bindIndexBuffer(VkCommandBuffer commandBuffer, VkIndexType indexType) const {
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, indexType);
+    }
+
+    VkDeviceSize GeometryArena::getVertexBytesUsed() {
+        std::lock_guard<std::mutex> lock{mutex};
+        return vertexRanges.getUsed();
+    }
+
+    VkDeviceSize GeometryArena::getIndexBytesUsed() {
+        std::lock_guard<std::mutex> lock{mutex};
+        return indexRanges.getUsed();
+    }
+
+    GeometryArena::Range GeometryArena::allocate(FreeListAllocator &allocator, VkDeviceSize size, uint32_t alignment,
+                                                 const char *what) {
+        std::lock_guard<std::mutex> lock{mutex};
+        uint64_t offset = allocator.allocate(size, alignment);
+        if (offset == FreeListAllocator::INVALID) {
+            throw std::runtime_error("failed to allocate " + std::to_string(size) + " bytes of " + what +
+                                     " geometry, " + std::to_string(allocator.getUsed()) + " of " +
+                                     std::to_string(allocator.getCapacity()) + " in use");
+        }
+        return {offset, size};
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef VULKANLEARN_GEOMETRYARENA_H
+#define VULKANLEARN_GEOMETRYARENA_H
+
+#include "VulkanCommon.h"
+#include "Buffer.h"
+#include "FreeListAllocator.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rendering {
+    class Device;
+
+    // One device local vertex buffer and one index buffer shared by every Model. Models get ranges
+    // of them and draw with firstIndex/vertexOffset, so a frame binds geometry once instead of once
+    // per object. Vertex ranges are aligned to their vertex size and index ranges to their index
+    // size, which lets formats of different strides and index types share the buffers.
+    class GeometryArena {
+    public:
+        static constexpr VkDeviceSize VERTEX_CAPACITY = 128ull << 20;
+        static constexpr VkDeviceSize INDEX_CAPACITY = 32ull << 20;
+
+        struct Range {
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+        };
+
+        explicit GeometryArena(Device& _device, VkDeviceSize vertexCapacity = VERTEX_CAPACITY,
+                               VkDeviceSize indexCapacity = INDEX_CAPACITY);
+
+        GeometryArena(const GeometryArena&) = delete;
+        GeometryArena &operator = (const GeometryArena&) = delete;
+
+        Range allocateVertices(VkDeviceSize size, uint32_t vertexSize);
+        Range allocateIndices(VkDeviceSize size, uint32_t indexSize);
+        void freeVertices(const Range& range);
+        void freeIndices(const Range& range);
+        void nextFrame();
+
+        void bindVertexBuffer(VkCommandBuffer commandBuffer) const;
+        void bindIndexBuffer(VkCommandBuffer commandBuffer, VkIndexType indexType) const;
+
+        [[nodiscard]] VkBuffer getVertexBuffer() const { return vertexBuffer->getBuffer(); }
+        [[nodiscard]] VkBuffer getIndexBuffer() const { return indexBuffer->getBuffer(); }
+        [[nodiscard]] VkDeviceSize getVertexBytesUsed();
+        [[nodiscard]] VkDeviceSize getIndexBytesUsed();
+
+    private:
+        // Ranges freed while earlier frames may still read them.
+        struct Retired {
+            FreeListAllocator* allocator;
+            VkDeviceSize offset;
+            uint64_t frame;
+        };
+
+        Range allocate(FreeListAllocator& allocator, VkDeviceSize size, uint32_t alignment, const char* what);
+
+        std::unique_ptr<Buffer> vertexBuffer;
+        std::unique_ptr<Buffer> indexBuffer;
+
+        std::mutex mutex;
+        FreeListAllocator vertexRanges;
+        FreeListAllocator indexRanges;
+        std::vector<Retired> retired{};
+        uint64_t frame = 0;
+    };
+}
+
+#endif //VULKANLEARN_GEOMETRYARENA_H
@@ -0,0 +1,96 @@
+
+#include "GpuTimer.h"
+#include "Device.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace rendering {
+
+    GpuTimer::GpuTimer(Device &_device, uint32_t frameCount) : device(_device), slots(frameCount) {
+        // Guarantees timestamps on every graphics queue, which is where frames are recorded.
+        supported = device.properties.limits.timestampComputeAndGraphics == VK_TRUE;
+        periodMs = device.properties.limits.timestampPeriod * 1e-6;
+        if (!supported) {
+            return;
+        }
+
+        VkQueryPoolCreateInfo queryPoolCI{};
+        queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolCI.queryCount = 2 * frameCount;
+        if (vkCreateQueryPool(device.device(), &queryPoolCI, nullptr, &queryPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool\n");
+        }
+    }
+
+    GpuTimer::~GpuTimer() {
+        if (queryPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(device.device(), queryPool, nullptr);
+        }
+    }
+
+/**
+ * Collects the time the slot's previous frame took, then resets its queries and writes the first
+ * timestamp. Has to be recorded outside a render pass, since queries cannot be reset inside one.
+ *
+ * @param frameIndex Frame in flight, the slot's last frame must have finished
+ * @param tag What this frame's time is summed under
+ */
+    void GpuTimer::begin(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t tag) {
+        if (!supported) {
+            return;
+        }
+        collect(frameIndex);
+        vkCmdResetQueryPool(commandBuffer, queryPool, 2 * frameIndex, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 2 * frameIndex);
+        slots[frameIndex].tag = tag;
+    }
+
+    void GpuTimer::end(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+        if (!supported) {
+            return;
+        }
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2 * frameIndex + 1);
+        slots[frameIndex].written = true;
+    }
+
+/**
+ * Collects every slot still holding a frame. The frames must have finished, for example after
+ * vkDeviceWaitIdle, otherwise their results are not available and they are dropped.
+ */
+    void GpuTimer::collectAll() {
+        if (!supported) {
+            return;
+        }
+        for (uint32_t frameIndex = 0; frameIndex < slots.size(); frameIndex++) {
+            collect(frameIndex);
+        }
+    }
+
+    void GpuTimer::collect(uint32_t frameIndex) {
+        Slot &slot = slots[frameIndex];
+        if (!slot.written) {
+            return;
+        }
+        slot.written = false;
+
+        // No wait flag, a frame whose fence was signalled has its results available.
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(device.device(), queryPool, 2 * frameIndex, 2, sizeof(timestamps), timestamps,
+                                  sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            return;
+        }
+        // A counter that wrapped within the frame gives no time.
+        if (timestamps[1] < timestamps[0]) {
+            return;
+        }
+        double ms = static_cast<double>(timestamps[1] - timestamps[0]) * periodMs;
+
+        Timing &timing = timings[slot.tag];
+        timing.minMs = timing.frames == 0 ? ms : std::min(timing.minMs, ms);
+        timing.maxMs = std::max(timing.maxMs, ms);
+        timing.totalMs += ms;
+        timing.frames++;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef VULKANLEARN_GPUTIMER_H
+#define VULKANLEARN_GPUTIMER_H
+
+#include "VulkanCommon.h"
+
+#include <map>
+#include <vector>
+
+namespace rendering {
+    class Device;
+
+    // GPU time of a span of each frame, measured with a pair of timestamp queries per frame in
+    // flight. Every span carries a tag, for example a ShaderPermutation::key(), and times are
+    // summed per tag. A frame's queries are read when its slot is begun again, after beginFrame
+    // waited for the slot's fence, so reading never stalls. Not thread safe, use it from the thread
+    // recording the frame.
+    class GpuTimer {
+    public:
+        struct Timing {
+            uint32_t frames = 0;
+            double totalMs = 0.0;
+            double minMs = 0.0;
+            double maxMs = 0.0;
+        };
+
+        GpuTimer(Device& _device, uint32_t frameCount);
+        ~GpuTimer();
+
+        GpuTimer(const GpuTimer&) = delete;
+        GpuTimer &operator = (const GpuTimer&) = delete;
+
+        void begin(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t tag);
+        void end(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+        // The last frames of each slot are only read by collectAll(), call it once the device is idle.
+        void collectAll();
+
+        // Without timestamps on graphics queues begin() and end() record nothing.
+        [[nodiscard]] bool isSupported() const { return supported; }
+        [[nodiscard]] const std::map<uint32_t, Timing>& getTimings() const { return timings; }
+        void clear() { timings.clear(); }
+
+    private:
+        void collect(uint32_t frameIndex);
+
+        Device& device;
+        bool supported;
+        double periodMs;
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+
+        struct Slot {
+            bool written = false;
+            uint32_t tag = 0;
+        };
+        std::vector<Slot> slots;
+        std::map<uint32_t, Timing> timings{};
+    };
+}
+
+#endif //VULKANLEARN_GPUTIMER_H
@@ -0,0 +1,116 @@
+
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rendering {
+
+    MappedFile::MappedFile(const std::string &filepath) {
+        open(filepath);
+    }
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept
+            : mapped{std::exchange(other.mapped, nullptr)},
+              fileSize{std::exchange(other.fileSize, 0)},
+              opened{std::exchange(other.opened, false)} {}
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            close();
+            mapped = std::exchange(other.mapped, nullptr);
+            fileSize = std::exchange(other.fileSize, 0);
+            opened = std::exchange(other.opened, false);
+        }
+        return *this;
+    }
+
+/**
+ * Maps the whole file read-only. Empty files are valid and report a size of zero with a null data
+ * pointer, since neither platform can map a zero length view.
+ *
+ * @param filepath Path of the file to map
+ */
+    void MappedFile::open(const std::string &filepath) {
+        close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("failed to open file: " + filepath);
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            throw std::runtime_error("failed to query file size: " + filepath);
+        }
+        fileSize = static_cast<size_t>(size.QuadPart);
+
+        if (fileSize > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                mapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int file = ::open(filepath.c_str(), O_RDONLY);
+        if (file < 0) {
+            throw std::runtime_error("failed to open file: " + filepath);
+        }
+
+        struct stat info{};
+        if (fstat(file, &info) != 0) {
+            ::close(file);
+            throw std::runtime_error("failed to query file size: " + filepath);
+        }
+        fileSize = static_cast<size_t>(info.st_size);
+
+        if (fileSize > 0) {
+            void *view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, file, 0);
+            if (view != MAP_FAILED) {
+                madvise(view, fileSize, MADV_SEQUENTIAL);
+                mapped = view;
+            }
+        }
+        ::close(file);
+#endif
+
+        if (fileSize > 0 && mapped == nullptr) {
+            fileSize = 0;
+            throw std::runtime_error("failed to map file: " + filepath);
+        }
+        opened = true;
+    }
+
+    void MappedFile::close() {
+        if (mapped) {
+#ifdef _WIN32
+            UnmapViewOfFile(mapped);
+#else
+            munmap(const_cast<void *>(mapped), fileSize);
+#endif
+        }
+        mapped = nullptr;
+        fileSize = 0;
+        opened = false;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef VULKANLEARN_MAPPEDFILE_H
+#define VULKANLEARN_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+namespace rendering {
+    // Read-only view of a whole file mapped into the address space. The mapping is
+    // released when the object is destroyed, so pointers returned by data() must not
+    // outlive it.
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::string& filepath);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile &operator = (const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile &operator = (MappedFile&& other) noexcept;
+
+        void open(const std::string& filepath);
+        void close();
+
+        [[nodiscard]] const char* data() const { return static_cast<const char*>(mapped); }
+        [[nodiscard]] size_t size() const { return fileSize; }
+        [[nodiscard]] bool isOpen() const { return opened; }
+
+    private:
+        const void* mapped = nullptr;
+        size_t fileSize = 0;
+        bool opened = false;
+    };
+}
+
+#endif //VULKANLEARN_MAPPEDFILE_H
@@ -0,0 +1,326 @@
+
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace rendering {
+
+    MemoryAllocator::MemoryAllocator(VkDevice _device, VkPhysicalDevice physicalDevice, bool memoryBudget)
+            : device{_device}, budget{physicalDevice, memoryBudget} {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        bufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+        nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+    }
+
+    MemoryAllocator::~MemoryAllocator() {
+        uint32_t leaked = dedicatedAllocations;
+        for (auto &typeBlocks: blocks) {
+            for (auto &block: typeBlocks) {
+                leaked += block->ranges.getAllocationCount();
+                vkFreeMemory(device, block->memory, nullptr);
+            }
+        }
+        if (leaked > 0) {
+            std::cerr << "memory allocator destroyed with " << leaked << " live allocations\n";
+        }
+    }
+
+/**
+ * Finds memory for a buffer or image. Small resources share a block of their memory type, large
+ * ones get a dedicated VkDeviceMemory. Bind the resource at the returned memory and offset.
+ *
+ * @param requirements What vkGetBufferMemoryRequirements or vkGetImageMemoryRequirements reported
+ * @param properties Memory properties the resource needs
+ * @param kind Linear for buffers and linear images, Optimal for optimally tiled images
+ * @param category What the resource is used for, only for accounting
+ *
+ * @return The allocation, hand it back with free()
+ */
+    MemoryAllocator::Allocation MemoryAllocator::allocate(const VkMemoryRequirements &requirements,
+                                                          VkMemoryPropertyFlags properties, Kind kind,
+                                                          Category category) {
+        std::lock_guard<std::mutex> lock{mutex};
+        Allocation allocation{};
+        allocation.memoryType = selectMemoryType(requirements.memoryTypeBits, properties, requirements.size);
+        allocation.category = category;
+
+        // Non coherent ranges are flushed in whole atoms, which must not reach into a neighbour.
+        VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+        VkDeviceSize size = requirements.size;
+        if (isNonCoherent(allocation.memoryType)) {
+            alignment = std::max(alignment, nonCoherentAtomSize);
+            size = (size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+        }
+        allocation.size = size;
+
+        VkDeviceSize typeBlockSize = blockSize(allocation.memoryType);
+        if (size <= typeBlockSize / 2) {
+            auto &typeBlocks = blocks[allocation.memoryType];
+            for (size_t i = 0; i <= typeBlocks.size(); i++) {
+                if (i == typeBlocks.size()) {
+                    void *mapped = nullptr;
+                    VkDeviceMemory memory = allocateMemory(typeBlockSize, allocation.memoryType, &mapped);
+                    if (memory == VK_NULL_HANDLE) {
+                        break;
+                    }
+                    typeBlocks.push_back(std::make_unique<Block>(Block{memory, mapped, TlsfAllocator{typeBlockSize, bufferImageGranularity}}));
+                }
+                Block &block = *typeBlocks[i];
+                TlsfAllocator::Allocation range = block.ranges.allocate(size, alignment, kind);
+                if (range.offset == TlsfAllocator::INVALID) {
+                    continue;
+                }
+                allocation.memory = block.memory;
+                allocation.offset = range.offset;
+                allocation.mapped = block.mapped ? static_cast<char *>(block.mapped) + range.offset : nullptr;
+                allocation.block = &block;
+                allocation.handle = range.handle;
+                budget.resourceAllocated(allocation.memoryType, category, size);
+                return allocation;
+            }
+        }
+
+        // Too large to share a block, or no new block fit into the heap: try the exact size.
+        allocation.memory = allocateMemory(size, allocation.memoryType, &allocation.mapped);
+        if (allocation.memory == VK_NULL_HANDLE) {
+            throw std::runtime_error("failed to allocate " + std::to_string(size) + " bytes of device memory");
+        }
+        dedicatedAllocations++;
+        dedicatedBytes += size;
+        budget.resourceAllocated(allocation.memoryType, category, size);
+        return allocation;
+    }
+
+    // Returns the memory of an allocation and resets it. Blocks that become empty are released,
+    // except for one per memory type to absorb alloc/free churn.
+    void MemoryAllocator::free(Allocation &allocation) {
+        if (allocation.memory == VK_NULL_HANDLE) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock{mutex};
+        budget.resourceFreed(allocation.memoryType, allocation.category, allocation.size);
+        if (allocation.block == nullptr) {
+            forgetDirty(allocation.memory);
+            vkFreeMemory(device, allocation.memory, nullptr);
+            budget.memoryFreed(allocation.memoryType, allocation.size);
+            dedicatedAllocations--;
+            dedicatedBytes -= allocation.size;
+            allocation = {};
+            return;
+        }
+
+        Block *block = allocation.block;
+        block->ranges.free(allocation.handle);
+        if (block->ranges.empty()) {
+            auto &typeBlocks = blocks[allocation.memoryType];
+            auto emptyBlocks = std::count_if(typeBlocks.begin(), typeBlocks.end(), [](const std::unique_ptr<Block> &other) {
+                return other->ranges.empty();
+            });
+            if (emptyBlocks > 1) {
+                forgetDirty(block->memory);
+                vkFreeMemory(device, block->memory, nullptr);
+                budget.memoryFreed(allocation.memoryType, block->ranges.getCapacity());
+                typeBlocks.erase(std::find_if(typeBlocks.begin(), typeBlocks.end(), [block](const std::unique_ptr<Block> &other) {
+                    return other.get() == block;
+                }));
+            }
+        }
+        allocation = {};
+    }
+
+/**
+ * Translates a range of an allocation into a range of its VkDeviceMemory for
+ * vkFlushMappedMemoryRanges and vkInvalidateMappedMemoryRanges, widened to whole atoms for non
+ * coherent memory. Allocations of such memory start and end on atom boundaries, so the widened
+ * range never touches a neighbour.
+ *
+ * @param allocation Host visible allocation
+ * @param size Bytes, or VK_WHOLE_SIZE for everything from offset to the end of the allocation
+ * @param offset Byte offset from the start of the allocation
+ */
+    VkMappedMemoryRange MemoryAllocator::mappedRange(const Allocation &allocation, VkDeviceSize size,
+                                                     VkDeviceSize offset) const {
+        VkDeviceSize end = allocation.offset + allocation.size;
+        VkDeviceSize start = allocation.offset + offset;
+        if (size != VK_WHOLE_SIZE) {
+            end = std::min(end, start + size);
+        }
+        if (isNonCoherent(allocation.memoryType)) {
+            start = start / nonCoherentAtomSize * nonCoherentAtomSize;
+            end = std::min((end + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize,
+                           allocation.offset + allocation.size);
+        }
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = allocation.memory;
+        range.offset = start;
+        range.size = end - start;
+        return range;
+    }
+
+/**
+ * Records a host write to a mapped allocation, to be flushed by the next flushDirty(). Free for
+ * coherent memory, which needs no flush.
+ *
+ * @param size Bytes written, or VK_WHOLE_SIZE for everything from offset to the end
+ * @param offset Byte offset from the start of the allocation
+ */
+    void MemoryAllocator::markDirty(const Allocation &allocation, VkDeviceSize size, VkDeviceSize offset) {
+        if (!isNonCoherent(allocation.memoryType)) {
+            return;
+        }
+        VkMappedMemoryRange range = mappedRange(allocation, size, offset);
+        std::lock_guard<std::mutex> lock{mutex};
+        // Consecutive writes to one buffer are the common case, extend the last range right away.
+        if (!dirtyRanges.empty()) {
+            VkMappedMemoryRange &last = dirtyRanges.back();
+            if (last.memory == range.memory && range.offset <= last.offset + last.size && last.offset <= range.offset + range.size) {
+                VkDeviceSize end = std::max(last.offset + last.size, range.offset + range.size);
+                last.offset = std::min(last.offset, range.offset);
+                last.size = end - last.offset;
+                return;
+            }
+        }
+        dirtyRanges.push_back(range);
+    }
+
+/**
+ * Flushes every range marked dirty since the last call with a single vkFlushMappedMemoryRanges,
+ * after merging ranges that overlap or touch. Call before submitting work that reads them.
+ *
+ * @return Number of ranges flushed
+ */
+    uint32_t MemoryAllocator::flushDirty() {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (dirtyRanges.empty()) {
+            return 0;
+        }
+        std::sort(dirtyRanges.begin(), dirtyRanges.end(), [](const VkMappedMemoryRange &a, const VkMappedMemoryRange &b) {
+            return a.memory != b.memory ? a.memory < b.memory : a.offset < b.offset;
+        });
+        size_t merged = 0;
+        for (size_t i = 1; i < dirtyRanges.size(); i++) {
+            VkMappedMemoryRange &last = dirtyRanges[merged];
+            const VkMappedMemoryRange &range = dirtyRanges[i];
+            if (range.memory == last.memory && range.offset <= last.offset + last.size) {
+                last.size = std::max(last.offset + last.size, range.offset + range.size) - last.offset;
+            }
+            else {
+                dirtyRanges[++merged] = range;
+            }
+        }
+        dirtyRanges.resize(merged + 1);
+
+        if (vkFlushMappedMemoryRanges(device, static_cast<uint32_t>(dirtyRanges.size()), dirtyRanges.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to flush mapped memory ranges");
+        }
+        auto flushed = static_cast<uint32_t>(dirtyRanges.size());
+        dirtyRanges.clear();
+        return flushed;
+    }
+
+    MemoryAllocator::Stats MemoryAllocator::getStats() {
+        std::lock_guard<std::mutex> lock{mutex};
+        Stats stats{};
+        stats.dedicatedAllocations = dedicatedAllocations;
+        stats.dedicatedBytes = dedicatedBytes;
+        stats.allocations = dedicatedAllocations;
+        stats.usedBytes = dedicatedBytes;
+        for (const auto &typeBlocks: blocks) {
+            for (const auto &block: typeBlocks) {
+                stats.blocks++;
+                stats.blockBytes += block->ranges.getCapacity();
+                stats.allocations += block->ranges.getAllocationCount();
+                stats.usedBytes += block->ranges.getUsed();
+            }
+        }
+        return stats;
+    }
+
+/**
+ * Current usage and budget of every heap, refreshed from the driver, with what the allocator holds
+ * per heap, memory type and category.
+ */
+    MemoryBudget::Snapshot MemoryAllocator::getBudget() {
+        std::lock_guard<std::mutex> lock{mutex};
+        budget.update();
+        return budget.snapshot();
+    }
+
+/**
+ * Picks the memory type a resource of the given size would get.
+ *
+ * @param typeFilter Bit mask of acceptable memory types, from the memory requirements
+ * @param properties Memory properties the type must have
+ * @param size Bytes the resource needs, to prefer types whose heap has that much budget left
+ */
+    uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkDeviceSize size) {
+        std::lock_guard<std::mutex> lock{mutex};
+        return selectMemoryType(typeFilter, properties, size);
+    }
+
+    // The first matching type with budget left, or the first matching type when every heap is full.
+    uint32_t MemoryAllocator::selectMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkDeviceSize size) const {
+        uint32_t fallback = VK_MAX_MEMORY_TYPES;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                if (budget.fits(i, size)) {
+                    return i;
+                }
+                fallback = std::min(fallback, i);
+            }
+        }
+        if (fallback == VK_MAX_MEMORY_TYPES) {
+            throw std::runtime_error("failed to find suitable memory type!");
+        }
+        return fallback;
+    }
+
+    // Small heaps, like the 256 MiB device local and host visible one, get an eighth of their size.
+    VkDeviceSize MemoryAllocator::blockSize(uint32_t memoryType) const {
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+        return heapSize <= (1ull << 30) ? std::min(heapSize / 8, BLOCK_SIZE) : BLOCK_SIZE;
+    }
+
+    bool MemoryAllocator::isHostVisible(uint32_t memoryType) const {
+        return memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    }
+
+    bool MemoryAllocator::isNonCoherent(uint32_t memoryType) const {
+        VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[memoryType].propertyFlags;
+        return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+
+    // Drops pending flushes of memory about to be freed. Called with the mutex held.
+    void MemoryAllocator::forgetDirty(VkDeviceMemory memory) {
+        dirtyRanges.erase(std::remove_if(dirtyRanges.begin(), dirtyRanges.end(), [memory](const VkMappedMemoryRange &range) {
+            return range.memory == memory;
+        }), dirtyRanges.end());
+    }
+
+    // Null handle when the heap is exhausted. Host visible memory is mapped right away.
+    VkDeviceMemory MemoryAllocator::allocateMemory(VkDeviceSize size, uint32_t memoryType, void **mapped) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            return VK_NULL_HANDLE;
+        }
+        *mapped = nullptr;
+        if (isHostVisible(memoryType) && vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+            vkFreeMemory(device, memory, nullptr);
+            throw std::runtime_error("failed to map device memory");
+        }
+        budget.memoryAllocated(memoryType, size);
+        return memory;
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef VULKANLEARN_MEMORYALLOCATOR_H
+#define VULKANLEARN_MEMORYALLOCATOR_H
+
+#include "VulkanCommon.h"
+#include "MemoryBudget.h"
+#include "TlsfAllocator.h"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rendering {
+    // Sub-allocates buffers and images from a few large VkDeviceMemory blocks per memory type instead
+    // of one vkAllocateMemory each, which is slow and capped by maxMemoryAllocationCount (often 4096).
+    // Resources larger than half a block get memory of their own. Host visible blocks stay mapped
+    // for their whole lifetime, so any number of buffers in them can be "mapped" at once. Host writes
+    // to non coherent memory are recorded with markDirty() and flushed together by flushDirty().
+    // Every allocation is accounted for in a MemoryBudget, and memory types whose heap is out of
+    // budget are only picked when no other type fits. Thread safe.
+    class MemoryAllocator {
+    public:
+        using Kind = TlsfAllocator::Kind;
+        using Category = MemoryBudget::Category;
+
+        static constexpr VkDeviceSize BLOCK_SIZE = 64ull << 20;
+
+        // One VkDeviceMemory shared by many allocations, owned by the allocator.
+        struct Block {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            void* mapped = nullptr;
+            TlsfAllocator ranges;
+        };
+
+        struct Allocation {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            void* mapped = nullptr; // start of the allocation, null unless host visible
+            uint32_t memoryType = 0;
+            Block* block = nullptr; // null for dedicated allocations
+            uint32_t handle = 0;
+            Category category = Category::Other;
+        };
+
+        struct Stats {
+            uint32_t blocks = 0;
+            uint32_t dedicatedAllocations = 0;
+            uint32_t allocations = 0;
+            VkDeviceSize blockBytes = 0;
+            VkDeviceSize dedicatedBytes = 0;
+            VkDeviceSize usedBytes = 0;
+        };
+
+        MemoryAllocator(VkDevice _device, VkPhysicalDevice physicalDevice, bool memoryBudget);
+        ~MemoryAllocator();
+
+        MemoryAllocator(const MemoryAllocator&) = delete;
+        MemoryAllocator &operator = (const MemoryAllocator&) = delete;
+
+        Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, Kind kind,
+                            Category category = Category::Other);
+        void free(Allocation& allocation);
+        uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkDeviceSize size = 0);
+
+        [[nodiscard]] VkMappedMemoryRange mappedRange(const Allocation& allocation, VkDeviceSize size, VkDeviceSize offset) const;
+        [[nodiscard]] bool isCoherent(const Allocation& allocation) const { return !isNonCoherent(allocation.memoryType); }
+        void markDirty(const Allocation& allocation, VkDeviceSize size, VkDeviceSize offset);
+        uint32_t flushDirty();
+        [[nodiscard]] Stats getStats();
+        [[nodiscard]] MemoryBudget::Snapshot getBudget();
+
+    private:
+        uint32_t selectMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkDeviceSize size) const;
+        [[nodiscard]] VkDeviceSize blockSize(uint32_t memoryType) const;
+        [[nodiscard]] bool isHostVisible(uint32_t memoryType) const;
+        [[nodiscard]] bool isNonCoherent(uint32_t memoryType) const;
+        VkDeviceMemory allocateMemory(VkDeviceSize size, uint32_t memoryType, void** mapped);
+        void forgetDirty(VkDeviceMemory memory);
+
+        VkDevice device;
+        VkPhysicalDeviceMemoryProperties memoryProperties{};
+        VkDeviceSize bufferImageGranularity = 1;
+        VkDeviceSize nonCoherentAtomSize = 1;
+
+        std::mutex mutex;
+        MemoryBudget budget;
+        std::array<std::vector<std::unique_ptr<Block>>, VK_MAX_MEMORY_TYPES> blocks{};
+        std::vector<VkMappedMemoryRange> dirtyRanges{};
+        uint32_t dedicatedAllocations = 0;
+        VkDeviceSize dedicatedBytes = 0;
+    };
+}
+
+#endif //VULKANLEARN_MEMORYALLOCATOR_H
@@ -0,0 +1,180 @@
+
+#include "MemoryBudget.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+namespace rendering {
+
+    MemoryBudget::MemoryBudget(VkPhysicalDevice _physicalDevice, bool _budgetExtension)
+            : physicalDevice{_physicalDevice}, budgetExtension{_budgetExtension} {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            heaps[i].size = memoryProperties.memoryHeaps[i].size;
+            heaps[i].deviceLocal = memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        }
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            types[i].flags = memoryProperties.memoryTypes[i].propertyFlags;
+            types[i].heap = memoryProperties.memoryTypes[i].heapIndex;
+        }
+        update();
+    }
+
+    // A vkAllocateMemory, which is rare enough to ask the driver for its budget every time.
+    void MemoryBudget::memoryAllocated(uint32_t memoryType, VkDeviceSize size) {
+        Type &type = types[memoryType];
+        type.memory.bytes += size;
+        type.memory.count++;
+        heaps[type.heap].memory.bytes += size;
+        heaps[type.heap].memory.count++;
+        update();
+        checkPressure(type.heap);
+    }
+
+    void MemoryBudget::memoryFreed(uint32_t memoryType, VkDeviceSize size) {
+        Type &type = types[memoryType];
+        type.memory.bytes -= size;
+        type.memory.count--;
+        heaps[type.heap].memory.bytes -= size;
+        heaps[type.heap].memory.count--;
+        checkPressure(type.heap);
+    }
+
+    void MemoryBudget::resourceAllocated(uint32_t memoryType, Category category, VkDeviceSize size) {
+        Type &type = types[memoryType];
+        for (Usage *usage: {&type.resources, &heaps[type.heap].resources, &categories[static_cast<uint32_t>(category)]}) {
+            usage->bytes += size;
+            usage->count++;
+        }
+    }
+
+    void MemoryBudget::resourceFreed(uint32_t memoryType, Category category, VkDeviceSize size) {
+        Type &type = types[memoryType];
+        for (Usage *usage: {&type.resources, &heaps[type.heap].resources, &categories[static_cast<uint32_t>(category)]}) {
+            usage->bytes -= size;
+            usage->count--;
+        }
+    }
+
+/**
+ * Refreshes the heap budgets. With VK_EXT_memory_budget they and the usage of the whole process
+ * come from the driver, which accounts for other allocations and for what the OS lets us have.
+ */
+    void MemoryBudget::update() {
+        if (!budgetExtension) {
+            for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+                heaps[i].budget = static_cast<VkDeviceSize>(heaps[i].size * ESTIMATED_BUDGET);
+                heaps[i].usage = heaps[i].memory.bytes;
+            }
+            return;
+        }
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        VkPhysicalDeviceMemoryProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            // Some drivers report zero for heaps they do not track.
+            heaps[i].budget = budgetProperties.heapBudget[i] > 0 ? budgetProperties.heapBudget[i]
+                                                                 : static_cast<VkDeviceSize>(heaps[i].size * ESTIMATED_BUDGET);
+            heaps[i].usage = budgetProperties.heapUsage[i];
+            memoryAtUpdate[i] = heaps[i].memory.bytes;
+        }
+    }
+
+    // Whether allocating size more bytes of the memory type keeps its heap within budget.
+    bool MemoryBudget::fits(uint32_t memoryType, VkDeviceSize size) const {
+        uint32_t heap = types[memoryType].heap;
+        return usage(heap) + size <= heaps[heap].budget;
+    }
+
+    MemoryBudget::Snapshot MemoryBudget::snapshot() const {
+        Snapshot snapshot{};
+        snapshot.budgetExtension = budgetExtension;
+        snapshot.heaps.assign(heaps.begin(), heaps.begin() + memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            snapshot.heaps[i].usage = usage(i);
+        }
+        snapshot.types.assign(types.begin(), types.begin() + memoryProperties.memoryTypeCount);
+        snapshot.categories = categories;
+        return snapshot;
+    }
+
+    const char *MemoryBudget::name(Category category) {
+        switch (category) {
+            case Category::Geometry:
+                return "geometry";
+            case Category::Uniform:
+                return "uniform";
+            case Category::Depth:
+                return "depth";
+            case Category::Staging:
+                return "staging";
+            default:
+                return "other";
+        }
+    }
+
+    // Driver reported usage plus what the allocator did since, which the driver has not seen yet.
+    VkDeviceSize MemoryBudget::usage(uint32_t heap) const {
+        const Heap &info = heaps[heap];
+        if (!budgetExtension) {
+            return info.memory.bytes;
+        }
+        if (info.memory.bytes >= memoryAtUpdate[heap]) {
+            return info.usage + (info.memory.bytes - memoryAtUpdate[heap]);
+        }
+        return info.usage - std::min(info.usage, memoryAtUpdate[heap] - info.memory.bytes);
+    }
+
+    void MemoryBudget::checkPressure(uint32_t heap) {
+        VkDeviceSize used = usage(heap);
+        bool pressure = used > heaps[heap].budget * PRESSURE;
+        if (pressure && !underPressure[heap]) {
+            std::cerr << "memory heap " << heap << " is at " << used << " of its " << heaps[heap].budget
+                      << " byte budget\n" << snapshot().toJson() << '\n';
+        }
+        underPressure[heap] = pressure;
+    }
+
+    static void writeUsage(std::ostringstream &json, const char *name, const MemoryBudget::Usage &usage) {
+        json << '"' << name << "\": {\"bytes\": " << usage.bytes << ", \"count\": " << usage.count << '}';
+    }
+
+/**
+ * Formats the snapshot as JSON, for logs and for diffing between runs to find leaks.
+ */
+    std::string MemoryBudget::Snapshot::toJson() const {
+        std::ostringstream json;
+        json << "{\n  \"budgetExtension\": " << (budgetExtension ? "true" : "false") << ",\n  \"heaps\": [";
+        for (size_t i = 0; i < heaps.size(); i++) {
+            const Heap &heap = heaps[i];
+            json << (i > 0 ? ",\n" : "\n") << "    {\"index\": " << i << ", \"size\": " << heap.size
+                 << ", \"budget\": " << heap.budget << ", \"usage\": " << heap.usage
+                 << ", \"deviceLocal\": " << (heap.deviceLocal ? "true" : "false") << ", ";
+            writeUsage(json, "memory", heap.memory);
+            json << ", ";
+            writeUsage(json, "resources", heap.resources);
+            json << '}';
+        }
+        json << "\n  ],\n  \"types\": [";
+        for (size_t i = 0; i < types.size(); i++) {
+            const Type &type = types[i];
+            json << (i > 0 ? ",\n" : "\n") << "    {\"index\": " << i << ", \"heap\": " << type.heap
+                 << ", \"flags\": " << type.flags << ", ";
+            writeUsage(json, "memory", type.memory);
+            json << ", ";
+            writeUsage(json, "resources", type.resources);
+            json << '}';
+        }
+        json << "\n  ],\n  \"categories\": {";
+        for (uint32_t i = 0; i < CATEGORY_COUNT; i++) {
+            json << (i > 0 ? ",\n" : "\n") << "    ";
+            writeUsage(json, name(static_cast<Category>(i)), categories[i]);
+        }
+        json << "\n  }\n}";
+        return json.str();
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef VULKANLEARN_MEMORYBUDGET_H
+#define VULKANLEARN_MEMORYBUDGET_H
+
+#include "VulkanCommon.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace rendering {
+    // Accounts for the device memory the MemoryAllocator holds, per heap and memory type, and for the
+    // buffers and images placed in it, also per Category. Heap budgets come from VK_EXT_memory_budget
+    // when the device has it and are estimated as ESTIMATED_BUDGET of the heap size otherwise. Warns
+    // once each time a heap crosses PRESSURE of its budget. Not thread safe, the MemoryAllocator
+    // calls it under its lock.
+    class MemoryBudget {
+    public:
+        enum class Category : uint32_t {
+            Geometry,
+            Uniform,
+            Depth,
+            Staging,
+            Other
+        };
+        static constexpr uint32_t CATEGORY_COUNT = 5;
+        static constexpr double PRESSURE = 0.9;
+        static constexpr double ESTIMATED_BUDGET = 0.8;
+
+        struct Usage {
+            VkDeviceSize bytes = 0;
+            uint32_t count = 0;
+        };
+
+        struct Heap {
+            VkDeviceSize size = 0;
+            VkDeviceSize budget = 0;
+            VkDeviceSize usage = 0; // of the whole process with the extension, else memory.bytes
+            bool deviceLocal = false;
+            Usage memory{}; // VkDeviceMemory held by the allocator
+            Usage resources{}; // buffers and images bound to it
+        };
+
+        struct Type {
+            VkMemoryPropertyFlags flags = 0;
+            uint32_t heap = 0;
+            Usage memory{};
+            Usage resources{};
+        };
+
+        struct Snapshot {
+            bool budgetExtension = false;
+            std::vector<Heap> heaps{};
+            std::vector<Type> types{};
+            std::array<Usage, CATEGORY_COUNT> categories{};
+
+            [[nodiscard]] std::string toJson() const;
+        };
+
+        MemoryBudget(VkPhysicalDevice _physicalDevice, bool _budgetExtension);
+
+        MemoryBudget(const MemoryBudget&) = delete;
+        MemoryBudget &operator = (const MemoryBudget&) = delete;
+
+        void memoryAllocated(uint32_t memoryType, VkDeviceSize size);
+        void memoryFreed(uint32_t memoryType, VkDeviceSize size);
+        void resourceAllocated(uint32_t memoryType, Category category, VkDeviceSize size);
+        void resourceFreed(uint32_t memoryType, Category category, VkDeviceSize size);
+
+        void update();
+        [[nodiscard]] bool fits(uint32_t memoryType, VkDeviceSize size) const;
+        [[nodiscard]] Snapshot snapshot() const;
+
+        static const char* name(Category category);
+
+    private:
+        [[nodiscard]] VkDeviceSize usage(uint32_t heap) const;
+        void checkPressure(uint32_t heap);
+
+        VkPhysicalDevice physicalDevice;
+        bool budgetExtension;
+        VkPhysicalDeviceMemoryProperties memoryProperties{};
+
+        std::array<Heap, VK_MAX_MEMORY_HEAPS> heaps{};
+        std::array<Type, VK_MAX_MEMORY_TYPES> types{};
+        std::array<Usage, CATEGORY_COUNT> categories{};
+        // What the allocator held when the driver last reported usage, to account for changes since.
+        std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> memoryAtUpdate{};
+        std::array<bool, VK_MAX_MEMORY_HEAPS> underPressure{};
+    };
+}
+
+#endif //VULKANLEARN_MEMORYBUDGET_H
@@ -0,0 +1,262 @@
+
+#include "MeshCache.h"
+#include "renderingutility.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace rendering {
+
+    namespace {
+        constexpr char MAGIC[4] = {'V', 'L', 'M', 'C'};
+        constexpr uint64_t DATA_ALIGNMENT = 16;
+
+        struct CacheHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t vertexStride;
+            uint32_t vertexCount;
+            uint32_t indexCount;
+            uint32_t variant;
+            uint32_t lodCount;
+            uint32_t lodStride;
+            uint64_t vertexOffset;
+            uint64_t indexOffset;
+            uint64_t lodOffset;
+            uint64_t pathHash;
+            uint64_t sourceSize;
+            int64_t sourceModifiedTime;
+            uint64_t sourceHash;
+            float boundsMin[3];
+            float boundsMax[3];
+        };
+
+        uint64_t alignUp(uint64_t value, uint64_t alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+
+        std::string canonicalPath(const std::string &filepath) {
+            std::error_code error;
+            fs::path path = fs::weakly_canonical(filepath, error);
+            return error ? filepath : path.generic_string();
+        }
+
+        bool sourceStamp(const std::string &filepath, uint64_t &size, int64_t &modifiedTime) {
+            std::error_code error;
+            size = fs::file_size(filepath, error);
+            if (error) {
+                return false;
+            }
+            modifiedTime = static_cast<int64_t>(fs::last_write_time(filepath, error).time_since_epoch().count());
+            return !error;
+        }
+
+        uint64_t sourceContentHash(const std::string &filepath) {
+            MappedFile source{filepath};
+            return hashBytes(source.data(), source.size());
+        }
+
+        // What the header's offsets and sizes cannot show: every index names a vertex and every LOD
+        // lies within the indices. Geometry is indexed without checks once it is handed out.
+        bool validGeometry(const CacheHeader &header, const char *data) {
+            const auto *lods = reinterpret_cast<const Model::Lod *>(data + header.lodOffset);
+            for (uint32_t i = 0; i < header.lodCount; i++) {
+                if (uint64_t{lods[i].firstIndex} + lods[i].indexCount > header.indexCount) {
+                    return false;
+                }
+            }
+            const auto *indices = reinterpret_cast<const uint32_t *>(data + header.indexOffset);
+            uint32_t largest = 0;
+            for (uint32_t i = 0; i < header.indexCount; i++) {
+                largest = std::max(largest, indices[i]);
+            }
+            return header.indexCount == 0 || largest < header.vertexCount;
+        }
+
+        // Records the source's new mtime after its content hash matched, so the next load is a hit
+        // without hashing the source again. Not fatal, the entry stays valid either way.
+        void refreshModifiedTime(const std::string &path, int64_t modifiedTime) {
+            std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(offsetof(CacheHeader, sourceModifiedTime));
+            file.write(reinterpret_cast<const char *>(&modifiedTime), sizeof(modifiedTime));
+            if (!file) {
+                std::cerr << "mesh cache: could not update " << path << '\n';
+            }
+        }
+    }
+
+    void MeshCache::setDirectory(const std::string &_directory) {
+        directory = _directory;
+    }
+
+    std::string MeshCache::cachePath(const std::string &filepath, uint32_t variant) {
+        std::string key = canonicalPath(filepath);
+        std::ostringstream name;
+        name << fs::path(filepath).stem().string() << '-' << std::hex << hashBytes(key.data(), key.size(), variant) << ".mesh";
+        return (fs::path(directory) / name.str()).string();
+    }
+
+/**
+ * Looks up the cached geometry for a source file. The cache is only trusted when its version,
+ * vertex layout and source path match and its indices and LODs stay within its vertices and
+ * indices; an unchanged size and mtime is then accepted without reading the source at all, while a
+ * changed mtime falls back to comparing the content hash and, on a match, stores the new mtime.
+ *
+ * @param filepath Path of the source model
+ * @param variant Processing options the geometry was built with, see Model::LoadOptions::cacheVariant
+ * @param entry Receives the mapped cache file and a view of the geometry inside it
+ *
+ * @return true on a cache hit
+ */
+    bool MeshCache::load(const std::string &filepath, uint32_t variant, Entry &entry) {
+        uint64_t sourceSize;
+        int64_t sourceModifiedTime;
+        if (!sourceStamp(filepath, sourceSize, sourceModifiedTime)) {
+            return false;
+        }
+
+        std::string path = cachePath(filepath, variant);
+        std::error_code error;
+        if (!fs::exists(path, error)) {
+            return false;
+        }
+
+        try {
+            entry.file.open(path);
+        }
+        catch (const std::runtime_error &) {
+            return false;
+        }
+
+        if (entry.file.size() < sizeof(CacheHeader)) {
+            entry.file.close();
+            return false;
+        }
+
+        CacheHeader header{};
+        memcpy(&header, entry.file.data(), sizeof(header));
+        std::string key = canonicalPath(filepath);
+
+        bool valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                     header.version == VERSION &&
+                     header.vertexStride == sizeof(Model::Vertex) &&
+                     header.variant == variant &&
+                     header.pathHash == hashBytes(key.data(), key.size()) &&
+                     header.sourceSize == sourceSize &&
+                     header.vertexOffset >= sizeof(CacheHeader) &&
+                     header.vertexOffset % DATA_ALIGNMENT == 0 &&
+                     header.vertexOffset + uint64_t{header.vertexCount} * sizeof(Model::Vertex) <= header.indexOffset &&
+                     header.lodStride == sizeof(Model::Lod) &&
+                     header.indexOffset % alignof(uint32_t) == 0 &&
+                     header.indexOffset + uint64_t{header.indexCount} * sizeof(uint32_t) <= header.lodOffset &&
+                     header.lodOffset % DATA_ALIGNMENT == 0 &&
+                     header.lodOffset + uint64_t{header.lodCount} * sizeof(Model::Lod) <= entry.file.size() &&
+                     validGeometry(header, entry.file.data());
+
+        if (valid && header.sourceModifiedTime != sourceModifiedTime) {
+            valid = header.sourceHash == sourceContentHash(filepath);
+            if (valid) {
+                refreshModifiedTime(path, sourceModifiedTime);
+            }
+        }
+
+        if (!valid) {
+            entry.file.close();
+            return false;
+        }
+
+        entry.mesh.vertices = reinterpret_cast<const Model::Vertex *>(entry.file.data() + header.vertexOffset);
+        entry.mesh.vertexCount = header.vertexCount;
+        entry.mesh.indices = reinterpret_cast<const uint32_t *>(entry.file.data() + header.indexOffset);
+        entry.mesh.indexCount = header.indexCount;
+        entry.mesh.lods = reinterpret_cast<const Model::Lod *>(entry.file.data() + header.lodOffset);
+        entry.mesh.lodCount = header.lodCount;
+        entry.mesh.boundsMin = {header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]};
+        entry.mesh.boundsMax = {header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]};
+        return true;
+    }
+
+/**
+ * Writes the geometry for a source file to the cache. The file is written under a temporary name
+ * and renamed into place, so concurrent loaders never observe a partially written entry. Failures
+ * are reported but not fatal, the model is still usable without a cache.
+ *
+ * @param filepath Path of the source model
+ * @param variant Processing options the geometry was built with
+ * @param mesh Welded geometry to store
+ */
+    void MeshCache::store(const std::string &filepath, uint32_t variant, const Model::MeshData &mesh) {
+        std::string temporary{};
+        try {
+            CacheHeader header{};
+            memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.vertexStride = sizeof(Model::Vertex);
+            header.variant = variant;
+            header.vertexCount = mesh.vertexCount;
+            header.indexCount = mesh.indexCount;
+            header.vertexOffset = alignUp(sizeof(CacheHeader), DATA_ALIGNMENT);
+            header.indexOffset = alignUp(header.vertexOffset + uint64_t{mesh.vertexCount} * sizeof(Model::Vertex),
+                                         DATA_ALIGNMENT);
+            header.lodCount = mesh.lodCount;
+            header.lodStride = sizeof(Model::Lod);
+            header.lodOffset = alignUp(header.indexOffset + uint64_t{mesh.indexCount} * sizeof(uint32_t), DATA_ALIGNMENT);
+
+            std::string key = canonicalPath(filepath);
+            header.pathHash = hashBytes(key.data(), key.size());
+            if (!sourceStamp(filepath, header.sourceSize, header.sourceModifiedTime)) {
+                return;
+            }
+            header.sourceHash = sourceContentHash(filepath);
+            for (int i = 0; i < 3; i++) {
+                header.boundsMin[i] = mesh.boundsMin[i];
+                header.boundsMax[i] = mesh.boundsMax[i];
+            }
+
+            fs::create_directories(directory);
+            std::string path = cachePath(filepath, variant);
+            temporary = path + ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+            {
+                std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+                if (!file.is_open()) {
+                    throw std::runtime_error("failed to open " + temporary);
+                }
+
+                const char padding[DATA_ALIGNMENT] = {};
+                file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                file.write(padding, static_cast<std::streamsize>(header.vertexOffset - sizeof(header)));
+                file.write(reinterpret_cast<const char *>(mesh.vertices),
+                           static_cast<std::streamsize>(mesh.vertexCount * sizeof(Model::Vertex)));
+                uint64_t written = header.vertexOffset + uint64_t{mesh.vertexCount} * sizeof(Model::Vertex);
+                file.write(padding, static_cast<std::streamsize>(header.indexOffset - written));
+                file.write(reinterpret_cast<const char *>(mesh.indices),
+                           static_cast<std::streamsize>(mesh.indexCount * sizeof(uint32_t)));
+                written = header.indexOffset + uint64_t{mesh.indexCount} * sizeof(uint32_t);
+                file.write(padding, static_cast<std::streamsize>(header.lodOffset - written));
+                file.write(reinterpret_cast<const char *>(mesh.lods),
+                           static_cast<std::streamsize>(mesh.lodCount * sizeof(Model::Lod)));
+                if (!file) {
+                    throw std::runtime_error("failed to write " + temporary);
+                }
+            }
+
+            fs::rename(temporary, path);
+        }
+        catch (const std::exception &e) {
+            std::cerr << "mesh cache: could not store " << filepath << ": " << e.what() << '\n';
+            std::error_code error;
+            if (!temporary.empty()) {
+                fs::remove(temporary, error);
+            }
+        }
+    }
+}
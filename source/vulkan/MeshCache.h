@@ -0,0 +1,35 @@
+#ifndef VULKANLEARN_MESHCACHE_H
+#define VULKANLEARN_MESHCACHE_H
+
+#include "Model.h"
+#include "MappedFile.h"
+
+#include <string>
+
+namespace rendering {
+    // On-disk cache of welded geometry keyed by the source path, its size/mtime and a content hash.
+    // A hit maps the cache file and hands out pointers straight into it, so the vertex and index
+    // data is copied exactly once, into the staging buffer.
+    class MeshCache {
+    public:
+        static constexpr uint32_t VERSION = 4;
+
+        struct Entry {
+            MappedFile file{};
+            Model::MeshData mesh{};
+        };
+
+        static void setDirectory(const std::string& directory);
+        static const std::string& getDirectory() { return directory; }
+
+        static bool load(const std::string& filepath, uint32_t variant, Entry& entry);
+        static void store(const std::string& filepath, uint32_t variant, const Model::MeshData& mesh);
+
+    private:
+        static std::string cachePath(const std::string& filepath, uint32_t variant);
+
+        static inline std::string directory = "../cache";
+    };
+}
+
+#endif //VULKANLEARN_MESHCACHE_H
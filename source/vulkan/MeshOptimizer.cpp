@@ -0,0 +1,321 @@
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace rendering {
+
+    namespace {
+        // FIFO post-transform cache simulated with insertion timestamps: a vertex is resident while
+        // fewer than cacheSize other vertices were inserted after it. Hits do not refresh it.
+        class CacheSimulator {
+        public:
+            CacheSimulator(size_t vertexCount, uint32_t _cacheSize)
+                    : insertedAt(vertexCount, 0), cacheSize{_cacheSize}, time{_cacheSize + 1} {}
+
+            bool access(uint32_t vertex) {
+                if (time - insertedAt[vertex] > cacheSize) {
+                    insertedAt[vertex] = time++;
+                    return false;
+                }
+                return true;
+            }
+
+            void flush() {
+                time += cacheSize + 1;
+            }
+
+        private:
+            std::vector<uint32_t> insertedAt;
+            uint32_t cacheSize;
+            uint32_t time;
+        };
+
+        uint32_t triangleMisses(CacheSimulator &cache, const uint32_t *triangle) {
+            return !cache.access(triangle[0]) + !cache.access(triangle[1]) + !cache.access(triangle[2]);
+        }
+    }
+
+/**
+ * Runs all passes on the builder and recomputes its bounds, since the fetch pass drops vertices that
+ * no triangle references. Must run before MeshSimplifier::generateLods, the passes treat the whole
+ * index buffer as one mesh.
+ *
+ * @return ACMR and ATVR of the index buffer before and after
+ */
+    MeshOptimizer::Report MeshOptimizer::optimize(Model::Builder &builder) {
+        assert(builder.lods.size() <= 1 && "Optimize the mesh before generating LODs");
+
+        Report report{};
+        report.before = analyzeVertexCache(builder.indices, builder.vertices.size());
+
+        optimizeVertexCache(builder.indices, builder.vertices.size());
+        optimizeOverdraw(builder.indices, builder.vertices);
+        optimizeVertexFetch(builder.vertices, builder.indices);
+        builder.computeBounds();
+
+        report.after = analyzeVertexCache(builder.indices, builder.vertices.size());
+        return report;
+    }
+
+/**
+ * Reorders triangles for post-transform cache reuse with Tipsify (Sander, Nehab and Barczak 2007).
+ * Triangles are emitted as fans around a current vertex; the next fan vertex is the emitted vertex
+ * that will still be in the cache after its remaining triangles are drawn, and dead ends fall back
+ * to recently used vertices and finally to the next vertex in input order.
+ *
+ * @param indices Triangle list, reordered in place
+ * @param vertexCount Number of vertices the indices refer to
+ * @param cacheSize Size of the simulated cache
+ */
+    void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2) {
+            return;
+        }
+
+        // Vertex to triangle adjacency in compressed rows.
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            offsets[indices[i] + 1]++;
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        std::vector<uint32_t> live(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++) {
+            live[v] = offsets[v + 1] - offsets[v];
+        }
+
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        std::vector<uint8_t> emitted(triangleCount, 0);
+        std::vector<uint32_t> deadEnd{};
+        deadEnd.reserve(triangleCount * 3);
+        std::vector<uint32_t> candidates{};
+        std::vector<uint32_t> result{};
+        result.reserve(triangleCount * 3);
+
+        uint32_t time = cacheSize + 1;
+        size_t cursor = 0;
+
+        auto skipDeadEnd = [&]() -> int64_t {
+            while (!deadEnd.empty()) {
+                uint32_t vertex = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[vertex] > 0) {
+                    return vertex;
+                }
+            }
+            for (; cursor < vertexCount; cursor++) {
+                if (live[cursor] > 0) {
+                    return static_cast<int64_t>(cursor);
+                }
+            }
+            return -1;
+        };
+
+        int64_t fan = skipDeadEnd();
+        while (fan >= 0) {
+            candidates.clear();
+            for (uint32_t i = offsets[fan]; i < offsets[fan + 1]; i++) {
+                uint32_t triangle = adjacency[i];
+                if (emitted[triangle]) {
+                    continue;
+                }
+                emitted[triangle] = 1;
+                for (uint32_t k = 0; k < 3; k++) {
+                    uint32_t vertex = indices[triangle * 3 + k];
+                    result.push_back(vertex);
+                    deadEnd.push_back(vertex);
+                    candidates.push_back(vertex);
+                    live[vertex]--;
+                    if (time - cacheTime[vertex] > cacheSize) {
+                        cacheTime[vertex] = time++;
+                    }
+                }
+            }
+
+            int64_t best = -1;
+            int64_t bestPriority = -1;
+            for (uint32_t vertex: candidates) {
+                if (live[vertex] == 0) {
+                    continue;
+                }
+                int64_t priority = 0;
+                if (time - cacheTime[vertex] + 2 * live[vertex] <= cacheSize) {
+                    priority = time - cacheTime[vertex];
+                }
+                if (priority > bestPriority) {
+                    best = vertex;
+                    bestPriority = priority;
+                }
+            }
+            fan = best >= 0 ? best : skipDeadEnd();
+        }
+
+        indices.swap(result);
+    }
+
+/**
+ * Reorders clusters of the cache optimized triangle list so outward facing surfaces come first,
+ * which lets early depth testing reject more of what is drawn later (the sort from the Tipsify
+ * paper, without a GPU overdraw measurement). Clusters start wherever the cache was effectively
+ * flushed and are split further while that keeps the cluster's ACMR within `threshold` of its
+ * unsplit value, so the reordering costs little vertex reuse.
+ *
+ * @param indices Triangle list in vertex cache optimized order, reordered in place
+ * @param vertices Vertex positions used for the cluster centroids and normals
+ * @param threshold Allowed ACMR degradation from splitting clusters
+ * @param cacheSize Size of the simulated cache
+ */
+    void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Model::Vertex> &vertices,
+                                         float threshold, uint32_t cacheSize) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2) {
+            return;
+        }
+
+        // Hard boundaries: triangles that miss on all three vertices start a new cluster.
+        std::vector<uint32_t> hardStarts{};
+        {
+            CacheSimulator cache{vertices.size(), cacheSize};
+            for (size_t t = 0; t < triangleCount; t++) {
+                if (triangleMisses(cache, &indices[t * 3]) == 3) {
+                    hardStarts.push_back(static_cast<uint32_t>(t));
+                }
+            }
+        }
+        hardStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+        // Soft boundaries: split a hard cluster once the running ACMR gets within the threshold.
+        std::vector<uint32_t> clusterStarts{};
+        CacheSimulator cache{vertices.size(), cacheSize};
+        for (size_t c = 0; c + 1 < hardStarts.size(); c++) {
+            uint32_t begin = hardStarts[c];
+            uint32_t end = hardStarts[c + 1];
+
+            cache.flush();
+            uint32_t clusterMisses = 0;
+            for (uint32_t t = begin; t < end; t++) {
+                clusterMisses += triangleMisses(cache, &indices[t * 3]);
+            }
+            float target = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - begin);
+
+            cache.flush();
+            clusterStarts.push_back(begin);
+            uint32_t start = begin;
+            uint32_t misses = 0;
+            for (uint32_t t = begin; t < end; t++) {
+                misses += triangleMisses(cache, &indices[t * 3]);
+                if (t + 1 < end && static_cast<float>(misses) <= target * static_cast<float>(t + 1 - start)) {
+                    clusterStarts.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    cache.flush();
+                }
+            }
+        }
+        clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+        // Area weighted centroid of the whole mesh and, per cluster, centroid and summed normal.
+        size_t clusterCount = clusterStarts.size() - 1;
+        std::vector<glm::vec3> clusterCentroids(clusterCount);
+        std::vector<glm::vec3> clusterNormals(clusterCount);
+        glm::vec3 meshCentroid{0.0f};
+        float meshArea = 0.0f;
+        for (size_t c = 0; c < clusterCount; c++) {
+            glm::vec3 centroid{0.0f};
+            glm::vec3 normal{0.0f};
+            float area = 0.0f;
+            for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+                const glm::vec3 &p0 = vertices[indices[t * 3 + 0]].position;
+                const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].position;
+                const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].position;
+                glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+                float triangleArea = glm::length(cross);
+                centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                normal += cross;
+                area += triangleArea;
+            }
+            meshCentroid += centroid;
+            meshArea += area;
+            clusterCentroids[c] = area > 0.0f ? centroid / area : vertices[indices[clusterStarts[c] * 3]].position;
+            clusterNormals[c] = normal;
+        }
+        if (meshArea > 0.0f) {
+            meshCentroid /= meshArea;
+        }
+
+        std::vector<float> sortKeys(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            float length = glm::length(clusterNormals[c]);
+            sortKeys[c] = length > 0.0f ? glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c] / length) : 0.0f;
+        }
+
+        std::vector<uint32_t> order(clusterCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+        std::vector<uint32_t> result{};
+        result.reserve(indices.size());
+        for (uint32_t c: order) {
+            result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+        }
+        indices.swap(result);
+    }
+
+/**
+ * Renumbers vertices in the order the index buffer first references them, so vertex fetches walk
+ * memory mostly forward. Vertices no triangle references are dropped.
+ *
+ * @param vertices Vertex array, reordered in place
+ * @param indices Index buffer, rewritten to the new numbering
+ */
+    void MeshOptimizer::optimizeVertexFetch(std::vector<Model::Vertex> &vertices, std::vector<uint32_t> &indices) {
+        std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+        std::vector<Model::Vertex> result{};
+        result.reserve(vertices.size());
+
+        for (auto &index: indices) {
+            if (remap[index] == UINT32_MAX) {
+                remap[index] = static_cast<uint32_t>(result.size());
+                result.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(result);
+    }
+
+/**
+ * Simulates the FIFO post-transform cache over an index buffer.
+ *
+ * @return ACMR (misses per triangle) and ATVR (misses per referenced vertex)
+ */
+    MeshOptimizer::VertexCacheStats MeshOptimizer::analyzeVertexCache(const std::vector<uint32_t> &indices,
+                                                                      size_t vertexCount, uint32_t cacheSize) {
+        VertexCacheStats stats{};
+        if (indices.size() < 3) {
+            return stats;
+        }
+
+        CacheSimulator cache{vertexCount, cacheSize};
+        std::vector<uint8_t> referenced(vertexCount, 0);
+        size_t misses = 0;
+        size_t unique = 0;
+        for (uint32_t index: indices) {
+            misses += !cache.access(index);
+            unique += !referenced[index];
+            referenced[index] = 1;
+        }
+
+        stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+        stats.atvr = static_cast<float>(misses) / static_cast<float>(unique);
+        return stats;
+    }
+}
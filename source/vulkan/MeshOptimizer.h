@@ -0,0 +1,41 @@
+#ifndef VULKANLEARN_MESHOPTIMIZER_H
+#define VULKANLEARN_MESHOPTIMIZER_H
+
+#include "Model.h"
+
+#include <vector>
+
+namespace rendering {
+    // Triangle and vertex reordering run on a Builder before upload. The order of the passes matters:
+    // vertex cache first, then overdraw (which only moves whole clusters of the cache optimized order)
+    // and finally vertex fetch, which renumbers vertices by first use in the final index order.
+    class MeshOptimizer {
+    public:
+        // Post-transform cache modelled as a FIFO, 16 entries is a conservative fit for current GPUs.
+        static constexpr uint32_t CACHE_SIZE = 16;
+        // How much the overdraw pass may degrade ACMR (1.05 = 5%) in exchange for better ordering.
+        static constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+        struct VertexCacheStats {
+            float acmr = 0.0f; // transformed vertices per triangle, 0.5 is ideal for a regular grid
+            float atvr = 0.0f; // transformed vertices per referenced vertex, 1.0 is ideal
+        };
+
+        struct Report {
+            VertexCacheStats before{};
+            VertexCacheStats after{};
+        };
+
+        static Report optimize(Model::Builder& builder);
+
+        static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+        static void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Model::Vertex>& vertices,
+                                     float threshold = OVERDRAW_THRESHOLD, uint32_t cacheSize = CACHE_SIZE);
+        static void optimizeVertexFetch(std::vector<Model::Vertex>& vertices, std::vector<uint32_t>& indices);
+
+        static VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+                                                   uint32_t cacheSize = CACHE_SIZE);
+    };
+}
+
+#endif //VULKANLEARN_MESHOPTIMIZER_H
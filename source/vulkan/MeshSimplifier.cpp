@@ -0,0 +1,365 @@
+
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "VertexTable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace rendering {
+
+    namespace {
+        // Open boundaries get a plane perpendicular to the surface through the edge, weighted well
+        // above the surface planes so silhouettes of open meshes (the vase rim, the quad) hold.
+        constexpr double BORDER_WEIGHT = 10.0;
+        // A collapse may not turn any remaining triangle by more than ~75 degrees.
+        constexpr float MIN_NORMAL_COSINE = 0.25f;
+
+        // Symmetric 4x4 error quadric of the planes around a vertex, weighted by triangle area.
+        struct Quadric {
+            double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+            double b2 = 0.0, bc = 0.0, bd = 0.0;
+            double c2 = 0.0, cd = 0.0;
+            double d2 = 0.0;
+            double weight = 0.0;
+
+            static Quadric plane(const glm::vec3 &normal, const glm::vec3 &point, double weight) {
+                double a = normal.x, b = normal.y, c = normal.z;
+                double d = -(a * point.x + b * point.y + c * point.z);
+                Quadric q{};
+                q.a2 = a * a * weight, q.ab = a * b * weight, q.ac = a * c * weight, q.ad = a * d * weight;
+                q.b2 = b * b * weight, q.bc = b * c * weight, q.bd = b * d * weight;
+                q.c2 = c * c * weight, q.cd = c * d * weight;
+                q.d2 = d * d * weight;
+                q.weight = weight;
+                return q;
+            }
+
+            void add(const Quadric &o) {
+                a2 += o.a2, ab += o.ab, ac += o.ac, ad += o.ad;
+                b2 += o.b2, bc += o.bc, bd += o.bd;
+                c2 += o.c2, cd += o.cd;
+                d2 += o.d2;
+                weight += o.weight;
+            }
+
+            // Weighted mean squared distance of `p` to the accumulated planes.
+            [[nodiscard]] double error(const glm::vec3 &p) const {
+                double x = p.x, y = p.y, z = p.z;
+                double sum = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x +
+                             b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y +
+                             c2 * z * z + 2.0 * cd * z + d2;
+                return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+            }
+        };
+
+        struct Collapse {
+            uint32_t from;
+            uint32_t to;
+            float error; // root of the quadric error, orders the collapses
+        };
+
+        void removeDegenerate(std::vector<uint32_t> &triangles, std::vector<uint32_t> &corners) {
+            size_t kept = 0;
+            for (size_t i = 0; i < triangles.size(); i += 3) {
+                uint32_t a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+                if (a == b || b == c || c == a) {
+                    continue;
+                }
+                for (size_t k = 0; k < 3; k++) {
+                    triangles[kept + k] = triangles[i + k];
+                    corners[kept + k] = corners[i + k];
+                }
+                kept += 3;
+            }
+            triangles.resize(kept);
+            corners.resize(kept);
+        }
+
+        glm::vec3 triangleNormal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+            return glm::cross(b - a, c - a);
+        }
+    }
+
+/**
+ * Simplifies a triangle list by collapsing edges in order of quadric error until the target is
+ * reached, skipping collapses that would move the surface further than maxError. Collapses work on
+ * positions, so vertices that only differ in normal or uv (seams, flat shading) move together; each
+ * corner is then re-pointed to the vertex at its new position whose attributes match best.
+ *
+ * The quadric error is a weighted mean and bounds nothing, so the distance is tracked separately:
+ * every input position is represented by the position it was collapsed into, and each position
+ * keeps the largest distance to any input position it represents. Every point of an input triangle
+ * lies at most that far from the matching point of its collapsed triangle and the other way round,
+ * so the largest of these distances bounds the distance between the two surfaces.
+ *
+ * @param vertices Vertex array the indices refer to, not modified
+ * @param indices Triangle list to simplify
+ * @param targetTriangleCount Stop once at most this many triangles remain
+ * @param maxError Largest distance between the input and the simplified surface, in model space units
+ * @param resultError Receives the bound on that distance for the result
+ *
+ * @return The simplified triangle list, referring to the same vertices
+ */
+    std::vector<uint32_t> MeshSimplifier::simplify(const std::vector<Model::Vertex> &vertices,
+                                                   const std::vector<uint32_t> &indices,
+                                                   size_t targetTriangleCount, float maxError, float &resultError) {
+        resultError = 0.0f;
+        if (indices.size() / 3 <= targetTriangleCount) {
+            return indices;
+        }
+
+        // Weld by position only.
+        std::vector<uint32_t> positionOf(vertices.size());
+        std::vector<glm::vec3> positions{};
+        {
+            VertexTable table{};
+            table.reserve(vertices.size());
+            for (size_t v = 0; v < vertices.size(); v++) {
+                const glm::vec3 &position = vertices[v].position;
+                auto [id, inserted] = table.findOrInsert(
+                        hashBytes(&position, sizeof(position)), static_cast<uint32_t>(positions.size()),
+                        [&](uint32_t existing) { return memcmp(&positions[existing], &position, sizeof(position)) == 0; });
+                if (inserted) {
+                    positions.push_back(position);
+                }
+                positionOf[v] = id;
+            }
+        }
+        const size_t positionCount = positions.size();
+
+        std::vector<uint32_t> triangles(indices.size());
+        std::vector<uint32_t> corners(indices);
+        for (size_t i = 0; i < indices.size(); i++) {
+            triangles[i] = positionOf[indices[i]];
+        }
+        removeDegenerate(triangles, corners);
+
+        // Surface quadrics, then border quadrics for edges used by a single triangle.
+        std::vector<Quadric> quadrics(positionCount);
+        std::vector<uint64_t> edges{};
+        edges.reserve(triangles.size());
+        for (size_t t = 0; t < triangles.size() / 3; t++) {
+            const uint32_t *triangle = &triangles[t * 3];
+            glm::vec3 normal = triangleNormal(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]]);
+            float length = glm::length(normal);
+            if (length == 0.0f) {
+                continue;
+            }
+            Quadric q = Quadric::plane(normal / length, positions[triangle[0]], 0.5 * length);
+            for (size_t k = 0; k < 3; k++) {
+                quadrics[triangle[k]].add(q);
+                uint32_t a = triangle[k], b = triangle[(k + 1) % 3];
+                edges.push_back((uint64_t{std::min(a, b)} << 32) | std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t t = 0; t < triangles.size() / 3; t++) {
+            const uint32_t *triangle = &triangles[t * 3];
+            glm::vec3 normal = triangleNormal(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]]);
+            if (glm::length(normal) == 0.0f) {
+                continue;
+            }
+            for (size_t k = 0; k < 3; k++) {
+                uint32_t a = triangle[k], b = triangle[(k + 1) % 3];
+                uint64_t key = (uint64_t{std::min(a, b)} << 32) | std::max(a, b);
+                auto range = std::equal_range(edges.begin(), edges.end(), key);
+                if (range.second - range.first != 1) {
+                    continue;
+                }
+                glm::vec3 edge = positions[b] - positions[a];
+                glm::vec3 borderNormal = glm::cross(edge, normal);
+                float length = glm::length(borderNormal);
+                if (length == 0.0f) {
+                    continue;
+                }
+                Quadric q = Quadric::plane(borderNormal / length, positions[a], glm::dot(edge, edge) * BORDER_WEIGHT);
+                quadrics[a].add(q);
+                quadrics[b].add(q);
+            }
+        }
+
+        std::vector<uint32_t> collapsedInto(positionCount);
+        std::iota(collapsedInto.begin(), collapsedInto.end(), 0);
+        std::vector<uint32_t> offsets(positionCount + 1);
+        std::vector<uint32_t> adjacency{};
+        std::vector<Collapse> collapses{};
+        std::vector<uint8_t> touched(positionCount);
+        // Largest distance of each position to the input positions collapsed into it.
+        std::vector<float> displacement(positionCount, 0.0f);
+
+        // Each pass collapses an independent set of cheap edges, then rebuilds the triangle list.
+        while (triangles.size() / 3 > targetTriangleCount) {
+            size_t triangleCount = triangles.size() / 3;
+
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (uint32_t position: triangles) {
+                offsets[position + 1]++;
+            }
+            std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+            adjacency.resize(triangles.size());
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < triangles.size(); i++) {
+                adjacency[fill[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+
+            edges.clear();
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (size_t k = 0; k < 3; k++) {
+                    uint32_t a = triangles[t * 3 + k], b = triangles[t * 3 + (k + 1) % 3];
+                    edges.push_back((uint64_t{std::min(a, b)} << 32) | std::max(a, b));
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+            edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+            collapses.clear();
+            for (uint64_t edge: edges) {
+                auto a = static_cast<uint32_t>(edge >> 32);
+                auto b = static_cast<uint32_t>(edge);
+                Quadric q = quadrics[a];
+                q.add(quadrics[b]);
+                double intoB = q.error(positions[b]);
+                double intoA = q.error(positions[a]);
+                if (intoB <= intoA) {
+                    collapses.push_back({a, b, static_cast<float>(std::sqrt(intoB))});
+                } else {
+                    collapses.push_back({b, a, static_cast<float>(std::sqrt(intoA))});
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(),
+                      [](const Collapse &x, const Collapse &y) { return x.error < y.error; });
+
+            std::fill(touched.begin(), touched.end(), 0);
+            size_t removed = 0;
+            bool collapsed = false;
+            for (const auto &collapse: collapses) {
+                if (triangleCount - removed <= targetTriangleCount) {
+                    break;
+                }
+                if (touched[collapse.from] || touched[collapse.to]) {
+                    continue;
+                }
+                float moved = displacement[collapse.from] + glm::distance(positions[collapse.from], positions[collapse.to]);
+                if (moved > maxError) {
+                    continue;
+                }
+
+                // Reject collapses that flip or badly rotate a remaining triangle.
+                bool keepsOrientation = true;
+                for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1] && keepsOrientation; i++) {
+                    const uint32_t *triangle = &triangles[adjacency[i] * 3];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                        continue;
+                    }
+                    glm::vec3 corner[3];
+                    for (size_t k = 0; k < 3; k++) {
+                        corner[k] = positions[triangle[k] == collapse.from ? collapse.to : triangle[k]];
+                    }
+                    glm::vec3 before = triangleNormal(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]]);
+                    glm::vec3 after = triangleNormal(corner[0], corner[1], corner[2]);
+                    keepsOrientation = glm::dot(before, after) > MIN_NORMAL_COSINE * glm::length(before) * glm::length(after);
+                }
+                if (!keepsOrientation) {
+                    continue;
+                }
+
+                // Triangles around `from` must not change again in this pass, so lock their vertices.
+                for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++) {
+                    const uint32_t *triangle = &triangles[adjacency[i] * 3];
+                    touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                        removed++;
+                    }
+                }
+                collapsedInto[collapse.from] = collapse.to;
+                quadrics[collapse.to].add(quadrics[collapse.from]);
+                displacement[collapse.to] = std::max(displacement[collapse.to], moved);
+                resultError = std::max(resultError, displacement[collapse.to]);
+                collapsed = true;
+            }
+
+            if (!collapsed) {
+                break;
+            }
+            for (auto &position: triangles) {
+                position = collapsedInto[position];
+            }
+            removeDegenerate(triangles, corners);
+        }
+
+        // Re-point each corner to the vertex at its final position that best matches its attributes.
+        std::vector<uint32_t> vertexOffsets(positionCount + 1, 0);
+        for (uint32_t position: positionOf) {
+            vertexOffsets[position + 1]++;
+        }
+        std::partial_sum(vertexOffsets.begin(), vertexOffsets.end(), vertexOffsets.begin());
+        std::vector<uint32_t> verticesAt(vertices.size());
+        std::vector<uint32_t> fill(vertexOffsets.begin(), vertexOffsets.end() - 1);
+        for (size_t v = 0; v < vertices.size(); v++) {
+            verticesAt[fill[positionOf[v]]++] = static_cast<uint32_t>(v);
+        }
+
+        std::vector<uint32_t> result(triangles.size());
+        for (size_t i = 0; i < triangles.size(); i++) {
+            uint32_t vertex = corners[i];
+            uint32_t position = triangles[i];
+            if (positionOf[vertex] == position) {
+                result[i] = vertex;
+                continue;
+            }
+            const Model::Vertex &original = vertices[vertex];
+            float bestScore = -1e30f;
+            for (uint32_t j = vertexOffsets[position]; j < vertexOffsets[position + 1]; j++) {
+                const Model::Vertex &candidate = vertices[verticesAt[j]];
+                float score = glm::dot(original.normal, candidate.normal) - glm::length(original.uv - candidate.uv) -
+                              glm::length(original.color - candidate.color);
+                if (score > bestScore) {
+                    bestScore = score;
+                    result[i] = verticesAt[j];
+                }
+            }
+        }
+        return result;
+    }
+
+/**
+ * Appends a chain of LODs to the builder's index buffer. Each LOD halves the triangle count of the
+ * previous one and is stored as a sub-range of `indices` over the shared vertices; the chain stops
+ * at MAX_LODS, below MIN_LOD_TRIANGLES, or when simplification stalls. Each LOD is simplified from
+ * the previous one and the distance bounds of the steps add up, so Lod::error is an upper bound on
+ * the distance to the full resolution surface.
+ *
+ * Run this after MeshOptimizer::optimize, which renumbers vertices; each LOD gets its own vertex
+ * cache pass here.
+ */
+    void MeshSimplifier::generateLods(Model::Builder &builder) {
+        builder.lods.clear();
+        builder.lods.push_back({0, static_cast<uint32_t>(builder.indices.size()), 0.0f});
+
+        float maxError = MAX_RELATIVE_ERROR * glm::length(builder.boundsMax - builder.boundsMin);
+        std::vector<uint32_t> previous = builder.indices;
+        float error = 0.0f;
+
+        while (builder.lods.size() < MAX_LODS) {
+            auto target = static_cast<size_t>(static_cast<float>(previous.size() / 3) * LOD_REDUCTION);
+            if (target < MIN_LOD_TRIANGLES) {
+                break;
+            }
+
+            float lodError = 0.0f;
+            std::vector<uint32_t> simplified = simplify(builder.vertices, previous, target, maxError - error, lodError);
+            if (simplified.empty() || simplified.size() * 10 > previous.size() * 9) {
+                break;
+            }
+            MeshOptimizer::optimizeVertexCache(simplified, builder.vertices.size());
+
+            error += lodError;
+            builder.lods.push_back({static_cast<uint32_t>(builder.indices.size()),
+                                    static_cast<uint32_t>(simplified.size()), error});
+            builder.indices.insert(builder.indices.end(), simplified.begin(), simplified.end());
+            previous.swap(simplified);
+        }
+    }
+}
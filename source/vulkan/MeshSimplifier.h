@@ -0,0 +1,26 @@
+#ifndef VULKANLEARN_MESHSIMPLIFIER_H
+#define VULKANLEARN_MESHSIMPLIFIER_H
+
+#include "Model.h"
+
+#include <vector>
+
+namespace rendering {
+    // Quadric error edge collapse (Garland and Heckbert 1997) restricted to half-edge collapses, so
+    // every simplified index list still refers to the original vertex array and all LODs of a model
+    // can share one vertex buffer.
+    class MeshSimplifier {
+    public:
+        static constexpr uint32_t MAX_LODS = 6;
+        static constexpr float LOD_REDUCTION = 0.5f;      // triangle count of each LOD relative to the previous
+        static constexpr size_t MIN_LOD_TRIANGLES = 64;   // coarser LODs stop paying for themselves
+        static constexpr float MAX_RELATIVE_ERROR = 0.1f; // largest error allowed, relative to the bounds diagonal
+
+        static std::vector<uint32_t> simplify(const std::vector<Model::Vertex>& vertices, const std::vector<uint32_t>& indices,
+                                              size_t targetTriangleCount, float maxError, float& resultError);
+
+        static void generateLods(Model::Builder& builder);
+    };
+}
+
+#endif //VULKANLEARN_MESHSIMPLIFIER_H
@@ -0,0 +1,173 @@
+
+#include "MeshletBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace rendering {
+
+    namespace {
+        void addMeshlet(Model::Meshlets &meshlets, const Model::MeshData &mesh, uint32_t firstIndex, uint32_t indexCount) {
+            meshlets.firstIndex.push_back(firstIndex);
+            meshlets.indexCount.push_back(indexCount);
+            meshlets.bounds.push_back(MeshletBuilder::boundingSphere(mesh.vertices, mesh.indices + firstIndex, indexCount));
+            meshlets.cones.push_back(MeshletBuilder::normalCone(mesh.vertices, mesh.indices + firstIndex, indexCount));
+        }
+    }
+
+/**
+ * Builds the meshlets of every LOD. A meshlet is closed as soon as the next triangle would take it
+ * past MAX_VERTICES unique vertices or MAX_TRIANGLES triangles, so the meshlets of one LOD exactly
+ * tile its index range.
+ *
+ * @param mesh Indexed geometry, a mesh without LODs is treated as a single LOD
+ *
+ * @return Meshlets of all LODs, the ones of LOD i are [lodOffsets[i], lodOffsets[i + 1])
+ */
+    Model::Meshlets MeshletBuilder::build(const Model::MeshData &mesh) {
+        Model::Meshlets meshlets{};
+        if (mesh.indexCount == 0) {
+            return meshlets;
+        }
+
+        const Model::Lod whole{0, mesh.indexCount, 0.0f};
+        const Model::Lod *lods = mesh.lodCount ? mesh.lods : &whole;
+        uint32_t lodCount = mesh.lodCount ? mesh.lodCount : 1;
+
+        // Id of the meshlet that last referenced each vertex, saves a per meshlet set.
+        constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> usedBy(mesh.vertexCount, NONE);
+
+        for (uint32_t lod = 0; lod < lodCount; lod++) {
+            meshlets.lodOffsets.push_back(static_cast<uint32_t>(meshlets.size()));
+
+            uint32_t begin = lods[lod].firstIndex;
+            uint32_t end = begin + lods[lod].indexCount;
+            uint32_t first = begin;
+            uint32_t vertexCount = 0;
+            auto id = static_cast<uint32_t>(meshlets.size());
+
+            for (uint32_t i = begin; i + 2 < end; i += 3) {
+                const uint32_t *triangle = mesh.indices + i;
+                auto newVertices = [&]() {
+                    return static_cast<uint32_t>(usedBy[triangle[0]] != id) +
+                           static_cast<uint32_t>(usedBy[triangle[1]] != id && triangle[1] != triangle[0]) +
+                           static_cast<uint32_t>(usedBy[triangle[2]] != id && triangle[2] != triangle[0] && triangle[2] != triangle[1]);
+                };
+
+                uint32_t added = newVertices();
+                if (vertexCount + added > MAX_VERTICES || (i - first) / 3 == MAX_TRIANGLES) {
+                    addMeshlet(meshlets, mesh, first, i - first);
+                    first = i;
+                    vertexCount = 0;
+                    id = static_cast<uint32_t>(meshlets.size());
+                    added = newVertices();
+                }
+
+                usedBy[triangle[0]] = usedBy[triangle[1]] = usedBy[triangle[2]] = id;
+                vertexCount += added;
+            }
+
+            if (end > first) {
+                addMeshlet(meshlets, mesh, first, end - first);
+            }
+        }
+        meshlets.lodOffsets.push_back(static_cast<uint32_t>(meshlets.size()));
+
+        return meshlets;
+    }
+
+/**
+ * Ritter's bounding sphere: start from the most distant pair of axis extremes, then grow the sphere
+ * just enough to take in every vertex outside of it. Within a few percent of the minimal sphere.
+ *
+ * @return Center in xyz, radius in w
+ */
+    glm::vec4 MeshletBuilder::boundingSphere(const Model::Vertex *vertices, const uint32_t *indices, uint32_t indexCount) {
+        if (indexCount == 0) {
+            return glm::vec4{0.0f};
+        }
+
+        uint32_t minimum[3] = {indices[0], indices[0], indices[0]};
+        uint32_t maximum[3] = {indices[0], indices[0], indices[0]};
+        for (uint32_t i = 1; i < indexCount; i++) {
+            const glm::vec3 &position = vertices[indices[i]].position;
+            for (int axis = 0; axis < 3; axis++) {
+                if (position[axis] < vertices[minimum[axis]].position[axis]) {
+                    minimum[axis] = indices[i];
+                }
+                if (position[axis] > vertices[maximum[axis]].position[axis]) {
+                    maximum[axis] = indices[i];
+                }
+            }
+        }
+
+        int widest = 0;
+        float widestDistance = -1.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            float distance = glm::distance(vertices[minimum[axis]].position, vertices[maximum[axis]].position);
+            if (distance > widestDistance) {
+                widestDistance = distance;
+                widest = axis;
+            }
+        }
+
+        glm::vec3 center = (vertices[minimum[widest]].position + vertices[maximum[widest]].position) * 0.5f;
+        float radius = widestDistance * 0.5f;
+        for (uint32_t i = 0; i < indexCount; i++) {
+            const glm::vec3 &position = vertices[indices[i]].position;
+            float distance = glm::distance(position, center);
+            if (distance > radius) {
+                float grown = (radius + distance) * 0.5f;
+                center += (position - center) * ((grown - radius) / distance);
+                radius = grown;
+            }
+        }
+
+        // Rounding in the updates above can leave a vertex a few ulps outside.
+        return {center, radius * (1.0f + 1e-5f)};
+    }
+
+/**
+ * Cone around the mean of the triangle normals that contains all of them. Normals follow the
+ * counter-clockwise winding of the index buffer, degenerate triangles are ignored.
+ *
+ * @return Axis in xyz and the sine of the cone's half angle in w. A w of 1 or more means the normals
+ * spread over a hemisphere or more and the meshlet can face the camera from any position.
+ */
+    glm::vec4 MeshletBuilder::normalCone(const Model::Vertex *vertices, const uint32_t *indices, uint32_t indexCount) {
+        glm::vec3 sum{0.0f};
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+            const glm::vec3 &a = vertices[indices[i]].position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].position - a, vertices[indices[i + 2]].position - a);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                sum += normal / length;
+            }
+        }
+
+        float sumLength = glm::length(sum);
+        if (sumLength < 1e-6f) {
+            return {0.0f, 0.0f, 1.0f, 1.0f};
+        }
+        glm::vec3 axis = sum / sumLength;
+
+        float minimumCosine = 1.0f;
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+            const glm::vec3 &a = vertices[indices[i]].position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].position - a, vertices[indices[i + 2]].position - a);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                minimumCosine = std::min(minimumCosine, glm::dot(normal / length, axis));
+            }
+        }
+
+        if (minimumCosine <= 0.0f) {
+            return {axis, 1.0f};
+        }
+        // Widened slightly, a triangle right on the cone's edge must not be culled by rounding.
+        float sine = std::sqrt(std::max(1.0f - minimumCosine * minimumCosine, 0.0f));
+        return {axis, std::min(sine + 1e-4f, 1.0f)};
+    }
+}
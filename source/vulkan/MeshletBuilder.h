@@ -0,0 +1,25 @@
+#ifndef VULKANLEARN_MESHLETBUILDER_H
+#define VULKANLEARN_MESHLETBUILDER_H
+
+#include "Model.h"
+
+#include <vector>
+
+namespace rendering {
+    // Splits every LOD of a mesh into meshlets, runs of consecutive triangles in the existing index
+    // order. Scanning keeps the vertex cache and overdraw order MeshOptimizer produced and lets a
+    // meshlet be drawn as a plain index range; the cache optimized order is local enough to give
+    // compact clusters.
+    class MeshletBuilder {
+    public:
+        static constexpr uint32_t MAX_VERTICES = 64;
+        static constexpr uint32_t MAX_TRIANGLES = 124;
+
+        static Model::Meshlets build(const Model::MeshData& mesh);
+
+        static glm::vec4 boundingSphere(const Model::Vertex* vertices, const uint32_t* indices, uint32_t indexCount);
+        static glm::vec4 normalCone(const Model::Vertex* vertices, const uint32_t* indices, uint32_t indexCount);
+    };
+}
+
+#endif //VULKANLEARN_MESHLETBUILDER_H
@@ -1,5 +1,8 @@
 #include "Model.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <unordered_map>
 #include <iostream>
 
@@ -8,6 +11,106 @@
 #include <glm/gtx/hash.hpp>
 
 #include "renderingutility.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "VertexTable.h"
+
+namespace {
+    constexpr float SNORM16_MAX = 32767.0f;
+
+    int16_t toSnorm16(float value) {
+        return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * SNORM16_MAX));
+    }
+
+    float fromSnorm16(int16_t value) {
+        return std::max(static_cast<float>(value) / SNORM16_MAX, -1.0f);
+    }
+
+    uint8_t toUnorm8(float value) {
+        return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+    }
+
+    // IEEE half with round to nearest even, including subnormals, infinity and NaN.
+    uint16_t toHalf(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        uint32_t exponent = (bits >> 23) & 0xffu;
+        uint32_t mantissa = bits & 0x7fffffu;
+
+        if (exponent == 0xffu) {
+            return static_cast<uint16_t>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+        }
+        int halfExponent = static_cast<int>(exponent) - 127 + 15;
+        if (halfExponent >= 31) {
+            return static_cast<uint16_t>(sign | 0x7c00u);
+        }
+        if (halfExponent <= 0) {
+            if (halfExponent < -10) {
+                return static_cast<uint16_t>(sign);
+            }
+            mantissa |= 0x800000u;
+            uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+            uint32_t half = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1u);
+            uint32_t halfway = 1u << (shift - 1u);
+            if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+                half++;
+            }
+            return static_cast<uint16_t>(sign | half);
+        }
+
+        uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+        uint32_t remainder = mantissa & 0x1fffu;
+        if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+            half++;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    float fromHalf(uint16_t half) {
+        uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+        uint32_t exponent = (half >> 10) & 0x1fu;
+        uint32_t mantissa = half & 0x3ffu;
+
+        if (exponent == 0) {
+            float value = std::ldexp(static_cast<float>(mantissa), -24);
+            return sign ? -value : value;
+        }
+        uint32_t bits = exponent == 31 ? sign | 0x7f800000u | (mantissa << 13)
+                                       : sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Octahedral normal encoding (Cigolle et al. 2014): project onto the octahedron, fold the lower
+    // half over the diagonals. A zero normal encodes as +z.
+    glm::vec2 encodeOctahedral(glm::vec3 normal) {
+        float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (sum == 0.0f) {
+            return glm::vec2{0.0f};
+        }
+        normal /= sum;
+        glm::vec2 encoded{normal.x, normal.y};
+        if (normal.z < 0.0f) {
+            encoded = {(1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+                       (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f)};
+        }
+        return encoded;
+    }
+
+    // Same decode as shader.vert.
+    glm::vec3 decodeOctahedral(glm::vec2 encoded) {
+        glm::vec3 normal{encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y)};
+        float fold = std::max(-normal.z, 0.0f);
+        normal.x += normal.x >= 0.0f ? -fold : fold;
+        normal.y += normal.y >= 0.0f ? -fold : fold;
+        return glm::normalize(normal);
+    }
+}
 
 namespace std {
     template <>
@@ -20,95 +123,195 @@ namespace std {
     };
 }
 
-rendering::Model::Model(rendering::Device &_device, const Model::Builder& builder) : device(_device){
-    createVertexBuffers(builder.vertices);
-    createIndexBuffers(builder.indices);
-}
+rendering::Model::Model(rendering::Device &_device, const Model::Builder& builder) : Model(_device, builder.data()) {}
+
+rendering::Model::Model(rendering::Device &_device, const MeshData& mesh, VertexFormat format, PendingUpload* upload)
+        : Model(_device, mesh, format, nullptr, upload) {}
+
+rendering::Model::Model(rendering::Device &_device, const MeshData& mesh, VertexFormat format, TransferBatch& batch)
+        : Model(_device, mesh, format, &batch, nullptr) {}
 
-rendering::Model::~Model() { }
+rendering::Model::Model(rendering::Device &_device, const MeshData& mesh, VertexFormat format, TransferBatch* batch,
+                        PendingUpload* upload)
+        : device(_device), boundsMin(mesh.boundsMin), boundsMax(mesh.boundsMax), vertexFormat(format) {
+    if (vertexFormat == VertexFormat::Packed) {
+        glm::vec3 offset = (boundsMin + boundsMax) * 0.5f;
+        glm::vec3 scale = (boundsMax - boundsMin) * 0.5f;
+        for (int i = 0; i < 3; i++) {
+            scale[i] = scale[i] > 0.0f ? scale[i] : 1.0f;
+        }
+        vertexTransform[0][0] = scale.x;
+        vertexTransform[1][1] = scale.y;
+        vertexTransform[2][2] = scale.z;
+        vertexTransform[3] = glm::vec4(offset, 1.0f);
+
+        std::vector<PackedVertex> packed(mesh.vertexCount);
+        for (uint32_t i = 0; i < mesh.vertexCount; i++) {
+            packed[i] = PackedVertex::pack(mesh.vertices[i], offset, scale);
+        }
+        createVertexBuffers(packed.data(), sizeof(PackedVertex), mesh.vertexCount, batch, upload);
+    }
+    else {
+        createVertexBuffers(mesh.vertices, sizeof(Vertex), mesh.vertexCount, batch, upload);
+    }
+    createIndexBuffers(mesh.indices, mesh.indexCount, batch, upload);
 
-void rendering::Model::bind(VkCommandBuffer commandBuffer) {
-    VkBuffer buffers[] = {vertexBuffer->getBuffer()};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+    lods.assign(mesh.lods, mesh.lods + mesh.lodCount);
+    if (lods.empty()) {
+        lods.push_back({0, indexCount, 0.0f});
+    }
+    meshlets = MeshletBuilder::build(mesh);
+}
 
+// Ranges go back to the arena once the frames that may still draw them have finished.
+rendering::Model::~Model() {
+    GeometryArena &arena = device.geometryArena();
+    arena.freeVertices(vertexRange);
     if (hasIndexBuffer) {
-        vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+        arena.freeIndices(indexRange);
     }
 }
 
-void rendering::Model::draw(VkCommandBuffer commandBuffer) {
+void rendering::Model::draw(VkCommandBuffer commandBuffer, uint32_t lod) {
     if (hasIndexBuffer) {
-        vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+        const Lod &range = lods[std::min(lod, static_cast<uint32_t>(lods.size() - 1))];
+        vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, firstIndex + range.firstIndex, vertexOffset, 0);
     }
     else {
-        vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+        vkCmdDraw(commandBuffer, vertexCount, 1, static_cast<uint32_t>(vertexOffset), 0);
     }
 }
 
-void rendering::Model::createVertexBuffers(const std::vector<Vertex> &vertices) {
-    vertexCount = static_cast<uint32_t>(vertices.size());
-    assert(vertexCount >= 3 && "Vertex Count must be at least 3");
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-    uint32_t vertexSize = sizeof(vertices[0]);
-
-    Buffer stagingBuffer{
-            device,
-            vertexSize,
-            vertexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    };
+// Draws index ranges left after cluster culling. Only valid for models with an index buffer.
+void rendering::Model::drawRanges(VkCommandBuffer commandBuffer, const std::vector<IndexRange>& ranges) {
+    assert(hasIndexBuffer && "Index ranges need an index buffer");
+    for (const auto &range: ranges) {
+        vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, firstIndex + range.firstIndex, vertexOffset, 0);
+    }
+}
 
-    stagingBuffer.map();
-    stagingBuffer.writeToBuffer((void*)vertices.data());
+void rendering::Model::createVertexBuffers(const void* vertices, uint32_t vertexSize, uint32_t count, TransferBatch* batch,
+                                           PendingUpload* upload) {
+    vertexCount = count;
+    assert(vertexCount >= 3 && "Vertex Count must be at least 3");
+    vertexBufferBytes = VkDeviceSize{vertexSize} * vertexCount;
 
-    vertexBuffer = std::make_unique<Buffer>(device,
-                                            vertexSize,
-                                            vertexCount,
-                                            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-                                            );
+    // Aligned to the vertex size so the offset is a whole number of vertices.
+    GeometryArena &arena = device.geometryArena();
+    vertexRange = arena.allocateVertices(vertexBufferBytes, vertexSize);
+    vertexOffset = static_cast<int32_t>(vertexRange.offset / vertexSize);
 
-    device.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
+    uploadGeometry(vertices, arena.getVertexBuffer(), vertexRange, batch, upload);
 }
 
-void rendering::Model::createIndexBuffers(const std::vector<uint32_t>& indices) {
-    indexCount = static_cast<uint32_t>(indices.size());
+void rendering::Model::createIndexBuffers(const uint32_t* indices, uint32_t count, TransferBatch* batch, PendingUpload* upload) {
+    indexCount = count;
     hasIndexBuffer = indexCount > 0;
     if (!hasIndexBuffer) {
         return;
     }
 
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-    uint32_t indexSize = sizeof(indices[0]);
+    // Models with fewer than 65536 vertices get a 16 bit index buffer, halving its size.
+    std::vector<uint16_t> narrowIndices{};
+    const void* indexData = indices;
+    uint32_t indexSize = sizeof(uint32_t);
+    indexType = VK_INDEX_TYPE_UINT32;
+    if (vertexCount < 65536) {
+        narrowIndices.assign(indices, indices + indexCount);
+        indexData = narrowIndices.data();
+        indexSize = sizeof(uint16_t);
+        indexType = VK_INDEX_TYPE_UINT16;
+    }
 
-    Buffer stagingBuffer {
-        device,
-        indexSize,
-        indexCount,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    };
+    indexBufferBytes = VkDeviceSize{indexSize} * indexCount;
+
+    GeometryArena &arena = device.geometryArena();
+    indexRange = arena.allocateIndices(indexBufferBytes, indexSize);
+    firstIndex = static_cast<uint32_t>(indexRange.offset / indexSize);
 
-    stagingBuffer.map();
-    stagingBuffer.writeToBuffer((void*)indices.data());
+    uploadGeometry(indexData, arena.getIndexBuffer(), indexRange, batch, upload);
+}
 
-    indexBuffer = std::make_unique<Buffer>(
-            device,
-            indexSize,
-            indexCount,
-            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-            );
+// Records the copy into `batch` or defers it into `upload`, with neither uploads right away and
+// blocks until the GPU is done.
+void rendering::Model::uploadGeometry(const void* data, VkBuffer destination, const GeometryArena::Range& range,
+                                      TransferBatch* batch, PendingUpload* upload) {
+    if (batch != nullptr) {
+        batch->uploadBuffer(destination, range.offset, data, range.size);
+        return;
+    }
+    if (upload == nullptr) {
+        device.uploadBuffer(destination, range.offset, data, range.size);
+        return;
+    }
+    auto bytes = static_cast<const uint8_t*>(data);
+    upload->copies.push_back({std::vector<uint8_t>(bytes, bytes + range.size), destination, range.offset});
+}
 
-    device.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);}
+VkDeviceSize rendering::Model::unpackedGeometryBytes(const MeshData &mesh) {
+    return VkDeviceSize{mesh.vertexCount} * sizeof(Vertex) + VkDeviceSize{mesh.indexCount} * sizeof(uint32_t);
+}
 
 std::unique_ptr<rendering::Model> rendering::Model::createModelFromFile(rendering::Device &device, const std::string &filepath) {
+    return createModelFromFile(device, filepath, LoadOptions{});
+}
+
+std::unique_ptr<rendering::Model> rendering::Model::createModelFromFile(rendering::Device &device, const std::string &filepath,
+                                                                        const LoadOptions &options, PendingUpload *upload) {
+    return loadFromFile(device, filepath, options, nullptr, upload);
+}
+
+// Loads many models with one submit: record them all into the same batch, then submit it once.
+std::unique_ptr<rendering::Model> rendering::Model::createModelFromFile(rendering::Device &device, const std::string &filepath,
+                                                                        const LoadOptions &options, TransferBatch &batch) {
+    return loadFromFile(device, filepath, options, &batch, nullptr);
+}
+
+std::unique_ptr<rendering::Model> rendering::Model::loadFromFile(rendering::Device &device, const std::string &filepath,
+                                                                 const LoadOptions &options, TransferBatch *batch,
+                                                                 PendingUpload *upload) {
+    MeshCache::Entry cached{};
+    if (MeshCache::load(filepath, options.cacheVariant(), cached)) {
+        std::cout << "Vertex Count: " << cached.mesh.vertexCount << " (cached)\n";
+        return std::unique_ptr<Model>(new Model(device, cached.mesh, options.vertexFormat, batch, upload));
+    }
+
     Builder builder{};
-    builder.loadModel(filepath);
+    builder.loadModel(filepath, options.parseThreads);
+    if (options.optimize) {
+        MeshOptimizer::optimize(builder);
+    }
+    if (options.generateLods) {
+        MeshSimplifier::generateLods(builder);
+    }
+    MeshCache::store(filepath, options.cacheVariant(), builder.data());
     std::cout << "Vertex Count: " << builder.vertices.size() << '\n';
-    return std::make_unique<Model>(device, builder);
+    return std::unique_ptr<Model>(new Model(device, builder.data(), options.vertexFormat, batch, upload));
+}
+
+void rendering::Model::Builder::computeBounds() {
+    if (vertices.empty()) {
+        boundsMin = boundsMax = glm::vec3{0.0f};
+        return;
+    }
+    boundsMin = boundsMax = vertices[0].position;
+    for (const auto &vertex: vertices) {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+}
+
+rendering::Model::MeshData rendering::Model::Builder::data() const {
+    MeshData mesh{};
+    mesh.vertices = vertices.data();
+    mesh.vertexCount = static_cast<uint32_t>(vertices.size());
+    mesh.indices = indices.data();
+    mesh.indexCount = static_cast<uint32_t>(indices.size());
+    mesh.lods = lods.data();
+    mesh.lodCount = static_cast<uint32_t>(lods.size());
+    mesh.boundsMin = boundsMin;
+    mesh.boundsMax = boundsMax;
+    return mesh;
 }
 
 std::vector<VkVertexInputBindingDescription> rendering::Model::Vertex::getBindingDescription() {
@@ -129,7 +332,114 @@ std::vector<VkVertexInputAttributeDescription> rendering::Model::Vertex::getAttr
     return attributeDescriptions;
 }
 
-void rendering::Model::Builder::loadModel(const std::string& filepath) {
+std::vector<VkVertexInputBindingDescription> rendering::Model::PackedVertex::getBindingDescription() {
+    std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+    bindingDescriptions[0].binding = 0;
+    bindingDescriptions[0].stride = sizeof(PackedVertex);
+    bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    return bindingDescriptions;
+}
+
+std::vector<VkVertexInputAttributeDescription> rendering::Model::PackedVertex::getAttributeDescription() {
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+    attributeDescriptions.push_back({0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(PackedVertex, position)});
+    attributeDescriptions.push_back({1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color)});
+    attributeDescriptions.push_back({2, 0, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal)});
+    attributeDescriptions.push_back({3, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv)});
+
+    return attributeDescriptions;
+}
+
+/**
+ * Quantizes a vertex. Positions are stored relative to the box `offset` +- `scale`, which is
+ * expected to contain them (Model uses the mesh bounds).
+ *
+ * @param vertex Vertex to pack
+ * @param offset Center of the quantization box
+ * @param scale Half extent of the quantization box, no component may be zero
+ *
+ * @return The packed vertex
+ */
+rendering::Model::PackedVertex rendering::Model::PackedVertex::pack(const Vertex &vertex, const glm::vec3 &offset,
+                                                                    const glm::vec3 &scale) {
+    PackedVertex packed{};
+    glm::vec3 position = (vertex.position - offset) / scale;
+    glm::vec2 normal = encodeOctahedral(vertex.normal);
+    for (int i = 0; i < 3; i++) {
+        packed.position[i] = toSnorm16(position[i]);
+        packed.color[i] = toUnorm8(vertex.color[i]);
+    }
+    packed.color[3] = 255;
+    packed.normal[0] = toSnorm16(normal.x);
+    packed.normal[1] = toSnorm16(normal.y);
+    packed.uv[0] = toHalf(vertex.uv.x);
+    packed.uv[1] = toHalf(vertex.uv.y);
+    return packed;
+}
+
+// Decodes like the vertex shader does, used to measure quantization error on the CPU.
+rendering::Model::Vertex rendering::Model::PackedVertex::unpack(const glm::vec3 &offset, const glm::vec3 &scale) const {
+    Vertex vertex{};
+    for (int i = 0; i < 3; i++) {
+        vertex.position[i] = offset[i] + scale[i] * fromSnorm16(position[i]);
+        vertex.color[i] = static_cast<float>(color[i]) / 255.0f;
+    }
+    vertex.normal = decodeOctahedral({fromSnorm16(normal[0]), fromSnorm16(normal[1])});
+    vertex.uv = {fromHalf(uv[0]), fromHalf(uv[1])};
+    return vertex;
+}
+
+/**
+ * Assembles the vertex for one face corner. Every component gets + 0.0f so -0.0f turns into +0.0f,
+ * which the byte wise weld in VertexTable would otherwise treat as a different vertex.
+ */
+rendering::Model::Vertex rendering::Model::Builder::makeVertex(const ObjData& obj, const ObjIndex& index) {
+    Vertex vertex{};
+
+    vertex.position = glm::vec3{
+            obj.positions[3 * index.vertexIndex + 0],
+            obj.positions[3 * index.vertexIndex + 1],
+            obj.positions[3 * index.vertexIndex + 2],
+    } + 0.0f;
+
+    vertex.color = glm::vec3{
+            obj.colors[3 * index.vertexIndex + 0],
+            obj.colors[3 * index.vertexIndex + 1],
+            obj.colors[3 * index.vertexIndex + 2],
+    } + 0.0f;
+
+    if (index.normalIndex >= 0) {
+        vertex.normal = glm::vec3{
+                obj.normals[3 * index.normalIndex + 0],
+                obj.normals[3 * index.normalIndex + 1],
+                obj.normals[3 * index.normalIndex + 2],
+        } + 0.0f;
+    }
+
+    if (index.texcoordIndex >= 0) {
+        vertex.uv = glm::vec2{
+                obj.texcoords[2 * index.texcoordIndex + 0],
+                obj.texcoords[2 * index.texcoordIndex + 1],
+        } + 0.0f;
+    }
+
+    return vertex;
+}
+
+void rendering::Model::Builder::loadModel(const std::string& filepath, uint32_t threadCount) {
+    ObjData obj{};
+    ObjParser::parse(filepath, obj, threadCount);
+
+    lods.clear();
+    weldVertices(obj.indices.size(),
+                 [&obj](size_t corner) { return makeVertex(obj, obj.indices[corner]); },
+                 vertices, indices, threadCount);
+
+    computeBounds();
+}
+
+// Reference loader kept for the --benchmark comparison against ObjParser.
+void rendering::Model::Builder::loadModelTinyObj(const std::string& filepath) {
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
@@ -142,6 +452,7 @@ void rendering::Model::Builder::loadModel(const std::string& filepath) {
 
     vertices.clear();
     indices.clear();
+    lods.clear();
 
     for (const auto &shape: shapes) {
         for (const auto &index: shape.mesh.indices) {
@@ -185,4 +496,6 @@ void rendering::Model::Builder::loadModel(const std::string& filepath) {
             indices.push_back(uniqueVertices[vertex]);
         }
     }
+
+    computeBounds();
 }
\ No newline at end of file
@@ -11,11 +11,19 @@
 #include "VulkanCommon.h"
 #include "Device.hpp"
 #include "Buffer.h"
+#include "GeometryArena.h"
+#include "ObjParser.h"
+#include "TransferBatch.h"
 
 namespace rendering {
     class Model {
     public:
 
+        enum class VertexFormat {
+            Float,  // Vertex, 44 bytes
+            Packed, // PackedVertex, 20 bytes, shader.vert with ShaderPermutation::vertexFormat Packed
+        };
+
         struct Vertex {
             glm::vec3 position{};
             glm::vec3 color{};
@@ -30,37 +38,178 @@ namespace rendering {
             }
         };
 
+        // Quantized counterpart of Vertex. Positions are snorm16 relative to the model's bounds and are
+        // scaled back by getVertexTransform(), normals are octahedral snorm16, uvs are half floats.
+        struct PackedVertex {
+            int16_t position[4]; // w unused, keeps the attribute 8 byte aligned
+            uint8_t color[4];    // alpha unused
+            int16_t normal[2];
+            uint16_t uv[2];
+
+            static std::vector<VkVertexInputBindingDescription> getBindingDescription();
+            static std::vector<VkVertexInputAttributeDescription> getAttributeDescription();
+
+            static PackedVertex pack(const Vertex& vertex, const glm::vec3& offset, const glm::vec3& scale);
+            [[nodiscard]] Vertex unpack(const glm::vec3& offset, const glm::vec3& scale) const;
+        };
+
+        // Sub-range of the model's indices drawing it at reduced detail. `error` bounds the
+        // distance to the full resolution surface in model space; LOD 0 is the full mesh with error 0.
+        struct Lod {
+            uint32_t firstIndex = 0;
+            uint32_t indexCount = 0;
+            float error = 0.0f;
+        };
+
+        // Contiguous run of the model's indices, what a single vkCmdDrawIndexed draws. Like Lod, relative
+        // to the model's first index; draw calls add getFirstIndex().
+        struct IndexRange {
+            uint32_t firstIndex = 0;
+            uint32_t indexCount = 0;
+        };
+
+        // Clusters of at most MeshletBuilder::MAX_VERTICES vertices and MAX_TRIANGLES triangles, stored
+        // as parallel arrays so culling only touches the bounds and cones. All in model space.
+        struct Meshlets {
+            std::vector<uint32_t> firstIndex{};
+            std::vector<uint32_t> indexCount{};
+            std::vector<glm::vec4> bounds{};     // bounding sphere center in xyz, radius in w
+            std::vector<glm::vec4> cones{};      // normal cone axis in xyz, sine of the half angle in w
+            std::vector<uint32_t> lodOffsets{};  // meshlets of LOD i are [lodOffsets[i], lodOffsets[i + 1])
+
+            [[nodiscard]] uint32_t size() const { return static_cast<uint32_t>(firstIndex.size()); }
+        };
+
+        // Non-owning view of finished geometry, backed either by a Builder or by a mapped cache file.
+        struct MeshData {
+            const Vertex* vertices = nullptr;
+            uint32_t vertexCount = 0;
+            const uint32_t* indices = nullptr;
+            uint32_t indexCount = 0;
+            const Lod* lods = nullptr;
+            uint32_t lodCount = 0;
+            glm::vec3 boundsMin{};
+            glm::vec3 boundsMax{};
+        };
+
         struct Builder {
             std::vector<Vertex> vertices{};
             std::vector<uint32_t> indices{};
+            std::vector<Lod> lods{};
+            glm::vec3 boundsMin{};
+            glm::vec3 boundsMax{};
+
+            void loadModel(const std::string& filepath, uint32_t threadCount = 0);
+            void loadModelTinyObj(const std::string& filepath);
+            void computeBounds();
+
+            static Vertex makeVertex(const ObjData& obj, const ObjIndex& index);
+
+            [[nodiscard]] MeshData data() const;
+        };
 
-            void loadModel(const std::string& filepath);
+        // Optional processing done by createModelFromFile between loading and upload.
+        struct LoadOptions {
+            bool optimize = true;     // MeshOptimizer vertex cache, overdraw and vertex fetch passes
+            bool generateLods = true; // MeshSimplifier LOD chain
+            VertexFormat vertexFormat = VertexFormat::Float;
+            // Threads a cache miss may use to parse and weld the mesh, 0 for every core. Callers that
+            // load several models at once pass their share so the loads do not oversubscribe the machine.
+            uint32_t parseThreads = 0;
+
+            // Distinguishes cache entries produced with different options. The vertex format is not
+            // part of it, the cache always holds float vertices and packing happens at upload.
+            [[nodiscard]] uint32_t cacheVariant() const { return (optimize ? 1u : 0u) | (generateLods ? 2u : 0u); }
+        };
+
+        // Geometry of a model that was placed in the arena but not copied there yet, for Models created
+        // off the thread that submits transfers. Whoever passed it to the Model stages the bytes with a
+        // TransferBatch later; the model must not be drawn before it completed. See ModelStreamer.
+        struct PendingUpload {
+            struct Copy {
+                std::vector<uint8_t> data{};
+                VkBuffer destination = VK_NULL_HANDLE;
+                VkDeviceSize destinationOffset = 0;
+            };
+
+            std::vector<Copy> copies{};
         };
 
         Model(Device &_device, const Model::Builder& builder);
+        Model(Device &_device, const MeshData& mesh, VertexFormat format = VertexFormat::Float,
+              PendingUpload* upload = nullptr);
+        // Records the upload into `batch`, the model must not be drawn before the batch completed.
+        Model(Device &_device, const MeshData& mesh, VertexFormat format, TransferBatch& batch);
         ~Model();
 
         Model(const Model&) = delete;
         Model &operator = (const Model&) = delete;
 
         static std::unique_ptr<Model> createModelFromFile(Device& device, const std::string& filepath);
-
-        void bind(VkCommandBuffer commandBuffer);
-        void draw(VkCommandBuffer commandBuffer);
+        static std::unique_ptr<Model> createModelFromFile(Device& device, const std::string& filepath,
+                                                          const LoadOptions& options, PendingUpload* upload = nullptr);
+        static std::unique_ptr<Model> createModelFromFile(Device& device, const std::string& filepath,
+                                                          const LoadOptions& options, TransferBatch& batch);
+
+        // Geometry lives in the device's GeometryArena, bind it once with GeometryArena::bindVertexBuffer
+        // and bindIndexBuffer(getIndexType()) before drawing.
+        void draw(VkCommandBuffer commandBuffer, uint32_t lod = 0);
+        void drawRanges(VkCommandBuffer commandBuffer, const std::vector<IndexRange>& ranges);
+
+        [[nodiscard]] glm::vec3 getBoundsMin() const { return boundsMin; }
+        [[nodiscard]] glm::vec3 getBoundsMax() const { return boundsMax; }
+        [[nodiscard]] const std::vector<Lod>& getLods() const { return lods; }
+        // Empty for models without an index buffer.
+        [[nodiscard]] const Meshlets& getMeshlets() const { return meshlets; }
+        [[nodiscard]] VertexFormat getVertexFormat() const { return vertexFormat; }
+        [[nodiscard]] bool hasIndices() const { return hasIndexBuffer; }
+        [[nodiscard]] VkIndexType getIndexType() const { return indexType; }
+        // Position of the model's first index and vertex in the arena, in indices and vertices.
+        [[nodiscard]] uint32_t getFirstIndex() const { return firstIndex; }
+        [[nodiscard]] int32_t getVertexOffset() const { return vertexOffset; }
+        [[nodiscard]] uint32_t getIndexCount() const { return indexCount; }
+        // Maps stored vertex positions to model space, identity unless the format is Packed.
+        [[nodiscard]] const glm::mat4& getVertexTransform() const { return vertexTransform; }
+        // Arena memory taken by the vertices and indices.
+        [[nodiscard]] VkDeviceSize getGeometryBytes() const { return vertexBufferBytes + indexBufferBytes; }
+        // What the same geometry takes as Vertex with 32 bit indices.
+        static VkDeviceSize unpackedGeometryBytes(const MeshData& mesh);
 
     private:
 
-        void createVertexBuffers(const std::vector<Vertex> &vertices);
-        void createIndexBuffers(const std::vector<uint32_t> &indices);
+        // At most one of `batch` and `upload` is set, with neither the upload blocks.
+        Model(Device &_device, const MeshData& mesh, VertexFormat format, TransferBatch* batch, PendingUpload* upload);
+        static std::unique_ptr<Model> loadFromFile(Device& device, const std::string& filepath, const LoadOptions& options,
+                                                   TransferBatch* batch, PendingUpload* upload);
+
+        void createVertexBuffers(const void* vertices, uint32_t vertexSize, uint32_t count, TransferBatch* batch,
+                                 PendingUpload* upload);
+        void createIndexBuffers(const uint32_t* indices, uint32_t count, TransferBatch* batch, PendingUpload* upload);
+        void uploadGeometry(const void* data, VkBuffer destination, const GeometryArena::Range& range,
+                            TransferBatch* batch, PendingUpload* upload);
 
         Device& device;
 
-        std::unique_ptr<Buffer> vertexBuffer;
+        glm::vec3 boundsMin{};
+        glm::vec3 boundsMax{};
+
+        VertexFormat vertexFormat = VertexFormat::Float;
+        glm::mat4 vertexTransform{1.0f};
+
+        GeometryArena::Range vertexRange{};
         uint32_t vertexCount;
+        int32_t vertexOffset = 0;
+        VkDeviceSize vertexBufferBytes = 0;
 
         bool hasIndexBuffer = false;
-        std::unique_ptr<Buffer> indexBuffer;
+        GeometryArena::Range indexRange{};
         uint32_t  indexCount;
+        uint32_t firstIndex = 0;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+        VkDeviceSize indexBufferBytes = 0;
+
+        std::vector<Lod> lods{};
+        Meshlets meshlets{};
     };
 
 }
@@ -0,0 +1,131 @@
+
+#include "ModelRegistry.h"
+#include "MappedFile.h"
+#include "renderingutility.h"
+
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace rendering {
+
+    namespace {
+        std::string canonicalPath(const std::string &filepath) {
+            std::error_code error;
+            fs::path path = fs::weakly_canonical(filepath, error);
+            return error ? filepath : path.generic_string();
+        }
+
+        // Everything in LoadOptions but parseThreads changes the uploaded model, unlike MeshCache's variant.
+        uint32_t optionBits(const Model::LoadOptions &options) {
+            return options.cacheVariant() | (options.vertexFormat == Model::VertexFormat::Packed ? 4u : 0u);
+        }
+    }
+
+    std::shared_ptr<Model> ModelRegistry::load(Device &device, const std::string &filepath) {
+        return load(device, filepath, Model::LoadOptions{});
+    }
+
+/**
+ * Returns the resident model for a file, loading it synchronously on a miss.
+ */
+    std::shared_ptr<Model> ModelRegistry::load(Device &device, const std::string &filepath, const Model::LoadOptions &options) {
+        if (auto model = find(filepath, options)) {
+            return model;
+        }
+        std::shared_ptr<Model> model = Model::createModelFromFile(device, filepath, options);
+        return insert(filepath, options, model);
+    }
+
+/**
+ * Looks up a resident model by path, hashing the file the first time a path is seen so a copy
+ * under another name is found as well. Counts a hit or a miss.
+ *
+ * @return The shared model, nullptr if none is resident
+ */
+    std::shared_ptr<Model> ModelRegistry::find(const std::string &filepath, const Model::LoadOptions &options) {
+        uint64_t content = contentKey(key(filepath, options), filepath, options);
+
+        std::lock_guard<std::mutex> lock{mutex};
+        auto entry = models.find(content);
+        if (entry != models.end()) {
+            if (auto model = entry->second.model.lock()) {
+                hits++;
+                return model;
+            }
+        }
+        misses++;
+        return nullptr;
+    }
+
+/**
+ * Registers a freshly loaded model. If another thread registered the same content in the meantime,
+ * that model wins and the new one is left to be released by the caller.
+ *
+ * @return The model every later find() returns
+ */
+    std::shared_ptr<Model> ModelRegistry::insert(const std::string &filepath, const Model::LoadOptions &options,
+                                                 const std::shared_ptr<Model> &model) {
+        uint64_t content = contentKey(key(filepath, options), filepath, options);
+
+        std::lock_guard<std::mutex> lock{mutex};
+        prune();
+        Entry &entry = models[content];
+        if (auto existing = entry.model.lock()) {
+            return existing;
+        }
+        entry.model = model;
+        entry.bytes = model->getGeometryBytes();
+        return model;
+    }
+
+    void ModelRegistry::addSharedHit() {
+        std::lock_guard<std::mutex> lock{mutex};
+        hits++;
+    }
+
+    ModelRegistry::Stats ModelRegistry::getStats() {
+        std::lock_guard<std::mutex> lock{mutex};
+        prune();
+
+        Stats stats{};
+        stats.hits = hits;
+        stats.misses = misses;
+        stats.residentModels = static_cast<uint32_t>(models.size());
+        for (const auto &entry: models) {
+            stats.residentBytes += entry.second.bytes;
+        }
+        return stats;
+    }
+
+    // Canonical path plus load options, identifies a request without touching the file.
+    std::string ModelRegistry::key(const std::string &filepath, const Model::LoadOptions &options) {
+        return canonicalPath(filepath) + '?' + std::to_string(optionBits(options));
+    }
+
+    // The content is hashed once per path and remembered, later edits to the file are not noticed.
+    uint64_t ModelRegistry::contentKey(const std::string &pathKey, const std::string &filepath,
+                                       const Model::LoadOptions &options) {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            auto known = contentKeys.find(pathKey);
+            if (known != contentKeys.end()) {
+                return known->second;
+            }
+        }
+
+        MappedFile file{filepath};
+        uint64_t content = hashBytes(file.data(), file.size(), optionBits(options));
+
+        std::lock_guard<std::mutex> lock{mutex};
+        contentKeys[pathKey] = content;
+        return content;
+    }
+
+    // Drops entries whose model was released by every object. Expects the mutex to be held.
+    void ModelRegistry::prune() {
+        for (auto entry = models.begin(); entry != models.end();) {
+            entry = entry->second.model.expired() ? models.erase(entry) : std::next(entry);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef VULKANLEARN_MODELREGISTRY_H
+#define VULKANLEARN_MODELREGISTRY_H
+
+#include "Device.hpp"
+#include "Model.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace rendering {
+    // Shares one Model between every object that loads the same file with the same options. Models
+    // are found by canonical path first and by a hash of the file content second, so copies of a file
+    // under different names share too. Only weak references are kept: a model is evicted as soon as
+    // the last object drops it. Safe to use from several threads.
+    class ModelRegistry {
+    public:
+        struct Stats {
+            uint64_t hits = 0;            // requests served by a model that was resident or already loading
+            uint64_t misses = 0;          // requests that had to load the file
+            uint32_t residentModels = 0;
+            VkDeviceSize residentBytes = 0; // vertex and index buffer memory of the resident models
+        };
+
+        ModelRegistry() = default;
+
+        ModelRegistry(const ModelRegistry&) = delete;
+        ModelRegistry &operator = (const ModelRegistry&) = delete;
+
+        std::shared_ptr<Model> load(Device& device, const std::string& filepath);
+        std::shared_ptr<Model> load(Device& device, const std::string& filepath, const Model::LoadOptions& options);
+
+        std::shared_ptr<Model> find(const std::string& filepath, const Model::LoadOptions& options);
+        std::shared_ptr<Model> insert(const std::string& filepath, const Model::LoadOptions& options,
+                                      const std::shared_ptr<Model>& model);
+        // Counts a request that joined a load already in flight, see ModelStreamer.
+        void addSharedHit();
+
+        [[nodiscard]] Stats getStats();
+
+        static std::string key(const std::string& filepath, const Model::LoadOptions& options);
+
+    private:
+        struct Entry {
+            std::weak_ptr<Model> model{};
+            VkDeviceSize bytes = 0;
+        };
+
+        uint64_t contentKey(const std::string& pathKey, const std::string& filepath, const Model::LoadOptions& options);
+        void prune();
+
+        std::mutex mutex;
+        std::unordered_map<std::string, uint64_t> contentKeys{}; // path key -> content key
+        std::unordered_map<uint64_t, Entry> models{};            // content key -> model
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+}
+
+#endif //VULKANLEARN_MODELREGISTRY_H
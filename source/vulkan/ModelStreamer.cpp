@@ -0,0 +1,252 @@
+
+#include "ModelStreamer.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace rendering {
+
+    ModelStreamer::ModelStreamer(Device &_device, ModelRegistry *_registry, uint32_t workerCount)
+            : device(_device), registry(_registry) {
+        createPlaceholder();
+
+        // Half the cores keep many small files streaming. The cores are shared out between the
+        // workers' loads, a burst of loads must not start a full set of parse and weld threads per worker.
+        if (workerCount == 0) {
+            workerCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+        }
+        parseThreads = std::max(1u, std::thread::hardware_concurrency() / workerCount);
+        for (uint32_t i = 0; i < workerCount; i++) {
+            workers.emplace_back(&ModelStreamer::work, this);
+        }
+    }
+
+    ModelStreamer::~ModelStreamer() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker: workers) {
+            worker.join();
+        }
+
+        if (!submissions.empty()) {
+            device.transfers().wait(submissions.back().token);
+        }
+    }
+
+    ModelStreamer::Handle ModelStreamer::load(const std::string &filepath) {
+        return load(filepath, Model::LoadOptions{});
+    }
+
+/**
+ * Queues a model for loading and returns immediately. Must be called from the thread that calls
+ * update().
+ *
+ * @param filepath Model file, see Model::createModelFromFile
+ * @param options Processing options passed on to Model::createModelFromFile
+ *
+ * @return Handle that becomes ready once the model is resident on the GPU
+ */
+    ModelStreamer::Handle ModelStreamer::load(const std::string &filepath, const Model::LoadOptions &options) {
+        auto request = std::make_shared<Request>();
+        request->path = filepath;
+        request->options = options;
+        if (request->options.parseThreads == 0) {
+            request->options.parseThreads = parseThreads;
+        }
+        if (registry) {
+            request->key = ModelRegistry::key(filepath, options);
+            auto loading = inFlight.find(request->key);
+            if (loading != inFlight.end()) {
+                registry->addSharedHit();
+                return loading->second;
+            }
+            inFlight.emplace(request->key, request);
+        }
+        pending++;
+
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            queued.push_back(request);
+        }
+        wake.notify_one();
+        return request;
+    }
+
+/**
+ * Makes an object draw the model behind a handle. Until the handle is ready the object gets the
+ * placeholder, update() swaps in the real model afterwards.
+ */
+    void ModelStreamer::assign(engine::Object &object, const Handle &handle) {
+        object.lod = 0;
+        if (handle->isReady()) {
+            object.model = handle->getModel();
+            return;
+        }
+        object.model = placeholder;
+        assignments.push_back({object.getId(), handle});
+    }
+
+/**
+ * Stages and submits the uploads of models the workers finished parsing, as far as the staging ring
+ * has room, retires uploads whose submission completed and hands their models to the objects
+ * waiting for them. Call once per frame, outside of command buffer recording; swapping here means
+ * every frame draws either the placeholder or the finished model, never a model whose copy is still
+ * in flight.
+ *
+ * @return Number of models that became ready
+ */
+    uint32_t ModelStreamer::update(engine::Object::Map &objects) {
+        std::vector<Handle> finished{};
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            finished.swap(loaded);
+        }
+
+        uint32_t completed = 0;
+        for (auto &request: finished) {
+            if (request->model && request->upload.copies.empty()) {
+                // Shared with a model the registry already had resident.
+                request->state.store(State::Ready, std::memory_order_release);
+                inFlight.erase(request->key);
+                completed++;
+            }
+            else if (request->model) {
+                request->state.store(State::Uploading, std::memory_order_release);
+                staging.push_back(std::move(request));
+            }
+            else {
+                std::cerr << "failed to stream " << request->path << ": " << request->error << '\n';
+                request->state.store(State::Failed, std::memory_order_release);
+                inFlight.erase(request->key);
+                pending--;
+            }
+        }
+        if (!staging.empty()) {
+            submitUploads();
+        }
+
+        TransferQueue &transfers = device.transfers();
+        for (auto it = submissions.begin(); it != submissions.end();) {
+            if (!transfers.isComplete(it->token)) {
+                ++it;
+                continue;
+            }
+            for (auto &request: it->requests) {
+                if (registry) {
+                    request->model = registry->insert(request->path, request->options, request->model);
+                    inFlight.erase(request->key);
+                }
+                request->state.store(State::Ready, std::memory_order_release);
+                completed++;
+            }
+            it = submissions.erase(it);
+        }
+        pending -= completed;
+
+        assignments.erase(std::remove_if(assignments.begin(), assignments.end(), [&objects](const Assignment &assignment) {
+            State state = assignment.handle->getState();
+            if (state == State::Ready) {
+                auto object = objects.find(assignment.objectId);
+                if (object != objects.end()) {
+                    object->second.model = assignment.handle->getModel();
+                    object->second.lod = 0;
+                }
+            }
+            return state == State::Ready || state == State::Failed;
+        }), assignments.end());
+
+        return completed;
+    }
+
+    void ModelStreamer::work() {
+        for (;;) {
+            Handle request{};
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                wake.wait(lock, [this] { return stopping || !queued.empty(); });
+                if (stopping) {
+                    return;
+                }
+                request = std::move(queued.front());
+                queued.pop_front();
+            }
+
+            try {
+                if (registry) {
+                    request->model = registry->find(request->path, request->options);
+                }
+                if (!request->model) {
+                    request->model = Model::createModelFromFile(device, request->path, request->options, &request->upload);
+                }
+            }
+            catch (const std::exception &e) {
+                request->model.reset();
+                request->error = e.what();
+            }
+
+            std::lock_guard<std::mutex> lock{mutex};
+            loaded.push_back(std::move(request));
+        }
+    }
+
+/**
+ * Stages as much of the waiting geometry as the staging ring has room for into one TransferBatch
+ * and submits it. Requests whose last byte made it in complete with this submission, a request cut
+ * off by a full ring continues in the next update().
+ */
+    void ModelStreamer::submitUploads() {
+        TransferBatch batch{device};
+        Submission submission{};
+
+        bool full = false;
+        while (!staging.empty() && !full) {
+            Request &request = *staging.front();
+            auto &copies = request.upload.copies;
+            while (request.stagedCopies < copies.size()) {
+                const auto &copy = copies[request.stagedCopies];
+                VkDeviceSize staged = batch.stageBuffer(copy.destination, copy.destinationOffset + request.stagedBytes,
+                                                        copy.data.data() + request.stagedBytes,
+                                                        copy.data.size() - request.stagedBytes);
+                request.stagedBytes += staged;
+                if (request.stagedBytes < copy.data.size()) {
+                    full = true;
+                    break;
+                }
+                request.stagedCopies++;
+                request.stagedBytes = 0;
+            }
+            if (!full) {
+                staging.front()->upload = {};
+                submission.requests.push_back(std::move(staging.front()));
+                staging.pop_front();
+            }
+        }
+
+        // Draws submitted once the token completed see the finished geometry.
+        batch.makeVisible(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT);
+        submission.token = batch.submit();
+        if (!submission.requests.empty()) {
+            submissions.push_back(std::move(submission));
+        }
+    }
+
+    // Grey unit cube, uploaded synchronously once at startup.
+    void ModelStreamer::createPlaceholder() {
+        Model::Builder builder{};
+        for (uint32_t corner = 0; corner < 8; corner++) {
+            Model::Vertex vertex{};
+            vertex.position = {corner & 1 ? 0.5f : -0.5f, corner & 2 ? 0.5f : -0.5f, corner & 4 ? 0.5f : -0.5f};
+            vertex.color = glm::vec3{0.5f};
+            vertex.normal = glm::normalize(vertex.position);
+            builder.vertices.push_back(vertex);
+        }
+        builder.indices = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6,
+                           0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7,
+                           0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+        builder.computeBounds();
+        placeholder = std::make_shared<Model>(device, builder);
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef VULKANLEARN_MODELSTREAMER_H
+#define VULKANLEARN_MODELSTREAMER_H
+
+#include "Device.hpp"
+#include "Model.h"
+#include "ModelRegistry.h"
+#include "TransferBatch.h"
+
+#include "../engine/Object.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace rendering {
+    // Loads models in the background. Files are parsed and their arena ranges placed on a pool of
+    // worker threads, update() on the render thread, which owns the queue, stages the geometry of
+    // every model parsed since the last update into one TransferBatch and polls its token instead of
+    // waiting for the queue to go idle. When the staging ring is full the rest waits for the next update().
+    // Objects assigned to a load draw a placeholder cube until their model is resident. With a
+    // ModelRegistry, loads of a file that is already resident or loading share its model.
+    class ModelStreamer {
+    public:
+        enum class State {
+            Loading,   // queued or being parsed by a worker
+            Uploading, // being staged or copies submitted, waiting for their fence
+            Ready,
+            Failed,
+        };
+
+        // Returned by load() right away and shared between the caller and the streamer.
+        class Request {
+        public:
+            [[nodiscard]] State getState() const { return state.load(std::memory_order_acquire); }
+            [[nodiscard]] bool isReady() const { return getState() == State::Ready; }
+            [[nodiscard]] const std::string& getPath() const { return path; }
+            // Only set once the request is ready, read it from the thread calling update().
+            [[nodiscard]] std::shared_ptr<Model> getModel() const { return isReady() ? model : nullptr; }
+
+        private:
+            friend class ModelStreamer;
+
+            std::string path{};
+            std::string key{};
+            Model::LoadOptions options{};
+            std::atomic<State> state{State::Loading};
+            std::shared_ptr<Model> model{};
+            Model::PendingUpload upload{};
+            size_t stagedCopies = 0;       // copies of `upload` fully staged
+            VkDeviceSize stagedBytes = 0;  // bytes staged of the next copy
+            std::string error{};
+        };
+
+        using Handle = std::shared_ptr<Request>;
+
+        explicit ModelStreamer(Device& _device, ModelRegistry* _registry = nullptr, uint32_t workerCount = 0);
+        ~ModelStreamer();
+
+        ModelStreamer(const ModelStreamer&) = delete;
+        ModelStreamer &operator = (const ModelStreamer&) = delete;
+
+        Handle load(const std::string& filepath);
+        Handle load(const std::string& filepath, const Model::LoadOptions& options);
+
+        void assign(engine::Object& object, const Handle& handle);
+        uint32_t update(engine::Object::Map& objects);
+
+        // Loads that are neither ready nor failed yet.
+        [[nodiscard]] size_t getPendingCount() const { return pending; }
+        [[nodiscard]] const std::shared_ptr<Model>& getPlaceholder() const { return placeholder; }
+
+    private:
+        struct Submission {
+            TransferBatch::Token token{};
+            std::vector<Handle> requests{};
+        };
+
+        struct Assignment {
+            engine::Object::uint32 objectId;
+            Handle handle;
+        };
+
+        void work();
+        void submitUploads();
+        void createPlaceholder();
+
+        Device& device;
+        ModelRegistry* registry;
+        std::shared_ptr<Model> placeholder{};
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<Handle> queued{};
+        std::vector<Handle> loaded{}; // parsed by a worker, waiting for update() to submit them
+        bool stopping = false;
+        std::vector<std::thread> workers{};
+        uint32_t parseThreads = 1; // parse and weld threads of each worker's loads
+
+        std::deque<Handle> staging{};  // waiting for staging space, oldest first
+        std::vector<Submission> submissions{};
+        std::vector<Assignment> assignments{};
+        std::unordered_map<std::string, Handle> inFlight{}; // by ModelRegistry::key, only with a registry
+        size_t pending = 0;
+    };
+}
+
+#endif //VULKANLEARN_MODELSTREAMER_H
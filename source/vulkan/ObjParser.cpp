@@ -0,0 +1,454 @@
+
+#include "ObjParser.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <functional>
+#include <iterator>
+#include <thread>
+
+namespace rendering {
+
+    namespace {
+        // Smallest slice of the file worth handing to its own thread.
+        constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+        constexpr double powersOfTen[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+        struct Chunk {
+            const char *begin = nullptr;
+            const char *end = nullptr;
+
+            std::vector<float> positions{};
+            std::vector<float> colors{};
+            std::vector<float> normals{};
+            std::vector<float> texcoords{};
+            std::vector<ObjIndex> indices{};
+
+            // Slots of `indices` (corner * 3 + attribute) that were written relative to this chunk's
+            // own attribute counts and still need the chunk's global base added.
+            std::vector<uint32_t> relativeSlots{};
+
+            std::string error{};
+        };
+
+        inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+        inline bool isDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+
+        inline void skipBlanks(const char *&p, const char *end) {
+            while (p < end && isBlank(*p)) {
+                ++p;
+            }
+        }
+
+        // SWAR digit parsing: converts eight or four ASCII digits held in one register with a handful
+        // of multiplies instead of a dependent multiply-add per character.
+        inline bool eightDigits(const char *p, uint32_t &value) {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            if ((((word & 0xF0F0F0F0F0F0F0F0ull) |
+                  (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) != 0x3333333333333333ull)) {
+                return false;
+            }
+            word = (word & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+            word = (word & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+            value = static_cast<uint32_t>((word & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32);
+            return true;
+        }
+
+        inline bool fourDigits(const char *p, uint32_t &value) {
+            uint32_t bytes;
+            memcpy(&bytes, p, sizeof(bytes));
+            if ((((bytes & 0xF0F0F0F0u) | (((bytes + 0x06060606u) & 0xF0F0F0F0u) >> 4)) != 0x33333333u)) {
+                return false;
+            }
+            uint64_t word = bytes;
+            word = (word & 0x0F0F0F0Full) * 2561 >> 8;
+            word = (word & 0x00FF00FFull) * 6553601 >> 16;
+            value = static_cast<uint32_t>(word & 0xFFFFull);
+            return true;
+        }
+
+        // Accumulates a run of digits into mantissa. Digits beyond what fits exactly are dropped and
+        // reported through `dropped` so the caller can fix up the decimal exponent.
+        inline int readDigits(const char *&p, const char *end, uint64_t &mantissa, int &significant, int &dropped) {
+            const char *start = p;
+            uint32_t block;
+            while (significant <= 11 && end - p >= 8 && eightDigits(p, block)) {
+                mantissa = mantissa * 100000000ull + block;
+                significant += mantissa ? 8 : 0;
+                p += 8;
+            }
+            if (significant <= 15 && end - p >= 4 && fourDigits(p, block)) {
+                mantissa = mantissa * 10000ull + block;
+                significant += mantissa ? 4 : 0;
+                p += 4;
+            }
+            while (p < end && isDigit(*p)) {
+                if (significant < 19) {
+                    mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                    significant += mantissa ? 1 : 0;
+                } else {
+                    ++dropped;
+                }
+                ++p;
+            }
+            return static_cast<int>(p - start);
+        }
+
+        bool parseFloat(const char *&p, const char *end, float &value) {
+            skipBlanks(p, end);
+            if (p >= end) {
+                return false;
+            }
+
+            bool negative = false;
+            if (*p == '-' || *p == '+') {
+                negative = *p == '-';
+                ++p;
+            }
+
+            uint64_t mantissa = 0;
+            int significant = 0;
+            int dropped = 0;
+            int integerDigits = readDigits(p, end, mantissa, significant, dropped);
+            int exponent = dropped;
+
+            int fractionDigits = 0;
+            if (p < end && *p == '.') {
+                ++p;
+                int droppedBefore = dropped;
+                fractionDigits = readDigits(p, end, mantissa, significant, dropped);
+                exponent -= fractionDigits - (dropped - droppedBefore);
+            }
+
+            if (integerDigits == 0 && fractionDigits == 0) {
+                return false;
+            }
+
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                ++p;
+                bool negativeExponent = false;
+                if (p < end && (*p == '-' || *p == '+')) {
+                    negativeExponent = *p == '-';
+                    ++p;
+                }
+                if (p >= end || !isDigit(*p)) {
+                    return false;
+                }
+                int explicitExponent = 0;
+                while (p < end && isDigit(*p)) {
+                    explicitExponent = std::min(explicitExponent * 10 + (*p - '0'), 100000);
+                    ++p;
+                }
+                exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            }
+
+            double result = static_cast<double>(mantissa);
+            if (mantissa != 0) {
+                if (exponent < 0 && exponent >= -22) {
+                    result /= powersOfTen[-exponent];
+                } else if (exponent > 0 && exponent <= 22) {
+                    result *= powersOfTen[exponent];
+                } else if (exponent != 0) {
+                    result *= std::pow(10.0, exponent);
+                }
+            }
+            value = static_cast<float>(negative ? -result : result);
+            return true;
+        }
+
+        inline bool parseInt(const char *&p, const char *end, int &value) {
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative = *p == '-';
+                ++p;
+            }
+            if (p >= end || !isDigit(*p)) {
+                return false;
+            }
+            int64_t result = 0;
+            while (p < end && isDigit(*p)) {
+                result = std::min<int64_t>(result * 10 + (*p - '0'), INT32_MAX);
+                ++p;
+            }
+            value = static_cast<int>(negative ? -result : result);
+            return true;
+        }
+
+        // Turns a one based OBJ reference into a zero based index. Negative references count back from
+        // the attributes seen so far, which inside a chunk is only known relative to the chunk start.
+        inline bool resolveIndex(int raw, size_t localCount, int &index, bool &relative) {
+            if (raw > 0) {
+                index = raw - 1;
+                relative = false;
+                return true;
+            }
+            if (raw < 0) {
+                index = static_cast<int>(static_cast<int64_t>(localCount) + raw);
+                relative = true;
+                return true;
+            }
+            return false;
+        }
+
+        struct Corner {
+            ObjIndex index;
+            bool relative[3];
+        };
+
+        void emitCorner(Chunk &chunk, const Corner &corner) {
+            auto slot = static_cast<uint32_t>(chunk.indices.size() * 3);
+            for (uint32_t i = 0; i < 3; i++) {
+                if (corner.relative[i]) {
+                    chunk.relativeSlots.push_back(slot + i);
+                }
+            }
+            chunk.indices.push_back(corner.index);
+        }
+
+        bool parseFace(const char *&p, const char *end, Chunk &chunk, std::vector<Corner> &polygon) {
+            polygon.clear();
+            size_t positionCount = chunk.positions.size() / 3;
+            size_t texcoordCount = chunk.texcoords.size() / 2;
+            size_t normalCount = chunk.normals.size() / 3;
+
+            while (true) {
+                skipBlanks(p, end);
+                if (p >= end || *p == '\n') {
+                    break;
+                }
+
+                Corner corner{};
+                int raw = 0;
+                if (!parseInt(p, end, raw) ||
+                    !resolveIndex(raw, positionCount, corner.index.vertexIndex, corner.relative[0])) {
+                    return false;
+                }
+                if (p < end && *p == '/') {
+                    ++p;
+                    if (p < end && *p != '/') {
+                        if (!parseInt(p, end, raw) ||
+                            !resolveIndex(raw, texcoordCount, corner.index.texcoordIndex, corner.relative[2])) {
+                            return false;
+                        }
+                    }
+                    if (p < end && *p == '/') {
+                        ++p;
+                        if (!parseInt(p, end, raw) ||
+                            !resolveIndex(raw, normalCount, corner.index.normalIndex, corner.relative[1])) {
+                            return false;
+                        }
+                    }
+                }
+                polygon.push_back(corner);
+            }
+
+            if (polygon.size() < 3) {
+                return false;
+            }
+            for (size_t i = 1; i + 1 < polygon.size(); i++) {
+                emitCorner(chunk, polygon[0]);
+                emitCorner(chunk, polygon[i]);
+                emitCorner(chunk, polygon[i + 1]);
+            }
+            return true;
+        }
+
+        void parseChunk(Chunk &chunk) {
+            std::vector<Corner> polygon{};
+            const char *p = chunk.begin;
+            const char *end = chunk.end;
+
+            while (p < end) {
+                const char *lineEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+                if (lineEnd == nullptr) {
+                    lineEnd = end;
+                }
+
+                skipBlanks(p, lineEnd);
+                bool ok = true;
+                if (lineEnd - p >= 2 && isBlank(p[1]) && p[0] == 'v') {
+                    p += 2;
+                    float xyz[3];
+                    ok = parseFloat(p, lineEnd, xyz[0]) && parseFloat(p, lineEnd, xyz[1]) &&
+                         parseFloat(p, lineEnd, xyz[2]);
+                    // A lone fourth value is a homogeneous w rather than a color, which we ignore
+                    float rgb[3] = {1.0f, 1.0f, 1.0f};
+                    if (ok && !(parseFloat(p, lineEnd, rgb[0]) && parseFloat(p, lineEnd, rgb[1]) &&
+                                parseFloat(p, lineEnd, rgb[2]))) {
+                        rgb[0] = rgb[1] = rgb[2] = 1.0f;
+                    }
+                    chunk.positions.insert(chunk.positions.end(), xyz, xyz + 3);
+                    chunk.colors.insert(chunk.colors.end(), rgb, rgb + 3);
+                } else if (lineEnd - p >= 3 && isBlank(p[2]) && p[0] == 'v' && p[1] == 'n') {
+                    p += 3;
+                    float xyz[3];
+                    ok = parseFloat(p, lineEnd, xyz[0]) && parseFloat(p, lineEnd, xyz[1]) &&
+                         parseFloat(p, lineEnd, xyz[2]);
+                    chunk.normals.insert(chunk.normals.end(), xyz, xyz + 3);
+                } else if (lineEnd - p >= 3 && isBlank(p[2]) && p[0] == 'v' && p[1] == 't') {
+                    p += 3;
+                    float uv[2] = {0.0f, 0.0f};
+                    ok = parseFloat(p, lineEnd, uv[0]);
+                    parseFloat(p, lineEnd, uv[1]);
+                    chunk.texcoords.insert(chunk.texcoords.end(), uv, uv + 2);
+                } else if (lineEnd - p >= 2 && isBlank(p[1]) && p[0] == 'f') {
+                    p += 2;
+                    ok = parseFace(p, lineEnd, chunk, polygon);
+                }
+
+                if (!ok) {
+                    const char *lineStart = std::find(std::make_reverse_iterator(p),
+                                                      std::make_reverse_iterator(chunk.begin), '\n').base();
+                    chunk.error = "malformed line: " + std::string(lineStart, std::min<size_t>(lineEnd - lineStart, 64));
+                    return;
+                }
+                p = lineEnd + 1;
+            }
+        }
+
+        template <typename T>
+        void appendAt(std::vector<T> &destination, size_t offset, const std::vector<T> &source) {
+            if (!source.empty()) {
+                memcpy(destination.data() + offset, source.data(), source.size() * sizeof(T));
+            }
+        }
+    }
+
+    void ObjParser::parse(const std::string &filepath, ObjData &data, uint32_t threadCount) {
+        MappedFile file{filepath};
+        try {
+            parse(file.data(), file.size(), data, threadCount);
+        }
+        catch (const std::runtime_error &e) {
+            throw std::runtime_error(filepath + ": " + e.what());
+        }
+    }
+
+/**
+ * Parses OBJ text that is already in memory. The text is cut into line aligned chunks that are
+ * parsed independently, then the per chunk arrays are concatenated in file order so the result is
+ * identical to a serial parse.
+ *
+ * @param text Start of the OBJ text, not required to be null terminated
+ * @param size Length of the text in bytes
+ * @param data Receives the parsed attributes and triangulated corners
+ * @param threadCount (Optional) Number of worker threads, 0 picks std::thread::hardware_concurrency
+ */
+    void ObjParser::parse(const char *text, size_t size, ObjData &data, uint32_t threadCount) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, size / MIN_CHUNK_SIZE));
+
+        std::vector<Chunk> chunks(chunkCount);
+        const char *end = text + size;
+        const char *cursor = text;
+        for (size_t i = 0; i < chunkCount; i++) {
+            const char *split = i + 1 == chunkCount ? end : text + size * (i + 1) / chunkCount;
+            split = std::max(split, cursor);
+            if (split < end) {
+                const char *newline = static_cast<const char *>(memchr(split, '\n', end - split));
+                split = newline ? newline + 1 : end;
+            }
+            chunks[i].begin = cursor;
+            chunks[i].end = split;
+            cursor = split;
+        }
+
+        std::vector<std::thread> workers{};
+        for (size_t i = 1; i < chunkCount; i++) {
+            workers.emplace_back(parseChunk, std::ref(chunks[i]));
+        }
+        parseChunk(chunks[0]);
+        for (auto &worker: workers) {
+            worker.join();
+        }
+
+        for (const auto &chunk: chunks) {
+            if (!chunk.error.empty()) {
+                throw std::runtime_error(chunk.error);
+            }
+        }
+
+        // Prefix sums give every chunk its global attribute and corner bases.
+        struct Offsets {
+            size_t positions, normals, texcoords, indices;
+        };
+        std::vector<Offsets> offsets(chunkCount);
+        Offsets total{0, 0, 0, 0};
+        for (size_t i = 0; i < chunkCount; i++) {
+            offsets[i] = total;
+            total.positions += chunks[i].positions.size();
+            total.normals += chunks[i].normals.size();
+            total.texcoords += chunks[i].texcoords.size();
+            total.indices += chunks[i].indices.size();
+        }
+
+        data.positions.resize(total.positions);
+        data.colors.resize(total.positions);
+        data.normals.resize(total.normals);
+        data.texcoords.resize(total.texcoords);
+        data.indices.resize(total.indices);
+
+        auto positionCount = static_cast<int>(total.positions / 3);
+        auto normalCount = static_cast<int>(total.normals / 3);
+        auto texcoordCount = static_cast<int>(total.texcoords / 2);
+
+        auto merge = [&](size_t i) {
+            Chunk &chunk = chunks[i];
+            const Offsets &base = offsets[i];
+            int bases[3] = {static_cast<int>(base.positions / 3), static_cast<int>(base.normals / 3),
+                            static_cast<int>(base.texcoords / 2)};
+            for (uint32_t slot: chunk.relativeSlots) {
+                ObjIndex &index = chunk.indices[slot / 3];
+                int attribute = static_cast<int>(slot % 3);
+                int &value = attribute == 0 ? index.vertexIndex : attribute == 1 ? index.normalIndex : index.texcoordIndex;
+                value += bases[attribute];
+            }
+
+            for (const auto &index: chunk.indices) {
+                if (index.vertexIndex < 0 || index.vertexIndex >= positionCount ||
+                    index.normalIndex < -1 || index.normalIndex >= normalCount ||
+                    index.texcoordIndex < -1 || index.texcoordIndex >= texcoordCount) {
+                    chunk.error = "face references an attribute that does not exist";
+                    break;
+                }
+            }
+
+            appendAt(data.positions, base.positions, chunk.positions);
+            appendAt(data.colors, base.positions, chunk.colors);
+            appendAt(data.normals, base.normals, chunk.normals);
+            appendAt(data.texcoords, base.texcoords, chunk.texcoords);
+            appendAt(data.indices, base.indices, chunk.indices);
+
+            std::vector<float>().swap(chunk.positions);
+            std::vector<float>().swap(chunk.colors);
+            std::vector<float>().swap(chunk.normals);
+            std::vector<float>().swap(chunk.texcoords);
+            std::vector<ObjIndex>().swap(chunk.indices);
+        };
+
+        workers.clear();
+        for (size_t i = 1; i < chunkCount; i++) {
+            workers.emplace_back(merge, i);
+        }
+        merge(0);
+        for (auto &worker: workers) {
+            worker.join();
+        }
+
+        for (const auto &chunk: chunks) {
+            if (!chunk.error.empty()) {
+                throw std::runtime_error(chunk.error);
+            }
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef VULKANLEARN_OBJPARSER_H
+#define VULKANLEARN_OBJPARSER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rendering {
+    // Zero based references into ObjData's attribute arrays, -1 when the corner has no such attribute.
+    // Mirrors tinyobj::index_t so the two loaders can be compared directly.
+    struct ObjIndex {
+        int vertexIndex = -1;
+        int normalIndex = -1;
+        int texcoordIndex = -1;
+    };
+
+    struct ObjData {
+        std::vector<float> positions{};
+        std::vector<float> colors{};
+        std::vector<float> normals{};
+        std::vector<float> texcoords{};
+        std::vector<ObjIndex> indices{};
+    };
+
+    // Wavefront OBJ reader that maps the file and parses line aligned chunks on all cores.
+    // Only geometry is read (v, vn, vt, f); polygons are fan triangulated, vertex colors default
+    // to white like tinyobj, and relative (negative) face indices are resolved after the merge.
+    class ObjParser {
+    public:
+        static void parse(const std::string& filepath, ObjData& data, uint32_t threadCount = 0);
+        static void parse(const char* text, size_t size, ObjData& data, uint32_t threadCount = 0);
+    };
+}
+
+#endif //VULKANLEARN_OBJPARSER_H
@@ -1,45 +1,40 @@
 
 #include "Pipeline.h"
+#include "PipelineCache.h"
+#include "ShaderModuleCache.h"
 
 rendering::Pipeline::Pipeline(rendering::Device& _device,
                               const std::string& _vertexShader,
                               const std::string& _fragmentShader,
-                              const rendering::PipelineConfigInfo& _configInfo) : device{_device} {
-    createGraphicsPipeline(_vertexShader, _fragmentShader, _configInfo);
+                              const rendering::PipelineConfigInfo& _configInfo)
+        : Pipeline(_device, _device.shaderModules().acquire(_vertexShader), _device.shaderModules().acquire(_fragmentShader),
+                   _configInfo, nullptr) {
+    // The pipeline is built, it no longer needs its modules.
+    device.shaderModules().release(vertexShaderModule);
+    device.shaderModules().release(fragmentShaderModule);
 }
 
-std::vector<char> rendering::Pipeline::readFile(const std::string &filepath) {
-    std::ifstream  file(filepath, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open()) {
-        throw std::runtime_error("failed to open file: " + filepath);
-    }
-
-    size_t fileSize = static_cast<size_t>(file.tellg());
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-
-    file.close();
-    return buffer;
+rendering::Pipeline::Pipeline(rendering::Device& _device,
+                              VkShaderModule _vertexShaderModule,
+                              VkShaderModule _fragmentShaderModule,
+                              const rendering::PipelineConfigInfo& _configInfo,
+                              const VkSpecializationInfo* specialization,
+                              VkPipelineCreateFlags flags,
+                              VkPipeline basePipeline)
+        : device{_device}, vertexShaderModule{_vertexShaderModule}, fragmentShaderModule{_fragmentShaderModule} {
+    createGraphicsPipeline(_configInfo, specialization, flags, basePipeline);
 }
 
-void rendering::Pipeline::createGraphicsPipeline(const std::string &_vertexShader,
-                                                 const std::string &_fragmentShader,
-                                                 const rendering::PipelineConfigInfo &configInfo) {
-    auto vertexCode = readFile(_vertexShader);
-    auto fragCode = readFile(_fragmentShader);
-
+void rendering::Pipeline::createGraphicsPipeline(const rendering::PipelineConfigInfo &configInfo,
+                                                 const VkSpecializationInfo *specialization,
+                                                 VkPipelineCreateFlags flags,
+                                                 VkPipeline basePipeline) {
     assert(configInfo.pipelineLayout != VK_NULL_HANDLE &&
     "Cannot create graphics pipeline:: no pipelineLayout provided in config info\n");
 
     assert(configInfo.renderPass != VK_NULL_HANDLE &&
            "Cannot create graphics pipeline:: no renderPass provided in config info\n");
 
-    createShaderModule(vertexCode, &vertexShaderModule);
-    createShaderModule(fragCode, &fragmentShaderModule);
-
     VkPipelineShaderStageCreateInfo shaderStages[2];
     shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -47,17 +42,17 @@ void rendering::Pipeline::createGraphicsPipeline(const std::string &_vertexShade
     shaderStages[0].pName = "main";
     shaderStages[0].flags = 0;
     shaderStages[0].pNext = nullptr;
-    shaderStages[0].pSpecializationInfo = nullptr;
+    shaderStages[0].pSpecializationInfo = specialization;
     shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     shaderStages[1].module = fragmentShaderModule;
     shaderStages[1].pName = "main";
     shaderStages[1].flags = 0;
     shaderStages[1].pNext = nullptr;
-    shaderStages[1].pSpecializationInfo = nullptr;
+    shaderStages[1].pSpecializationInfo = specialization;
 
-    auto bindingDescriptions = rendering::Model::Vertex::getBindingDescription();
-    auto attributeDescriptions = rendering::Model::Vertex::getAttributeDescription();
+    auto& bindingDescriptions = configInfo.bindingDescriptions;
+    auto& attributeDescriptions = configInfo.attributeDescriptions;
 
     VkPipelineVertexInputStateCreateInfo vertexInputCI{};
     vertexInputCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -84,25 +79,15 @@ void rendering::Pipeline::createGraphicsPipeline(const std::string &_vertexShade
     pipelineCI.renderPass = configInfo.renderPass;
     pipelineCI.subpass = configInfo.subpass;
 
+    pipelineCI.flags = flags;
     pipelineCI.basePipelineIndex = -1;
-    pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineCI.basePipelineHandle = basePipeline;
 
-    if (vkCreateGraphicsPipelines(device.device(), VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+    if (device.pipelineCache().createGraphicsPipelines(&pipelineCI, 1, &graphicsPipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline\n");
     }
 }
 
-void rendering::Pipeline::createShaderModule(const std::vector<char> &code, VkShaderModule *shaderModule) {
-    VkShaderModuleCreateInfo shaderModuleCI{};
-    shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shaderModuleCI.codeSize = code.size();
-    shaderModuleCI.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-    if (vkCreateShaderModule(device.device(), &shaderModuleCI, nullptr, shaderModule) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create shader module\n");
-    }
-}
-
 void rendering::Pipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo) {
     configInfo.inputAssemblyCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     configInfo.inputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -171,6 +156,36 @@ void rendering::Pipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configIn
     configInfo.dynamicStateCI.pDynamicStates = configInfo.dynamicStateEnables.data();
     configInfo.dynamicStateCI.dynamicStateCount = static_cast<uint32_t >(configInfo.dynamicStateEnables.size());
     configInfo.dynamicStateCI.flags = 0;
+
+    configInfo.bindingDescriptions = Model::Vertex::getBindingDescription();
+    configInfo.attributeDescriptions = Model::Vertex::getAttributeDescription();
+}
+
+/**
+ * Copies a config, pointing the copy's blend attachment and dynamic states at its own members
+ * where the original pointed at its own.
+ */
+void rendering::Pipeline::copyPipelineConfigInfo(const PipelineConfigInfo& from, PipelineConfigInfo& to) {
+    to.viewportCI = from.viewportCI;
+    to.inputAssemblyCI = from.inputAssemblyCI;
+    to.rasterizationCI = from.rasterizationCI;
+    to.multisampleCI = from.multisampleCI;
+    to.colorBlendAttachmentCI = from.colorBlendAttachmentCI;
+    to.colorBlendCI = from.colorBlendCI;
+    if (from.colorBlendCI.pAttachments == &from.colorBlendAttachmentCI) {
+        to.colorBlendCI.pAttachments = &to.colorBlendAttachmentCI;
+    }
+    to.depthStencilCI = from.depthStencilCI;
+    to.dynamicStateEnables = from.dynamicStateEnables;
+    to.dynamicStateCI = from.dynamicStateCI;
+    if (from.dynamicStateCI.pDynamicStates == from.dynamicStateEnables.data()) {
+        to.dynamicStateCI.pDynamicStates = to.dynamicStateEnables.data();
+    }
+    to.bindingDescriptions = from.bindingDescriptions;
+    to.attributeDescriptions = from.attributeDescriptions;
+    to.pipelineLayout = from.pipelineLayout;
+    to.renderPass = from.renderPass;
+    to.subpass = from.subpass;
 }
 
 void rendering::Pipeline::bind(VkCommandBuffer commandBuffer) {
@@ -178,7 +193,5 @@ void rendering::Pipeline::bind(VkCommandBuffer commandBuffer) {
 }
 
 rendering::Pipeline::~Pipeline() {
-    vkDestroyShaderModule(device.device(), vertexShaderModule, nullptr);
-    vkDestroyShaderModule(device.device(), fragmentShaderModule, nullptr);
     vkDestroyPipeline(device.device(), graphicsPipeline, nullptr);
 }
@@ -30,33 +30,47 @@ namespace rendering{
         std::vector<VkDynamicState> dynamicStateEnables;
         VkPipelineDynamicStateCreateInfo dynamicStateCI;
 
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+
         VkPipelineLayout pipelineLayout = nullptr;
         VkRenderPass renderPass = nullptr;
         uint32_t subpass = 0;
     };
 
+    // Shader modules come from the Device's ShaderModuleCache and are shared with other pipelines,
+    // they only have to stay acquired while the constructor runs.
+    // Pipelines of the same shaders and different state should come from the PipelineRegistry.
     class Pipeline {
     public:
         Pipeline(rendering::Device& _device,
                  const std::string& _vertexShader,
                  const std::string &_fragmentShader,
                  const rendering::PipelineConfigInfo& _configInfo);
+        // specialization applies to both stages, flags and basePipeline are for pipeline derivatives.
+        Pipeline(rendering::Device& _device,
+                 VkShaderModule _vertexShaderModule,
+                 VkShaderModule _fragmentShaderModule,
+                 const rendering::PipelineConfigInfo& _configInfo,
+                 const VkSpecializationInfo* specialization,
+                 VkPipelineCreateFlags flags = 0,
+                 VkPipeline basePipeline = VK_NULL_HANDLE);
         ~Pipeline();
 
         Pipeline(const Pipeline&) = delete;
         Pipeline operator = (const Pipeline&) = delete;
 
         static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
+        static void copyPipelineConfigInfo(const PipelineConfigInfo& from, PipelineConfigInfo& to);
         void bind(VkCommandBuffer commandBuffer);
 
+        [[nodiscard]] VkPipeline getPipeline() const { return graphicsPipeline; }
 
     private:
-        static std::vector<char> readFile(const std::string& filepath);
-        void createGraphicsPipeline(const std::string& _vertexShader,
-                                    const std::string& _fragmentShader,
-                                    const rendering::PipelineConfigInfo& configInfo);
-
-        void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
+        void createGraphicsPipeline(const rendering::PipelineConfigInfo& configInfo,
+                                    const VkSpecializationInfo* specialization,
+                                    VkPipelineCreateFlags flags,
+                                    VkPipeline basePipeline);
 
         Device &device;
         VkPipeline graphicsPipeline;
@@ -0,0 +1,192 @@
+
+#include "PipelineCache.h"
+#include "Device.hpp"
+#include "renderingutility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace rendering {
+
+    namespace {
+        constexpr char MAGIC[4] = {'V', 'L', 'P', 'C'};
+
+        // Precedes the driver's data, which some drivers do not check before trusting it.
+        struct FileHeader {
+            char magic[4];
+            uint32_t version;
+            uint64_t dataSize;
+            uint64_t dataHash;
+        };
+
+        // VkPipelineCacheHeaderVersionOne, which every driver's data starts with.
+        struct DriverHeader {
+            uint32_t headerSize;
+            uint32_t headerVersion;
+            uint32_t vendorID;
+            uint32_t deviceID;
+            uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        };
+    }
+
+    PipelineCache::PipelineCache(Device &_device) : device{_device} {
+        std::vector<char> data{};
+        stats.warm = load(data);
+        if (!stats.warm) {
+            data.clear();
+        }
+        stats.loadedBytes = data.size();
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = data.size();
+        cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+        if (vkCreatePipelineCache(device.device(), &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+
+    PipelineCache::~PipelineCache() {
+        save();
+        vkDestroyPipelineCache(device.device(), cache, nullptr);
+    }
+
+    void PipelineCache::setDirectory(const std::string &_directory) {
+        directory = _directory;
+    }
+
+    std::string PipelineCache::cachePath() {
+        return (fs::path(directory) / "pipelines.bin").string();
+    }
+
+/**
+ * Creates graphics pipelines through the cache and records how long the driver took.
+ *
+ * @return VkResult of the vkCreateGraphicsPipelines call
+ */
+    VkResult PipelineCache::createGraphicsPipelines(const VkGraphicsPipelineCreateInfo *createInfos, uint32_t count,
+                                                    VkPipeline *pipelines) {
+        auto start = std::chrono::steady_clock::now();
+        VkResult result;
+        {
+            std::shared_lock<std::shared_mutex> lock{cacheMutex};
+            result = vkCreateGraphicsPipelines(device.device(), cache, count, createInfos, nullptr, pipelines);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock{statsMutex};
+        stats.pipelines += count;
+        stats.creationMs += ms;
+        stats.slowestMs = std::max(stats.slowestMs, ms);
+        return result;
+    }
+
+/**
+ * Writes the cache to disk under a temporary name and renames it into place, so a crash while
+ * saving leaves the previous file intact. Failures are reported but not fatal, the next launch
+ * just starts cold.
+ *
+ * @return Whether the file was written
+ */
+    bool PipelineCache::save() {
+        std::string temporary{};
+        try {
+            std::vector<char> data{};
+            {
+                std::unique_lock<std::shared_mutex> lock{cacheMutex};
+                size_t size = 0;
+                if (vkGetPipelineCacheData(device.device(), cache, &size, nullptr) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to get pipeline cache size");
+                }
+                data.resize(size);
+                if (size > 0 && vkGetPipelineCacheData(device.device(), cache, &size, data.data()) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to get pipeline cache data");
+                }
+                data.resize(size);
+            }
+            if (data.empty()) {
+                return false;
+            }
+
+            FileHeader header{};
+            memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.dataSize = data.size();
+            header.dataHash = hashBytes(data.data(), data.size());
+
+            fs::create_directories(directory);
+            std::string path = cachePath();
+            temporary = path + ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+            {
+                std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+                if (!file.is_open()) {
+                    throw std::runtime_error("failed to open " + temporary);
+                }
+                file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                file.write(data.data(), static_cast<std::streamsize>(data.size()));
+                if (!file) {
+                    throw std::runtime_error("failed to write " + temporary);
+                }
+            }
+            fs::rename(temporary, path);
+            return true;
+        }
+        catch (const std::exception &e) {
+            std::cerr << "pipeline cache: could not save: " << e.what() << '\n';
+            std::error_code error;
+            if (!temporary.empty()) {
+                fs::remove(temporary, error);
+            }
+            return false;
+        }
+    }
+
+    PipelineCache::Stats PipelineCache::getStats() {
+        std::lock_guard<std::mutex> lock{statsMutex};
+        return stats;
+    }
+
+    // Reads the driver's data from the file, only if it is intact and was written by this device and driver.
+    bool PipelineCache::load(std::vector<char> &data) {
+        std::ifstream file(cachePath(), std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::streamoff fileSize = file.tellg();
+        file.seekg(0);
+        FileHeader header{};
+        if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+            memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            header.dataSize < sizeof(DriverHeader)) {
+            return false;
+        }
+        // a truncated or forged size must not drive the allocation
+        if (fileSize < static_cast<std::streamoff>(sizeof(header)) ||
+            header.dataSize != static_cast<uint64_t>(fileSize) - sizeof(header)) {
+            std::cerr << "pipeline cache: ignoring a file of the wrong size\n";
+            return false;
+        }
+        data.resize(header.dataSize);
+        if (!file.read(data.data(), static_cast<std::streamsize>(data.size())) ||
+            hashBytes(data.data(), data.size()) != header.dataHash) {
+            std::cerr << "pipeline cache: ignoring a corrupt file\n";
+            return false;
+        }
+
+        DriverHeader driver{};
+        memcpy(&driver, data.data(), sizeof(driver));
+        const VkPhysicalDeviceProperties &properties = device.properties;
+        return driver.headerSize >= sizeof(DriverHeader) &&
+               driver.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               driver.vendorID == properties.vendorID &&
+               driver.deviceID == properties.deviceID &&
+               memcmp(driver.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+}
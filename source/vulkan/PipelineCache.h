@@ -0,0 +1,63 @@
+#ifndef VULKANLEARN_PIPELINECACHE_H
+#define VULKANLEARN_PIPELINECACHE_H
+
+#include "VulkanCommon.h"
+
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace rendering {
+    class Device;
+
+    // The VkPipelineCache every Pipeline is created with, loaded from disk when the Device starts and
+    // written back when it shuts down, so only the first launch pays the driver's full shader
+    // compile. A file is only used when it was written for the same vendor, device and driver cache
+    // UUID and its contents hash matches. Thread safe, PipelineCompiler's workers all create their
+    // pipelines through the one cache.
+    class PipelineCache {
+    public:
+        static constexpr uint32_t VERSION = 1;
+
+        struct Stats {
+            bool warm = false; // started from a valid file
+            size_t loadedBytes = 0;
+            uint32_t pipelines = 0;
+            double creationMs = 0.0;
+            double slowestMs = 0.0;
+        };
+
+        explicit PipelineCache(Device& _device);
+        ~PipelineCache();
+
+        PipelineCache(const PipelineCache&) = delete;
+        PipelineCache &operator = (const PipelineCache&) = delete;
+
+        static void setDirectory(const std::string& directory);
+        static const std::string& getDirectory() { return directory; }
+
+        VkResult createGraphicsPipelines(const VkGraphicsPipelineCreateInfo* createInfos, uint32_t count,
+                                         VkPipeline* pipelines);
+        bool save();
+
+        [[nodiscard]] VkPipelineCache getCache() const { return cache; }
+        [[nodiscard]] Stats getStats();
+
+    private:
+        bool load(std::vector<char>& data);
+        static std::string cachePath();
+
+        Device& device;
+        VkPipelineCache cache = VK_NULL_HANDLE;
+        // Pipelines are created under a shared lock, the driver synchronizes the cache internally.
+        // save() takes it exclusively so the size and the data it reads agree.
+        std::shared_mutex cacheMutex;
+        std::mutex statsMutex;
+        Stats stats{};
+
+        static inline std::string directory = "../cache";
+    };
+}
+
+#endif //VULKANLEARN_PIPELINECACHE_H
@@ -0,0 +1,188 @@
+
+#include "PipelineCompiler.h"
+#include "Device.hpp"
+#include "PipelineRegistry.h"
+#include "ShaderModuleCache.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace rendering {
+
+    PipelineCompiler::PipelineCompiler(Device &_device, uint32_t workerCount) : device(_device) {
+        // Drivers compile a pipeline on the calling thread, a quarter of the cores keeps the
+        // render thread and the ModelStreamer workers running while a burst of variants compiles.
+        if (workerCount == 0) {
+            workerCount = std::max(1u, std::thread::hardware_concurrency() / 4);
+        }
+        for (uint32_t i = 0; i < workerCount; i++) {
+            workers.emplace_back(&PipelineCompiler::work, this);
+        }
+    }
+
+    // Requests still queued are dropped, they keep returning their fallback.
+    PipelineCompiler::~PipelineCompiler() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker: workers) {
+            worker.join();
+        }
+        for (auto &request: queued) {
+            release(*request);
+        }
+    }
+
+/**
+ * Queues a pipeline of shader files for compilation and returns immediately. The files are read
+ * by the worker.
+ *
+ * @param configInfo State of the pipeline, copied
+ * @param specialization (Optional) Specialization constants of both stages, copied
+ * @param fallback (Optional) Pipeline to draw with until this one is ready, must stay alive as long
+ * as the request is used
+ *
+ * @return Handle that becomes ready once the pipeline is compiled
+ */
+    PipelineCompiler::Handle PipelineCompiler::request(const std::string &vertexShader, const std::string &fragmentShader,
+                                                       const PipelineConfigInfo &configInfo,
+                                                       const VkSpecializationInfo *specialization, Pipeline *fallback) {
+        Handle request = prepare(configInfo, specialization, fallback);
+        request->vertexPath = vertexShader;
+        request->fragmentPath = fragmentShader;
+        enqueue(request);
+        return request;
+    }
+
+    // A state the registry already has is ready before this returns. Otherwise the modules are
+    // retained until the pipeline is built, the caller may release them right away.
+    PipelineCompiler::Handle PipelineCompiler::request(VkShaderModule vertexShader, VkShaderModule fragmentShader,
+                                                       const PipelineConfigInfo &configInfo,
+                                                       const VkSpecializationInfo *specialization, Pipeline *fallback) {
+        Handle request = prepare(configInfo, specialization, fallback);
+        request->vertexShader = vertexShader;
+        request->fragmentShader = fragmentShader;
+        if (Pipeline *pipeline = device.pipelines().find(vertexShader, fragmentShader, configInfo, specialization)) {
+            request->pipeline = pipeline;
+            request->state.store(State::Ready, std::memory_order_release);
+            std::lock_guard<std::mutex> lock{mutex};
+            stats.immediate++;
+            return request;
+        }
+        device.shaderModules().retain(vertexShader);
+        device.shaderModules().retain(fragmentShader);
+        enqueue(request);
+        return request;
+    }
+
+/**
+ * Blocks until every queued request is compiled, for loading screens and shutdown.
+ */
+    void PipelineCompiler::waitIdle() {
+        std::unique_lock<std::mutex> lock{mutex};
+        idle.wait(lock, [this] { return queued.empty() && stats.compiling == 0; });
+    }
+
+    PipelineCompiler::Stats PipelineCompiler::getStats() {
+        std::lock_guard<std::mutex> lock{mutex};
+        Stats result = stats;
+        result.queueDepth = static_cast<uint32_t>(queued.size());
+        return result;
+    }
+
+    PipelineCompiler::Handle PipelineCompiler::prepare(const PipelineConfigInfo &configInfo,
+                                                       const VkSpecializationInfo *specialization, Pipeline *fallback) {
+        auto request = std::make_shared<Request>();
+        Pipeline::copyPipelineConfigInfo(configInfo, request->configInfo);
+        if (specialization != nullptr) {
+            request->specialized = true;
+            request->specializationEntries.assign(specialization->pMapEntries,
+                                                  specialization->pMapEntries + specialization->mapEntryCount);
+            const auto *data = static_cast<const char *>(specialization->pData);
+            request->specializationData.assign(data, data + specialization->dataSize);
+        }
+        request->fallback = fallback;
+        request->requested = std::chrono::steady_clock::now();
+        return request;
+    }
+
+    void PipelineCompiler::enqueue(Handle request) {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            queued.push_back(std::move(request));
+        }
+        wake.notify_one();
+    }
+
+    void PipelineCompiler::work() {
+        for (;;) {
+            Handle request{};
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                wake.wait(lock, [this] { return stopping || !queued.empty(); });
+                if (stopping) {
+                    return;
+                }
+                request = std::move(queued.front());
+                queued.pop_front();
+                stats.compiling++;
+            }
+
+            request->state.store(State::Compiling, std::memory_order_release);
+            bool compiled = true;
+            try {
+                compile(*request);
+            }
+            catch (const std::exception &e) {
+                std::cerr << "failed to compile pipeline: " << e.what() << '\n';
+                compiled = false;
+            }
+            release(*request);
+            double latency = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - request->requested).count();
+            request->state.store(compiled ? State::Ready : State::Failed, std::memory_order_release);
+
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                stats.compiling--;
+                if (compiled) {
+                    stats.compiled++;
+                    stats.totalLatencyMs += latency;
+                    stats.maxLatencyMs = std::max(stats.maxLatencyMs, latency);
+                }
+                else {
+                    stats.failed++;
+                }
+            }
+            idle.notify_all();
+        }
+    }
+
+    void PipelineCompiler::compile(Request &request) {
+        if (request.vertexShader == VK_NULL_HANDLE) {
+            request.vertexShader = device.shaderModules().acquire(request.vertexPath);
+            request.fragmentShader = device.shaderModules().acquire(request.fragmentPath);
+        }
+        VkSpecializationInfo specialization{};
+        specialization.mapEntryCount = static_cast<uint32_t>(request.specializationEntries.size());
+        specialization.pMapEntries = request.specializationEntries.data();
+        specialization.dataSize = request.specializationData.size();
+        specialization.pData = request.specializationData.data();
+        request.pipeline = &device.pipelines().get(request.vertexShader, request.fragmentShader, request.configInfo,
+                                                   request.specialized ? &specialization : nullptr);
+    }
+
+    // Drops the references the request holds, the modules it was given or loaded.
+    void PipelineCompiler::release(Request &request) {
+        if (request.vertexShader != VK_NULL_HANDLE) {
+            device.shaderModules().release(request.vertexShader);
+        }
+        if (request.fragmentShader != VK_NULL_HANDLE) {
+            device.shaderModules().release(request.fragmentShader);
+        }
+        request.vertexShader = VK_NULL_HANDLE;
+        request.fragmentShader = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef VULKANLEARN_PIPELINECOMPILER_H
+#define VULKANLEARN_PIPELINECOMPILER_H
+
+#include "VulkanCommon.h"
+#include "Pipeline.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rendering {
+    class Device;
+
+    // Compiles pipelines in the background so a new variant never stalls a frame. request() returns
+    // right away; a state the PipelineRegistry already has is ready at once, any other is compiled
+    // through the registry by a pool of worker threads, which share the Device's PipelineCache.
+    // Until then Request::getPipeline() returns the fallback the caller passed, for example the
+    // default lit pipeline of the same vertex layout. The Device owns it. Thread safe.
+    class PipelineCompiler {
+    public:
+        enum class State {
+            Queued,
+            Compiling,
+            Ready,
+            Failed, // keeps returning the fallback
+        };
+
+        struct Stats {
+            uint32_t queueDepth = 0;
+            uint32_t compiling = 0;
+            uint32_t compiled = 0;
+            uint32_t immediate = 0; // requests the registry already had
+            uint32_t failed = 0;
+            double totalLatencyMs = 0.0; // from request() to ready, of compiled requests
+            double maxLatencyMs = 0.0;
+        };
+
+        // Returned by request() right away and shared between the caller and the compiler.
+        class Request {
+        public:
+            [[nodiscard]] State getState() const { return state.load(std::memory_order_acquire); }
+            [[nodiscard]] bool isReady() const { return getState() == State::Ready; }
+            // The compiled pipeline once ready, the fallback until then, which may be null.
+            [[nodiscard]] Pipeline* getPipeline() const { return isReady() ? pipeline : fallback; }
+
+        private:
+            friend class PipelineCompiler;
+
+            std::string vertexPath{};
+            std::string fragmentPath{};
+            VkShaderModule vertexShader = VK_NULL_HANDLE;
+            VkShaderModule fragmentShader = VK_NULL_HANDLE;
+            PipelineConfigInfo configInfo{};
+            bool specialized = false;
+            std::vector<VkSpecializationMapEntry> specializationEntries{};
+            std::vector<char> specializationData{};
+            Pipeline* fallback = nullptr;
+            Pipeline* pipeline = nullptr;
+            std::atomic<State> state{State::Queued};
+            std::chrono::steady_clock::time_point requested{};
+        };
+
+        using Handle = std::shared_ptr<Request>;
+
+        explicit PipelineCompiler(Device& _device, uint32_t workerCount = 0);
+        ~PipelineCompiler();
+
+        PipelineCompiler(const PipelineCompiler&) = delete;
+        PipelineCompiler &operator = (const PipelineCompiler&) = delete;
+
+        Handle request(const std::string& vertexShader, const std::string& fragmentShader,
+                       const PipelineConfigInfo& configInfo, const VkSpecializationInfo* specialization = nullptr,
+                       Pipeline* fallback = nullptr);
+        Handle request(VkShaderModule vertexShader, VkShaderModule fragmentShader,
+                       const PipelineConfigInfo& configInfo, const VkSpecializationInfo* specialization = nullptr,
+                       Pipeline* fallback = nullptr);
+        void waitIdle();
+
+        [[nodiscard]] Stats getStats();
+
+    private:
+        Handle prepare(const PipelineConfigInfo& configInfo, const VkSpecializationInfo* specialization,
+                       Pipeline* fallback);
+        void enqueue(Handle request);
+        void work();
+        void compile(Request& request);
+        void release(Request& request);
+
+        Device& device;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        std::deque<Handle> queued{};
+        bool stopping = false;
+        std::vector<std::thread> workers{};
+        Stats stats{};
+    };
+}
+
+#endif //VULKANLEARN_PIPELINECOMPILER_H
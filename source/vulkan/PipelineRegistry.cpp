@@ -0,0 +1,249 @@
+
+#include "PipelineRegistry.h"
+#include "Device.hpp"
+#include "ShaderModuleCache.h"
+#include "renderingutility.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace rendering {
+
+    namespace {
+        constexpr uint32_t VENDOR_AMD = 0x1002;
+        constexpr uint32_t VENDOR_NVIDIA = 0x10DE;
+        constexpr uint32_t VENDOR_INTEL = 0x8086;
+
+        uint64_t bits(float value) {
+            uint32_t result;
+            memcpy(&result, &value, sizeof(result));
+            return result;
+        }
+
+        uint64_t handle(const void *object) {
+            return reinterpret_cast<uint64_t>(object);
+        }
+
+        void appendStencil(std::vector<uint64_t> &key, const VkStencilOpState &state) {
+            key.insert(key.end(), {static_cast<uint64_t>(state.failOp), static_cast<uint64_t>(state.passOp),
+                                   static_cast<uint64_t>(state.depthFailOp), static_cast<uint64_t>(state.compareOp),
+                                   state.compareMask, state.writeMask, state.reference});
+        }
+    }
+
+    // Desktop drivers document that they ignore derivatives, there allowing them would only cost.
+    PipelineRegistry::PipelineRegistry(Device &_device) : device{_device} {
+        uint32_t vendor = device.properties.vendorID;
+        derivatives = vendor != VENDOR_AMD && vendor != VENDOR_NVIDIA && vendor != VENDOR_INTEL;
+    }
+
+    Pipeline &PipelineRegistry::get(const std::string &vertexShader, const std::string &fragmentShader,
+                                    const PipelineConfigInfo &configInfo, const VkSpecializationInfo *specialization) {
+        ShaderModuleCache &shaderModules = device.shaderModules();
+        VkShaderModule vertexModule = shaderModules.acquire(vertexShader);
+        VkShaderModule fragmentModule = VK_NULL_HANDLE;
+        try {
+            fragmentModule = shaderModules.acquire(fragmentShader);
+            Pipeline &pipeline = get(vertexModule, fragmentModule, configInfo, specialization);
+            shaderModules.release(vertexModule);
+            shaderModules.release(fragmentModule);
+            return pipeline;
+        }
+        catch (...) {
+            shaderModules.release(vertexModule);
+            if (fragmentModule != VK_NULL_HANDLE) {
+                shaderModules.release(fragmentModule);
+            }
+            throw;
+        }
+    }
+
+/**
+ * Returns the pipeline of this state, creating it the first time the state is asked for. Both
+ * modules must be acquired from the Device's ShaderModuleCache.
+ */
+    Pipeline &PipelineRegistry::get(VkShaderModule vertexShader, VkShaderModule fragmentShader,
+                                    const PipelineConfigInfo &configInfo, const VkSpecializationInfo *specialization) {
+        std::vector<uint64_t> key = stateKey(device.shaderModules().codeHash(vertexShader),
+                                             device.shaderModules().codeHash(fragmentShader), configInfo, specialization);
+        std::vector<uint64_t> family{key.begin(), key.begin() + FAMILY_SIZE};
+        VkPipelineCreateFlags flags = 0;
+        VkPipeline base = VK_NULL_HANDLE;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            auto cached = pipelines.find(key);
+            if (cached != pipelines.end()) {
+                stats.hits++;
+                return *cached->second;
+            }
+            if (derivatives) {
+                auto found = familyBases.find(family);
+                if (found != familyBases.end()) {
+                    flags = VK_PIPELINE_CREATE_DERIVATIVE_BIT;
+                    base = found->second;
+                }
+                else {
+                    flags = VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT;
+                }
+            }
+        }
+
+        auto pipeline = std::make_unique<Pipeline>(device, vertexShader, fragmentShader, configInfo, specialization,
+                                                   flags, base);
+
+        std::lock_guard<std::mutex> lock{mutex};
+        auto inserted = pipelines.emplace(std::move(key), std::move(pipeline));
+        if (!inserted.second) {
+            return *inserted.first->second; // another thread created it first, ours is destroyed
+        }
+        Pipeline &result = *inserted.first->second;
+        if (flags & VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT) {
+            familyBases.emplace(std::move(family), result.getPipeline());
+        }
+        if (flags & VK_PIPELINE_CREATE_DERIVATIVE_BIT) {
+            stats.derived++;
+        }
+        stats.pipelines++;
+        return result;
+    }
+
+/**
+ * Returns the pipeline of this state if it was created before, never compiles.
+ */
+    Pipeline *PipelineRegistry::find(VkShaderModule vertexShader, VkShaderModule fragmentShader,
+                                     const PipelineConfigInfo &configInfo, const VkSpecializationInfo *specialization) {
+        std::vector<uint64_t> key = stateKey(device.shaderModules().codeHash(vertexShader),
+                                             device.shaderModules().codeHash(fragmentShader), configInfo, specialization);
+        std::lock_guard<std::mutex> lock{mutex};
+        auto cached = pipelines.find(key);
+        if (cached == pipelines.end()) {
+            return nullptr;
+        }
+        stats.hits++;
+        return cached->second.get();
+    }
+
+/**
+ * Destroys every pipeline created with a layout about to be destroyed, so a later layout that gets
+ * the same handle cannot be handed one of them. The GPU must be done with them.
+ */
+    void PipelineRegistry::releaseLayout(VkPipelineLayout pipelineLayout) {
+        std::lock_guard<std::mutex> lock{mutex};
+        for (auto it = pipelines.begin(); it != pipelines.end();) {
+            it = it->first[2] == handle(pipelineLayout) ? pipelines.erase(it) : std::next(it);
+        }
+        for (auto it = familyBases.begin(); it != familyBases.end();) {
+            it = it->first[2] == handle(pipelineLayout) ? familyBases.erase(it) : std::next(it);
+        }
+        stats.pipelines = static_cast<uint32_t>(pipelines.size());
+    }
+
+    PipelineRegistry::Stats PipelineRegistry::getStats() {
+        std::lock_guard<std::mutex> lock{mutex};
+        return stats;
+    }
+
+/**
+ * Everything that makes two pipelines differ. Starts with the FAMILY_SIZE values a family shares:
+ * shader code, pipeline layout, render pass and subpass. Shaders are identified by
+ * ShaderModuleCache::codeHash() rather than their module, which is destroyed once its pipelines are
+ * built and whose handle a later module may get.
+ */
+    std::vector<uint64_t> PipelineRegistry::stateKey(uint64_t vertexCode, uint64_t fragmentCode,
+                                                     const PipelineConfigInfo &configInfo,
+                                                     const VkSpecializationInfo *specialization) {
+        std::vector<uint64_t> key{vertexCode, fragmentCode, handle(configInfo.pipelineLayout),
+                                  handle(configInfo.renderPass), configInfo.subpass};
+        key.reserve(128);
+
+        key.push_back(specialization != nullptr ? specialization->mapEntryCount : ~0ull);
+        if (specialization != nullptr) {
+            for (uint32_t i = 0; i < specialization->mapEntryCount; i++) {
+                const VkSpecializationMapEntry &entry = specialization->pMapEntries[i];
+                key.insert(key.end(), {entry.constantID, entry.offset, entry.size});
+            }
+            key.push_back(specialization->dataSize);
+            const auto *data = static_cast<const char *>(specialization->pData);
+            for (size_t offset = 0; offset < specialization->dataSize; offset += sizeof(uint64_t)) {
+                uint64_t word = 0;
+                memcpy(&word, data + offset, std::min(sizeof(uint64_t), specialization->dataSize - offset));
+                key.push_back(word);
+            }
+        }
+
+        key.push_back(configInfo.bindingDescriptions.size());
+        for (const auto &binding: configInfo.bindingDescriptions) {
+            key.insert(key.end(), {binding.binding, binding.stride, static_cast<uint64_t>(binding.inputRate)});
+        }
+        key.push_back(configInfo.attributeDescriptions.size());
+        for (const auto &attribute: configInfo.attributeDescriptions) {
+            key.insert(key.end(), {attribute.location, attribute.binding, static_cast<uint64_t>(attribute.format),
+                                   attribute.offset});
+        }
+
+        const auto &inputAssembly = configInfo.inputAssemblyCI;
+        key.insert(key.end(), {static_cast<uint64_t>(inputAssembly.topology), inputAssembly.primitiveRestartEnable});
+
+        // Viewports and scissors are dynamic state by default, only their count is part of the pipeline.
+        const auto &viewport = configInfo.viewportCI;
+        key.insert(key.end(), {viewport.viewportCount, viewport.scissorCount});
+        if (viewport.pViewports != nullptr) {
+            for (uint32_t i = 0; i < viewport.viewportCount; i++) {
+                const VkViewport &v = viewport.pViewports[i];
+                key.insert(key.end(), {bits(v.x), bits(v.y), bits(v.width), bits(v.height),
+                                       bits(v.minDepth), bits(v.maxDepth)});
+            }
+        }
+        if (viewport.pScissors != nullptr) {
+            for (uint32_t i = 0; i < viewport.scissorCount; i++) {
+                const VkRect2D &s = viewport.pScissors[i];
+                key.insert(key.end(), {static_cast<uint64_t>(s.offset.x), static_cast<uint64_t>(s.offset.y),
+                                       s.extent.width, s.extent.height});
+            }
+        }
+
+        const auto &rasterization = configInfo.rasterizationCI;
+        key.insert(key.end(), {rasterization.depthClampEnable, rasterization.rasterizerDiscardEnable,
+                               static_cast<uint64_t>(rasterization.polygonMode), rasterization.cullMode,
+                               static_cast<uint64_t>(rasterization.frontFace), rasterization.depthBiasEnable,
+                               bits(rasterization.depthBiasConstantFactor), bits(rasterization.depthBiasClamp),
+                               bits(rasterization.depthBiasSlopeFactor), bits(rasterization.lineWidth)});
+
+        const auto &multisample = configInfo.multisampleCI;
+        key.insert(key.end(), {static_cast<uint64_t>(multisample.rasterizationSamples), multisample.sampleShadingEnable,
+                               bits(multisample.minSampleShading), multisample.alphaToCoverageEnable,
+                               multisample.alphaToOneEnable,
+                               multisample.pSampleMask != nullptr ? *multisample.pSampleMask : ~0ull});
+
+        const auto &colorBlend = configInfo.colorBlendCI;
+        key.insert(key.end(), {colorBlend.logicOpEnable, static_cast<uint64_t>(colorBlend.logicOp),
+                               colorBlend.attachmentCount, bits(colorBlend.blendConstants[0]),
+                               bits(colorBlend.blendConstants[1]), bits(colorBlend.blendConstants[2]),
+                               bits(colorBlend.blendConstants[3])});
+        for (uint32_t i = 0; i < colorBlend.attachmentCount; i++) {
+            const VkPipelineColorBlendAttachmentState &a = colorBlend.pAttachments[i];
+            key.insert(key.end(), {a.blendEnable, static_cast<uint64_t>(a.srcColorBlendFactor),
+                                   static_cast<uint64_t>(a.dstColorBlendFactor), static_cast<uint64_t>(a.colorBlendOp),
+                                   static_cast<uint64_t>(a.srcAlphaBlendFactor), static_cast<uint64_t>(a.dstAlphaBlendFactor),
+                                   static_cast<uint64_t>(a.alphaBlendOp), a.colorWriteMask});
+        }
+
+        const auto &depthStencil = configInfo.depthStencilCI;
+        key.insert(key.end(), {depthStencil.depthTestEnable, depthStencil.depthWriteEnable,
+                               static_cast<uint64_t>(depthStencil.depthCompareOp), depthStencil.depthBoundsTestEnable,
+                               depthStencil.stencilTestEnable, bits(depthStencil.minDepthBounds),
+                               bits(depthStencil.maxDepthBounds)});
+        appendStencil(key, depthStencil.front);
+        appendStencil(key, depthStencil.back);
+
+        key.push_back(configInfo.dynamicStateEnables.size());
+        for (VkDynamicState state: configInfo.dynamicStateEnables) {
+            key.push_back(static_cast<uint64_t>(state));
+        }
+        return key;
+    }
+
+    size_t PipelineRegistry::KeyHash::operator()(const std::vector<uint64_t> &key) const {
+        return hashBytes(key.data(), key.size() * sizeof(uint64_t));
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef VULKANLEARN_PIPELINEREGISTRY_H
+#define VULKANLEARN_PIPELINEREGISTRY_H
+
+#include "VulkanCommon.h"
+#include "Pipeline.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rendering {
+    class Device;
+
+    // Every graphics pipeline variant, keyed on its full state: shader code, specialization
+    // constants, each fixed function state of the PipelineConfigInfo, the vertex layout, pipeline
+    // layout, render pass and subpass. Asking for a state that was built before returns the same
+    // Pipeline. Variants of the same shaders, layout and render pass form a family; where
+    // derivatives help the driver, the first of a family allows them and the others derive from
+    // it. Pipelines live until the registry is destroyed or their layout is released. The Device
+    // owns it. Thread safe, pipelines are created outside the lock so threads compile in parallel.
+    // Threads racing to create the same state keep the first result.
+    class PipelineRegistry {
+    public:
+        struct Stats {
+            uint32_t pipelines = 0;
+            uint32_t hits = 0;
+            uint32_t derived = 0;
+        };
+
+        explicit PipelineRegistry(Device& _device);
+
+        PipelineRegistry(const PipelineRegistry&) = delete;
+        PipelineRegistry &operator = (const PipelineRegistry&) = delete;
+
+        Pipeline& get(const std::string& vertexShader, const std::string& fragmentShader,
+                      const PipelineConfigInfo& configInfo, const VkSpecializationInfo* specialization = nullptr);
+        Pipeline& get(VkShaderModule vertexShader, VkShaderModule fragmentShader,
+                      const PipelineConfigInfo& configInfo, const VkSpecializationInfo* specialization = nullptr);
+        Pipeline* find(VkShaderModule vertexShader, VkShaderModule fragmentShader,
+                       const PipelineConfigInfo& configInfo, const VkSpecializationInfo* specialization = nullptr);
+        void releaseLayout(VkPipelineLayout pipelineLayout);
+
+        [[nodiscard]] bool usesDerivatives() const { return derivatives; }
+        [[nodiscard]] Stats getStats();
+
+        static std::vector<uint64_t> stateKey(uint64_t vertexCode, uint64_t fragmentCode,
+                                              const PipelineConfigInfo& configInfo,
+                                              const VkSpecializationInfo* specialization);
+
+    private:
+        struct KeyHash {
+            size_t operator()(const std::vector<uint64_t>& key) const;
+        };
+
+        // Where the stateKey() keeps what a family shares.
+        static constexpr size_t FAMILY_SIZE = 5;
+
+        Device& device;
+        bool derivatives;
+        std::mutex mutex;
+        std::unordered_map<std::vector<uint64_t>, std::unique_ptr<Pipeline>, KeyHash> pipelines{};
+        std::unordered_map<std::vector<uint64_t>, VkPipeline, KeyHash> familyBases{};
+        Stats stats{};
+    };
+}
+
+#endif //VULKANLEARN_PIPELINEREGISTRY_H
@@ -1,5 +1,11 @@
 
 #include "RenderSystem.h"
+#include "BindlessTable.h"
+#include "GeometryArena.h"
+#include "PipelineRegistry.h"
+#include "ShaderModuleCache.h"
+
+#include <algorithm>
 
 struct pushConstantsData {
     glm::mat4 modelMatrix{1.0f};
@@ -7,17 +13,23 @@ struct pushConstantsData {
 };
 
 rendering::RenderSystem::RenderSystem(
-        rendering::Device& _device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) : device(_device)  {
+        rendering::Device& _device, VkRenderPass _renderPass, VkDescriptorSetLayout globalSetLayout)
+        : device(_device), renderPass(_renderPass)  {
     createPipelineLayout(globalSetLayout);
-    createPipeline(renderPass);
+    createPipeline();
 }
 
 rendering::RenderSystem::~RenderSystem() {
+    // Permutations may still be compiling with the layout.
+    device.pipelineCompiler().waitIdle();
+    device.pipelines().releaseLayout(pipelineLayout);
+    device.shaderModules().release(vertexShader);
+    device.shaderModules().release(fragmentShader);
     vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
 }
 
 void rendering::RenderSystem::renderObjects(FrameInfo& frameInfo) {
-    pipeline->bind(frameInfo.commandBuffer);
+    Pipeline* boundPipeline = nullptr;
 
     vkCmdBindDescriptorSets(
             frameInfo.commandBuffer,
@@ -26,17 +38,59 @@ void rendering::RenderSystem::renderObjects(FrameInfo& frameInfo) {
             0,
             1,
             &frameInfo.globalDescriptorSet,
-            0,
-            nullptr
+            1,
+            &frameInfo.globalUboOffset
             );
+    // Resources in the table are indexed by slot, so it is bound once for every draw of the frame.
+    if (BindlessTable* bindless = device.bindless()) {
+        bindless->bind(frameInfo.commandBuffer, pipelineLayout, BINDLESS_SET);
+    }
+
+    // Every model lives in the arena, so geometry is bound once per frame. 16 and 32 bit indices share
+    // one index buffer, only a change of index type needs a new bind.
+    GeometryArena& arena = device.geometryArena();
+    arena.bindVertexBuffer(frameInfo.commandBuffer);
+    bool indicesBound = false;
+    VkIndexType boundIndexType = VK_INDEX_TYPE_UINT32;
 
+    drawnTriangles = 0;
+    drawnMeshlets = 0;
+    culledMeshlets = 0;
     for (auto& kvPair : frameInfo.objects) {
         auto& object = kvPair.second;
+        // Models whose pipeline is still compiling are skipped rather than stalling the frame.
+        Pipeline* objectPipeline = pipelineFor(object.model->getVertexFormat());
+        if (objectPipeline == nullptr) {
+            continue;
+        }
+        glm::mat4 modelMatrix = object.transform.mat4();
+
+        const auto& lods = object.model->getLods();
+        float pixelsPerUnit = lodPixelsPerUnit(frameInfo.camera, frameInfo.extent, object.transform,
+                                               object.model->getBoundsMin(), object.model->getBoundsMax());
+        object.lod = selectLod(lods, object.lod, pixelsPerUnit);
+
+        const auto& meshlets = object.model->getMeshlets();
+        if (meshlets.size() > 0) {
+            uint32_t visible = cullMeshlets(meshlets, object.lod, clusterView(frameInfo.camera, modelMatrix, coneCulling),
+                                            visibleRanges);
+            drawnMeshlets += visible;
+            culledMeshlets += meshlets.lodOffsets[object.lod + 1] - meshlets.lodOffsets[object.lod] - visible;
+            if (visible == 0) {
+                continue;
+            }
+        }
+
         pushConstantsData push{};
-        auto modelMatrix = object.transform.mat4();
-        push.modelMatrix = object.transform.mat4();
+        push.modelMatrix = modelMatrix * object.model->getVertexTransform();
         push.normalMatrix = object.transform.normalMatrix();
 
+        // Every permutation shares the layout, so the global set stays bound across the switch.
+        if (objectPipeline != boundPipeline) {
+            boundPipeline = objectPipeline;
+            objectPipeline->bind(frameInfo.commandBuffer);
+        }
+
         vkCmdPushConstants(
                 frameInfo.commandBuffer,
                 pipelineLayout,
@@ -45,9 +99,138 @@ void rendering::RenderSystem::renderObjects(FrameInfo& frameInfo) {
                 sizeof(pushConstantsData),
                 &push);
 
-        object.model->bind(frameInfo.commandBuffer);
-        object.model->draw(frameInfo.commandBuffer);
+        if (object.model->hasIndices() && (!indicesBound || object.model->getIndexType() != boundIndexType)) {
+            boundIndexType = object.model->getIndexType();
+            arena.bindIndexBuffer(frameInfo.commandBuffer, boundIndexType);
+            indicesBound = true;
+        }
+        if (meshlets.size() > 0) {
+            for (const auto& range : visibleRanges) {
+                drawnTriangles += range.indexCount / 3;
+            }
+            object.model->drawRanges(frameInfo.commandBuffer, visibleRanges);
+        }
+        else {
+            drawnTriangles += lods[object.lod].indexCount / 3;
+            object.model->draw(frameInfo.commandBuffer, object.lod);
+        }
+    }
+}
+
+/**
+ * How many pixels one model space unit of error covers on screen for this object. The bounding
+ * sphere's nearest depth is used, so an object the camera is inside of always gets full detail.
+ *
+ * @return Pixels per unit, multiply with Model::Lod::error to get the projected error
+ */
+float rendering::RenderSystem::lodPixelsPerUnit(const Camera& camera, VkExtent2D extent,
+                                                const engine::TransformComponent& transform,
+                                                glm::vec3 boundsMin, glm::vec3 boundsMax) {
+    float scale = glm::max(glm::abs(transform.scale.x), glm::max(glm::abs(transform.scale.y), glm::abs(transform.scale.z)));
+    glm::vec4 center = camera.getView() * transform.mat4() * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f);
+    float radius = glm::length(boundsMax - boundsMin) * 0.5f * scale;
+
+    const glm::mat4 projection = camera.getProjection();
+    bool perspective = projection[2][3] != 0.0f;
+    float depth = perspective ? glm::max(center.z - radius, 1e-4f) : 1.0f;
+    return projection[1][1] * 0.5f * static_cast<float>(extent.height) * scale / depth;
+}
+
+/**
+ * Picks the coarsest LOD whose projected error stays under LOD_ERROR_PIXELS, moving from the LOD
+ * drawn last frame. Refining happens as soon as the current LOD exceeds the threshold, coarsening
+ * only once the next LOD is under LOD_HYSTERESIS of it.
+ *
+ * @param lods LOD chain of the model, errors increasing
+ * @param current LOD drawn last frame
+ * @param pixelsPerUnit Result of lodPixelsPerUnit
+ *
+ * @return Index of the LOD to draw
+ */
+uint32_t rendering::RenderSystem::selectLod(const std::vector<Model::Lod>& lods, uint32_t current, float pixelsPerUnit) {
+    auto lodCount = static_cast<uint32_t>(lods.size());
+    uint32_t lod = std::min(current, lodCount - 1);
+    while (lod > 0 && lods[lod].error * pixelsPerUnit > LOD_ERROR_PIXELS) {
+        lod--;
+    }
+    while (lod + 1 < lodCount && lods[lod + 1].error * pixelsPerUnit <= LOD_ERROR_PIXELS * LOD_HYSTERESIS) {
+        lod++;
+    }
+    return lod;
+}
+
+/**
+ * Moves the camera into an object's model space: the frustum planes come from the combined
+ * projection, view and model matrix, the camera position from the inverse of view and model. Cone
+ * culling additionally needs a perspective camera and a model matrix that does not mirror, which
+ * would flip the winding the cones were built from.
+ *
+ * @param backFaceCulling Whether the pipeline culls back faces
+ */
+rendering::RenderSystem::ClusterView rendering::RenderSystem::clusterView(const Camera& camera, const glm::mat4& modelMatrix,
+                                                                          bool backFaceCulling) {
+    const glm::mat4 projection = camera.getProjection();
+    const glm::mat4 clip = projection * camera.getView() * modelMatrix;
+    auto row = [&clip](int i) { return glm::vec4{clip[0][i], clip[1][i], clip[2][i], clip[3][i]}; };
+
+    // Gribb and Hartmann plane extraction for a 0 to 1 depth range.
+    ClusterView view{};
+    view.planes = {row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(2), row(3) - row(2)};
+    for (auto& plane : view.planes) {
+        plane /= glm::length(glm::vec3{plane.x, plane.y, plane.z});
+    }
+
+    bool perspective = projection[2][3] != 0.0f;
+    view.coneCulling = backFaceCulling && perspective && glm::determinant(modelMatrix) > 0.0f;
+    view.cameraPosition = glm::vec3{glm::inverse(camera.getView() * modelMatrix)[3]};
+    return view;
+}
+
+/**
+ * Culls the meshlets of one LOD. A meshlet is dropped when its bounding sphere is entirely outside
+ * a frustum plane, or when its normal cone shows every triangle facing away from the camera:
+ * dot(center - camera, axis) >= sin(halfAngle) * |center - camera| + radius. The survivors are
+ * returned as index ranges, with neighbouring meshlets merged into one draw.
+ *
+ * @param ranges Cleared, then receives the index ranges to draw
+ *
+ * @return Number of meshlets that survived
+ */
+uint32_t rendering::RenderSystem::cullMeshlets(const Model::Meshlets& meshlets, uint32_t lod, const ClusterView& view,
+                                               std::vector<Model::IndexRange>& ranges) {
+    ranges.clear();
+    lod = std::min(lod, static_cast<uint32_t>(meshlets.lodOffsets.size()) - 2);
+
+    uint32_t visible = 0;
+    for (uint32_t i = meshlets.lodOffsets[lod]; i < meshlets.lodOffsets[lod + 1]; i++) {
+        const glm::vec4& sphere = meshlets.bounds[i];
+        glm::vec3 center{sphere.x, sphere.y, sphere.z};
+
+        bool inside = true;
+        for (const auto& plane : view.planes) {
+            inside &= glm::dot(glm::vec3{plane.x, plane.y, plane.z}, center) + plane.w >= -sphere.w;
+        }
+        if (!inside) {
+            continue;
+        }
+
+        if (view.coneCulling) {
+            const glm::vec4& cone = meshlets.cones[i];
+            glm::vec3 toCenter = center - view.cameraPosition;
+            if (glm::dot(toCenter, glm::vec3{cone.x, cone.y, cone.z}) >= cone.w * glm::length(toCenter) + sphere.w) {
+                continue;
+            }
+        }
+
+        visible++;
+        if (!ranges.empty() && ranges.back().firstIndex + ranges.back().indexCount == meshlets.firstIndex[i]) {
+            ranges.back().indexCount += meshlets.indexCount[i];
+        }
+        else {
+            ranges.push_back({meshlets.firstIndex[i], meshlets.indexCount[i]});
+        }
     }
+    return visible;
 }
 
 void rendering::RenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
@@ -57,6 +240,9 @@ void rendering::RenderSystem::createPipelineLayout(VkDescriptorSetLayout globalS
     pushConstantRange.size = sizeof(pushConstantsData);
 
     std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
+    if (BindlessTable* bindless = device.bindless()) {
+        descriptorSetLayouts.push_back(bindless->getDescriptorSetLayout());
+    }
 
     VkPipelineLayoutCreateInfo pipelineLayoutCI{};
     pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -70,16 +256,89 @@ void rendering::RenderSystem::createPipelineLayout(VkDescriptorSetLayout globalS
     }
 }
 
-void rendering::RenderSystem::createPipeline(VkRenderPass renderPass) {
+void rendering::RenderSystem::createPipeline() {
     assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
+    // Held for the life of the system, permutations are built from them on demand.
+    vertexShader = device.shaderModules().acquire("../shaders/shader.vert.spv");
+    fragmentShader = device.shaderModules().acquire("../shaders/shader.frag.spv");
+
     PipelineConfigInfo pipelineConfig{};
-    Pipeline::defaultPipelineConfigInfo(pipelineConfig);
-    pipelineConfig.renderPass = renderPass;
-    pipelineConfig.pipelineLayout = pipelineLayout;
-    pipeline = std::make_unique<Pipeline>(
-            device,
-            "../shaders/shader.vert.spv",
-            "../shaders/shader.frag.spv",
-            pipelineConfig);
+    configFor(Model::VertexFormat::Float, pipelineConfig);
+    coneCulling = (pipelineConfig.rasterizationCI.cullMode & VK_CULL_MODE_BACK_BIT) != 0;
+    ShaderPermutation::Specialization specialization{permutation};
+    pipeline = &device.pipelines().get(vertexShader, fragmentShader, pipelineConfig, specialization.get());
+
+    ShaderPermutation packed = permutation;
+    packed.vertexFormat = Model::VertexFormat::Packed;
+    packedPipeline = request(packed);
+}
+
+/**
+ * Switches the lighting and debug view every object is drawn with. Both vertex formats of the
+ * permutation are requested right away, objects keep drawing with the default permutation of their
+ * vertex format until theirs is compiled.
+ */
+void rendering::RenderSystem::setPermutation(const ShaderPermutation& _permutation) {
+    permutation = _permutation;
+    for (auto format : {Model::VertexFormat::Float, Model::VertexFormat::Packed}) {
+        permutation.vertexFormat = format;
+        request(permutation);
+    }
+    permutation.vertexFormat = Model::VertexFormat::Float;
+}
+
+bool rendering::RenderSystem::isPermutationReady() {
+    for (auto format : {Model::VertexFormat::Float, Model::VertexFormat::Packed}) {
+        ShaderPermutation variant = permutation;
+        variant.vertexFormat = format;
+        PipelineCompiler::State state = request(variant)->getState();
+        if (state == PipelineCompiler::State::Queued || state == PipelineCompiler::State::Compiling) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void rendering::RenderSystem::configFor(Model::VertexFormat format, PipelineConfigInfo& configInfo) const {
+    Pipeline::defaultPipelineConfigInfo(configInfo);
+    configInfo.renderPass = renderPass;
+    configInfo.pipelineLayout = pipelineLayout;
+    if (format == Model::VertexFormat::Packed) {
+        configInfo.bindingDescriptions = Model::PackedVertex::getBindingDescription();
+        configInfo.attributeDescriptions = Model::PackedVertex::getAttributeDescription();
+    }
+}
+
+/**
+ * Returns the request of a permutation, making it the first time the permutation is asked for.
+ * One the PipelineRegistry already has is ready at once.
+ */
+rendering::PipelineCompiler::Handle& rendering::RenderSystem::request(const ShaderPermutation& variant) {
+    PipelineCompiler::Handle& handle = permutations[variant.key()];
+    if (!handle) {
+        PipelineConfigInfo pipelineConfig{};
+        configFor(variant.vertexFormat, pipelineConfig);
+        ShaderPermutation::Specialization specialization{variant};
+        // Packed permutations fall back in pipelineFor, the default packed pipeline may still be compiling.
+        Pipeline* fallback = variant.vertexFormat == Model::VertexFormat::Float ? pipeline : nullptr;
+        handle = device.pipelineCompiler().request(vertexShader, fragmentShader, pipelineConfig,
+                                                   specialization.get(), fallback);
+    }
+    return handle;
+}
+
+/**
+ * Returns the pipeline to draw a vertex format with this frame: the current permutation once it is
+ * compiled, otherwise its fallback. Packed permutations fall back to the default packed pipeline as
+ * soon as that one is ready, null until then.
+ */
+rendering::Pipeline* rendering::RenderSystem::pipelineFor(Model::VertexFormat format) {
+    ShaderPermutation variant = permutation;
+    variant.vertexFormat = format;
+    Pipeline* current = request(variant)->getPipeline();
+    if (current == nullptr && format == Model::VertexFormat::Packed) {
+        return packedPipeline->getPipeline();
+    }
+    return current;
 }
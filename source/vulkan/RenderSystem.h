@@ -7,12 +7,15 @@
 #include "Model.h"
 #include "Camera.h"
 #include "FrameInfo.h"
+#include "PipelineCompiler.h"
+#include "ShaderPermutation.h"
 
 #include "../engine/Object.h"
 
 #include <memory>
 #include <stdexcept>
 #include <array>
+#include <unordered_map>
 
 #include <glm/gtc/constants.hpp>
 
@@ -27,15 +30,71 @@ namespace rendering {
         RenderSystem &operator = (const RenderSystem&) = delete;
 
         void renderObjects(FrameInfo& frameInfo);
+        void setPermutation(const ShaderPermutation& _permutation);
+        // The vertex format of the permutation is unused, each model is drawn with its own.
+        [[nodiscard]] const ShaderPermutation& getPermutation() const { return permutation; }
+        // Whether the permutation finished compiling for both vertex formats, draws fall back until then.
+        [[nodiscard]] bool isPermutationReady();
+
+        // Set of the Device's BindlessTable in the pipeline layout, when it has one.
+        static constexpr uint32_t BINDLESS_SET = 1;
+
+        // Largest projected LOD error, in pixels, that is still drawn at the coarser LOD.
+        static constexpr float LOD_ERROR_PIXELS = 1.0f;
+        // A coarser LOD is only taken once its error falls below this fraction of the threshold, so
+        // objects sitting at a switching distance do not flip between two LODs every frame.
+        static constexpr float LOD_HYSTERESIS = 0.75f;
+
+        static float lodPixelsPerUnit(const Camera& camera, VkExtent2D extent, const engine::TransformComponent& transform,
+                                      glm::vec3 boundsMin, glm::vec3 boundsMax);
+        static uint32_t selectLod(const std::vector<Model::Lod>& lods, uint32_t current, float pixelsPerUnit);
+
+        // Frustum and, when enabled, back-facing cone test of one object's meshlets, with the camera
+        // moved into the object's model space so meshlet bounds are used as stored.
+        struct ClusterView {
+            std::array<glm::vec4, 6> planes{}; // normalized, positive inside
+            glm::vec3 cameraPosition{};
+            bool coneCulling = false;
+        };
+
+        static ClusterView clusterView(const Camera& camera, const glm::mat4& modelMatrix, bool backFaceCulling);
+        static uint32_t cullMeshlets(const Model::Meshlets& meshlets, uint32_t lod, const ClusterView& view,
+                                     std::vector<Model::IndexRange>& ranges);
+
+        [[nodiscard]] uint64_t getDrawnTriangles() const { return drawnTriangles; }
+        [[nodiscard]] uint64_t getDrawnMeshlets() const { return drawnMeshlets; }
+        [[nodiscard]] uint64_t getCulledMeshlets() const { return culledMeshlets; }
 
     private:
         void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
-        void createPipeline(VkRenderPass renderPass);
+        void createPipeline();
+        void configFor(Model::VertexFormat format, PipelineConfigInfo& configInfo) const;
+        PipelineCompiler::Handle& request(const ShaderPermutation& variant);
+        Pipeline* pipelineFor(Model::VertexFormat format);
 
         Device& device;
+        VkRenderPass renderPass;
+        VkShaderModule vertexShader = VK_NULL_HANDLE;
+        VkShaderModule fragmentShader = VK_NULL_HANDLE;
 
-        std::unique_ptr<Pipeline> pipeline;
+        // Pipelines are owned by the Device's PipelineRegistry. The default float permutation is
+        // built up front and is the fallback of every float permutation; the default packed one
+        // compiles in the background and falls back to nothing, no other pipeline reads packed
+        // vertices. pipelineFor draws other packed permutations with it once it is ready. Other
+        // permutations are requested the first time they are drawn.
+        Pipeline* pipeline = nullptr;
+        PipelineCompiler::Handle packedPipeline{};
+        std::unordered_map<uint32_t, PipelineCompiler::Handle> permutations{};
+        ShaderPermutation permutation{};
         VkPipelineLayout pipelineLayout;
+
+        // Cone culling removes back faces, so it is only allowed when the pipeline culls them too.
+        bool coneCulling = false;
+        std::vector<Model::IndexRange> visibleRanges{};
+
+        uint64_t drawnTriangles = 0;
+        uint64_t drawnMeshlets = 0;
+        uint64_t culledMeshlets = 0;
     };
 }
 
@@ -1,5 +1,6 @@
 
 #include "Renderer.h"
+#include "BindlessTable.h"
 
 
 namespace rendering {
@@ -75,6 +76,13 @@ namespace rendering {
         }
 
         isFrameStarted = true;
+        // acquireNextImage waited for the fence of the last frame that used this frame index.
+        frameAllocator.beginFrame(currentFrameIndex);
+        descriptorPools.beginFrame(currentFrameIndex);
+        device.descriptorSets().nextFrame();
+        if (BindlessTable* bindless = device.bindless()) {
+            bindless->nextFrame();
+        }
 
         auto commandBuffer = getCurrentCommandBuffer();
         VkCommandBufferBeginInfo beginInfo{};
@@ -94,6 +102,8 @@ namespace rendering {
             throw std::runtime_error("failed to record command buffer!");
         }
 
+        // Host writes of this frame to non coherent memory, all in one vkFlushMappedMemoryRanges.
+        device.memoryAllocator().flushDirty();
         auto result = swapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
             window.wasWindowResized()) {
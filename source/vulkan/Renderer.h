@@ -5,6 +5,8 @@
 #include "Window.h"
 #include "Device.hpp"
 #include "SwapChain.hpp"
+#include "FrameAllocator.h"
+#include "Descriptor.h"
 #include "Model.h"
 
 #include <memory>
@@ -31,6 +33,7 @@ namespace rendering {
 
         [[nodiscard]] VkRenderPass getSwapChainRenderPass() const { return swapChain->getRenderPass(); }
         float getAspectRatio() const { return swapChain->extentAspectRatio(); }
+        [[nodiscard]] VkExtent2D getExtent() const { return {swapChain->width(), swapChain->height()}; }
         [[nodiscard]] bool isFrameInProgress() const { return isFrameStarted; }
         [[nodiscard]] VkCommandBuffer getCurrentCommandBuffer() const {
             assert(isFrameStarted && "Cannot get command buffer when frame not in progress");
@@ -40,6 +43,10 @@ namespace rendering {
             assert(isFrameStarted && "Cannot get frame index when frame not in progress");
             return currentFrameIndex;
         }
+        // Per-frame uniform and draw data, rewound by beginFrame.
+        [[nodiscard]] FrameAllocator& getFrameAllocator() { return frameAllocator; }
+        // Descriptor sets, those allocated for a frame are released by its next beginFrame.
+        [[nodiscard]] DescriptorPoolManager& getDescriptorPools() { return descriptorPools; }
 
 
     private:
@@ -51,6 +58,8 @@ namespace rendering {
         Device& device;
         std::unique_ptr<SwapChain> swapChain;
         std::vector<VkCommandBuffer> commandBuffers;
+        FrameAllocator frameAllocator{device, SwapChain::MAX_FRAMES_IN_FLIGHT};
+        DescriptorPoolManager descriptorPools{device, SwapChain::MAX_FRAMES_IN_FLIGHT};
 
         uint32_t currentImageIndex = 0;
         int currentFrameIndex = 0;
@@ -0,0 +1,155 @@
+
+#include "ShaderModuleCache.h"
+#include "Device.hpp"
+#include "MappedFile.h"
+#include "renderingutility.h"
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace rendering {
+
+    ShaderModuleCache::~ShaderModuleCache() {
+        for (const auto &kv: modules) {
+            vkDestroyShaderModule(device.device(), kv.second.module, nullptr);
+        }
+    }
+
+/**
+ * Acquires the module of a SPIR-V file. A path whose module is still alive is not read again,
+ * otherwise the file is mapped, validated and hashed and only handed to the driver when no module
+ * has the same code.
+ */
+    VkShaderModule ShaderModuleCache::acquire(const std::string &filepath) {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            auto path = paths.find(filepath);
+            if (path != paths.end()) {
+                auto cached = modules.find(path->second);
+                if (cached != modules.end()) {
+                    cached->second.references++;
+                    stats.hits++;
+                    stats.pathHits++;
+                    return cached->second.module;
+                }
+                paths.erase(path);
+            }
+        }
+
+        MappedFile file{filepath};
+        // Mappings start on a page, which is aligned for the words vkCreateShaderModule reads. Copy
+        // the code only where a platform hands out something less.
+        if (reinterpret_cast<uintptr_t>(file.data()) % alignof(uint32_t) == 0) {
+            return acquire(reinterpret_cast<const uint32_t *>(file.data()), file.size(), filepath, &filepath);
+        }
+        std::vector<uint32_t> aligned((file.size() + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+        memcpy(aligned.data(), file.data(), file.size());
+        return acquire(aligned.data(), file.size(), filepath, &filepath);
+    }
+
+/**
+ * Acquires the module of SPIR-V in memory, creating it when no module has the same code.
+ *
+ * @param size In bytes
+ */
+    VkShaderModule ShaderModuleCache::acquire(const uint32_t *code, size_t size) {
+        return acquire(code, size, "shader code", nullptr);
+    }
+
+    VkShaderModule ShaderModuleCache::acquire(const uint32_t *code, size_t size, const std::string &name,
+                                              const std::string *filepath) {
+        validate(code, size, name);
+        uint64_t hash = hashBytes(code, size);
+
+        std::lock_guard<std::mutex> lock{mutex};
+        if (filepath != nullptr) {
+            paths[*filepath] = hash;
+            stats.mappedBytes += size;
+        }
+        Module &cached = modules[hash];
+        if (cached.module != VK_NULL_HANDLE) {
+            cached.references++;
+            stats.hits++;
+            return cached.module;
+        }
+
+        VkShaderModuleCreateInfo shaderModuleCI{};
+        shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        shaderModuleCI.codeSize = size;
+        shaderModuleCI.pCode = code;
+
+        if (vkCreateShaderModule(device.device(), &shaderModuleCI, nullptr, &cached.module) != VK_SUCCESS) {
+            modules.erase(hash);
+            throw std::runtime_error("failed to create shader module\n");
+        }
+        cached.references = 1;
+        hashes.emplace(cached.module, hash);
+        return cached.module;
+    }
+
+/**
+ * Adds a reference to a module that is already acquired, for a user that outlives the acquirer.
+ */
+    void ShaderModuleCache::retain(VkShaderModule module) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto hash = hashes.find(module);
+        assert(hash != hashes.end() && "Cannot retain a shader module that is not acquired");
+        modules[hash->second].references++;
+    }
+
+/**
+ * Drops a reference, destroying the module with the last one. Pipelines already created from it
+ * keep working.
+ */
+    void ShaderModuleCache::release(VkShaderModule module) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto hash = hashes.find(module);
+        assert(hash != hashes.end() && "Cannot release a shader module that is not acquired");
+        auto cached = modules.find(hash->second);
+        if (--cached->second.references > 0) {
+            return;
+        }
+        vkDestroyShaderModule(device.device(), module, nullptr);
+        modules.erase(cached);
+        hashes.erase(hash);
+        stats.released++;
+    }
+
+    uint64_t ShaderModuleCache::codeHash(VkShaderModule module) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto hash = hashes.find(module);
+        assert(hash != hashes.end() && "Shader module is not acquired");
+        return hash->second;
+    }
+
+    ShaderModuleCache::Stats ShaderModuleCache::getStats() {
+        std::lock_guard<std::mutex> lock{mutex};
+        Stats result = stats;
+        result.modules = static_cast<uint32_t>(modules.size());
+        return result;
+    }
+
+/**
+ * Checks the SPIR-V header: whole words, at least the five header words, the magic number in this
+ * machine's byte order and a 1.x version no newer than SPIRV_MAX_MINOR. Throws otherwise.
+ *
+ * @param size In bytes
+ * @param name File or description of the code, for the error
+ */
+    void ShaderModuleCache::validate(const uint32_t *code, size_t size, const std::string &name) {
+        if (size < 5 * sizeof(uint32_t) || size % sizeof(uint32_t) != 0) {
+            throw std::runtime_error("invalid SPIR-V size in " + name);
+        }
+        if (code[0] != SPIRV_MAGIC) {
+            throw std::runtime_error("invalid SPIR-V magic in " + name);
+        }
+        uint32_t major = (code[1] >> 16) & 0xff;
+        uint32_t minor = (code[1] >> 8) & 0xff;
+        if ((code[1] & 0xff0000ff) != 0 || major != 1 || minor > SPIRV_MAX_MINOR) {
+            throw std::runtime_error("unsupported SPIR-V version " + std::to_string(major) + "." +
+                                     std::to_string(minor) + " in " + name);
+        }
+    }
+}
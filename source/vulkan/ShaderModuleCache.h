@@ -0,0 +1,71 @@
+#ifndef VULKANLEARN_SHADERMODULECACHE_H
+#define VULKANLEARN_SHADERMODULECACHE_H
+
+#include "VulkanCommon.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace rendering {
+    class Device;
+
+    // One VkShaderModule per distinct SPIR-V, shared by every pipeline that uses it however many
+    // paths it was loaded from. Files are memory mapped and checked for the SPIR-V magic and version
+    // before the driver sees them. Modules are keyed on a 64 bit hash of their code, the code itself
+    // is not kept, and a path loaded before is not mapped again while its module lives.
+    //
+    // A pipeline only needs its modules while it is created, so modules are reference counted:
+    // acquire() or retain() before building pipelines and release() once every pipeline built from
+    // the module exists. The last release destroys the module. The Device owns it. Thread safe.
+    class ShaderModuleCache {
+    public:
+        static constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+        // Newest SPIR-V 1.x whose modules are accepted, drivers reject what they do not support.
+        static constexpr uint32_t SPIRV_MAX_MINOR = 6;
+
+        struct Stats {
+            uint32_t modules = 0;   // alive
+            uint32_t hits = 0;      // acquires of code that already had a module
+            uint32_t pathHits = 0;  // of those, acquires by a path that was not mapped again
+            uint32_t released = 0;  // modules destroyed by their last release
+            uint64_t mappedBytes = 0;
+        };
+
+        explicit ShaderModuleCache(Device& _device) : device{_device} {}
+        ~ShaderModuleCache();
+
+        ShaderModuleCache(const ShaderModuleCache&) = delete;
+        ShaderModuleCache &operator = (const ShaderModuleCache&) = delete;
+
+        VkShaderModule acquire(const std::string& filepath);
+        VkShaderModule acquire(const uint32_t* code, size_t size);
+        void retain(VkShaderModule module);
+        void release(VkShaderModule module);
+
+        // Identifies the code of an acquired module. Unlike the handle it stays the same when the
+        // module is released and created again, where the driver may also reuse the handle.
+        uint64_t codeHash(VkShaderModule module);
+
+        [[nodiscard]] Stats getStats();
+
+        static void validate(const uint32_t* code, size_t size, const std::string& name);
+
+    private:
+        struct Module {
+            VkShaderModule module = VK_NULL_HANDLE;
+            uint32_t references = 0;
+        };
+
+        VkShaderModule acquire(const uint32_t* code, size_t size, const std::string& name, const std::string* filepath);
+
+        Device& device;
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Module> modules{};          // by code hash
+        std::unordered_map<VkShaderModule, uint64_t> hashes{};   // code hash of each module
+        std::unordered_map<std::string, uint64_t> paths{};       // code hash last loaded from a path
+        Stats stats{};
+    };
+}
+
+#endif //VULKANLEARN_SHADERMODULECACHE_H
@@ -0,0 +1,38 @@
+
+#include "ShaderPermutation.h"
+
+#include <algorithm>
+
+namespace rendering {
+
+    ShaderPermutation::Specialization::Specialization(const ShaderPermutation &permutation) {
+        data[LIGHT_COUNT] = std::min(permutation.lightCount, MAX_LIGHTS);
+        data[ATTENUATION] = static_cast<uint32_t>(permutation.attenuation);
+        data[VERTEX_FORMAT] = static_cast<uint32_t>(permutation.vertexFormat);
+        data[DEBUG_VIEW] = static_cast<uint32_t>(permutation.debugView);
+
+        // All switches are 32 bit ints, stored at their constant_id.
+        for (uint32_t id = 0; id < CONSTANT_COUNT; id++) {
+            entries[id].constantID = id;
+            entries[id].offset = id * sizeof(uint32_t);
+            entries[id].size = sizeof(uint32_t);
+        }
+        info.mapEntryCount = CONSTANT_COUNT;
+        info.pMapEntries = entries.data();
+        info.dataSize = sizeof(data);
+        info.pData = data.data();
+    }
+
+    uint32_t ShaderPermutation::key() const {
+        return std::min(lightCount, MAX_LIGHTS) | static_cast<uint32_t>(attenuation) << 8 |
+               static_cast<uint32_t>(vertexFormat) << 16 | static_cast<uint32_t>(debugView) << 24;
+    }
+
+    std::string ShaderPermutation::name() const {
+        static const char *attenuations[] = {"none", "linear", "inverse-square"};
+        static const char *debugViews[] = {"none", "normals", "vertex-color", "lighting"};
+        return "lights=" + std::to_string(std::min(lightCount, MAX_LIGHTS)) +
+               " attenuation=" + attenuations[static_cast<uint32_t>(attenuation)] +
+               " debug=" + debugViews[static_cast<uint32_t>(debugView)];
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef VULKANLEARN_SHADERPERMUTATION_H
+#define VULKANLEARN_SHADERPERMUTATION_H
+
+#include "VulkanCommon.h"
+#include "Model.h"
+
+#include <array>
+#include <string>
+
+namespace rendering {
+    // Feature switches of shader.vert and shader.frag. They reach the shaders as specialization
+    // constants instead of uniforms, so each permutation is its own pipeline and the driver drops
+    // every path it does not take: the light loop is unrolled to lightCount, one attenuation model
+    // and one vertex decode are left and debug views cost nothing when off. RenderSystem builds
+    // permutations on demand through the PipelineCompiler, so they end up in the PipelineCache.
+    struct ShaderPermutation {
+        // Size of GlobalUbo::lights, MAX_LIGHTS in the shaders.
+        static constexpr uint32_t MAX_LIGHTS = 4;
+
+        // constant_id of each switch in the shaders.
+        enum ConstantId : uint32_t {
+            LIGHT_COUNT = 0,
+            ATTENUATION = 1,
+            VERTEX_FORMAT = 2,
+            DEBUG_VIEW = 3,
+            CONSTANT_COUNT,
+        };
+
+        enum class Attenuation : uint32_t {
+            None,
+            Linear,
+            InverseSquare,
+        };
+
+        enum class DebugView : uint32_t {
+            None,
+            Normals,
+            VertexColor,
+            Lighting, // lit white, without the vertex color
+        };
+
+        // Owns the constants a VkSpecializationInfo points to, it has to outlive the pipeline
+        // request it is passed to.
+        class Specialization {
+        public:
+            explicit Specialization(const ShaderPermutation& permutation);
+
+            Specialization(const Specialization&) = delete;
+            Specialization &operator = (const Specialization&) = delete;
+
+            [[nodiscard]] const VkSpecializationInfo* get() const { return &info; }
+
+        private:
+            std::array<uint32_t, CONSTANT_COUNT> data{};
+            std::array<VkSpecializationMapEntry, CONSTANT_COUNT> entries{};
+            VkSpecializationInfo info{};
+        };
+
+        uint32_t lightCount = 1; // clamped to MAX_LIGHTS
+        Attenuation attenuation = Attenuation::InverseSquare;
+        Model::VertexFormat vertexFormat = Model::VertexFormat::Float;
+        DebugView debugView = DebugView::None;
+
+        // Every switch packed into one value, equal for equal permutations.
+        [[nodiscard]] uint32_t key() const;
+        // The switches RenderSystem::setPermutation() takes, the vertex format comes with each model.
+        [[nodiscard]] std::string name() const;
+
+        bool operator == (const ShaderPermutation& other) const { return key() == other.key(); }
+    };
+}
+
+#endif //VULKANLEARN_SHADERPERMUTATION_H
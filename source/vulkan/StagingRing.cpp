@@ -0,0 +1,138 @@
+
+#include "StagingRing.h"
+#include "Device.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace rendering {
+
+    StagingRing::StagingRing(Device &_device, VkDeviceSize size) : device{_device}, capacity{size} {
+        buffer = std::make_unique<Buffer>(
+                device,
+                1,
+                static_cast<uint32_t>(capacity),
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                1,
+                MemoryBudget::Category::Staging
+                );
+        buffer->map();
+    }
+
+    StagingRing::~StagingRing() {
+        for (const auto &submission: pending) {
+            vkWaitForFences(device.device(), 1, &submission.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+            vkDestroyFence(device.device(), submission.fence, nullptr);
+        }
+        for (VkFence fence: unusedFences) {
+            vkDestroyFence(device.device(), fence, nullptr);
+        }
+    }
+
+    // Returns the id a batch allocates and closes its staging space with.
+    uint64_t StagingRing::open() {
+        return nextBatch++;
+    }
+
+/**
+ * Takes up to `size` bytes of staging memory. The region is contiguous, so it ends early where the
+ * ring wraps around or where space still in use by the GPU begins.
+ *
+ * @param batch Id from open() of the batch whose copies read the region
+ * @param size Bytes wanted
+ * @param alignment Offset multiple, a power of two no larger than the capacity
+ *
+ * @return Mapped region of at most `size` bytes, empty when the ring has no free space
+ */
+    StagingRing::Region StagingRing::allocate(uint64_t batch, VkDeviceSize size, VkDeviceSize alignment) {
+        reclaim();
+        uint64_t start = (head + alignment - 1) & ~(alignment - 1);
+        uint64_t offset = start % capacity;
+        if (start >= tail + capacity || size == 0) {
+            return {};
+        }
+        VkDeviceSize length = std::min({size, tail + capacity - start, capacity - offset});
+        head = start + length;
+        if (!ranges.empty() && ranges.back().batch == batch && ranges.back().serial == 0) {
+            ranges.back().end = head;
+        }
+        else {
+            ranges.push_back({head, batch, 0});
+        }
+        return {offset, length, static_cast<char *>(buffer->getMappedMemory()) + offset};
+    }
+
+/**
+ * Ends a submission of one batch: everything the batch allocated since its previous close() is
+ * read by the GPU work that signals the returned fence. Space of other batches still open stays
+ * allocated. Submit exactly once with it; the ring resets and reuses the fence after it signalled,
+ * so never wait on it directly, use isComplete() or wait().
+ */
+    StagingRing::Submission StagingRing::close(uint64_t batch) {
+        Pending submission{acquireFence(), nextSerial++};
+        pending.push_back(submission);
+        for (auto &range: ranges) {
+            if (range.batch == batch && range.serial == 0) {
+                range.serial = submission.serial;
+            }
+        }
+        return {submission.fence, submission.serial};
+    }
+
+    // Completes submissions whose fence has signalled, oldest first, then frees the ranges at the
+    // front of the ring they read. A range of a batch still open keeps everything after it.
+    void StagingRing::reclaim() {
+        while (!pending.empty() && vkGetFenceStatus(device.device(), pending.front().fence) == VK_SUCCESS) {
+            const Pending &submission = pending.front();
+            completedSerial = submission.serial;
+            vkResetFences(device.device(), 1, &submission.fence);
+            unusedFences.push_back(submission.fence);
+            pending.pop_front();
+        }
+        while (!ranges.empty() && ranges.front().serial != 0 && ranges.front().serial <= completedSerial) {
+            tail = ranges.front().end;
+            ranges.pop_front();
+        }
+    }
+
+    // Whether the submission and every one closed before it have finished.
+    bool StagingRing::isComplete(uint64_t serial) {
+        reclaim();
+        return serial <= completedSerial;
+    }
+
+    void StagingRing::wait(uint64_t serial) {
+        while (!pending.empty() && pending.front().serial <= serial) {
+            vkWaitForFences(device.device(), 1, &pending.front().fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+            reclaim();
+        }
+    }
+
+    // Waits for the submission reading the oldest space of the ring. False if that space belongs
+    // to a batch that has not closed it yet, then waiting cannot free anything.
+    bool StagingRing::waitForSpace() {
+        reclaim();
+        if (ranges.empty() || ranges.front().serial == 0) {
+            return false;
+        }
+        wait(ranges.front().serial);
+        return true;
+    }
+
+    VkFence StagingRing::acquireFence() {
+        if (!unusedFences.empty()) {
+            VkFence fence = unusedFences.back();
+            unusedFences.pop_back();
+            return fence;
+        }
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VkFence fence;
+        if (vkCreateFence(device.device(), &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create staging fence");
+        }
+        return fence;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef VULKANLEARN_STAGINGRING_H
+#define VULKANLEARN_STAGINGRING_H
+
+#include "VulkanCommon.h"
+#include "Buffer.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace rendering {
+    class Device;
+
+    // One persistently mapped host visible buffer that every upload to device local memory stages
+    // through, instead of a staging Buffer per upload. Space is handed out front to back and wraps
+    // around. Every allocation belongs to a batch from open(), so several TransferBatches can stage
+    // at once; close() ends a submission of one batch and returns the fence its copies must signal,
+    // and space is reclaimed in order once every range before it has been submitted and signalled.
+    // Allocations may come back shorter than requested at the end of the ring or when it is nearly
+    // full, callers copy in chunks. Not thread safe, use it from the thread that submits.
+    class StagingRing {
+    public:
+        static constexpr VkDeviceSize SIZE = 32ull << 20;
+        static constexpr VkDeviceSize ALIGNMENT = 16;
+
+        struct Region {
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0; // 0 when the ring is full
+            void* mapped = nullptr;
+        };
+
+        struct Submission {
+            VkFence fence = VK_NULL_HANDLE; // owned by the ring
+            uint64_t serial = 0;
+        };
+
+        explicit StagingRing(Device& _device, VkDeviceSize size = SIZE);
+        ~StagingRing();
+
+        StagingRing(const StagingRing&) = delete;
+        StagingRing &operator = (const StagingRing&) = delete;
+
+        uint64_t open();
+        Region allocate(uint64_t batch, VkDeviceSize size, VkDeviceSize alignment = ALIGNMENT);
+        Submission close(uint64_t batch);
+        void reclaim();
+        bool isComplete(uint64_t serial);
+        void wait(uint64_t serial);
+        bool waitForSpace();
+
+        [[nodiscard]] VkBuffer getBuffer() const { return buffer->getBuffer(); }
+        [[nodiscard]] VkDeviceSize getCapacity() const { return capacity; }
+        [[nodiscard]] VkDeviceSize getFree() const { return capacity - (head - tail); }
+
+    private:
+        struct Pending {
+            VkFence fence;
+            uint64_t serial;
+        };
+
+        // Consecutive space allocated by one batch, from the end of the previous range.
+        struct Range {
+            uint64_t end;
+            uint64_t batch;
+            uint64_t serial; // 0 until the batch closes it
+        };
+
+        VkFence acquireFence();
+
+        Device& device;
+        std::unique_ptr<Buffer> buffer;
+        VkDeviceSize capacity;
+
+        // Positions grow forever, the offset in the buffer is position % capacity.
+        uint64_t head = 0;
+        uint64_t tail = 0;
+        uint64_t nextSerial = 1;
+        uint64_t completedSerial = 0;
+        uint64_t nextBatch = 1;
+        std::deque<Pending> pending{};
+        std::deque<Range> ranges{};
+        std::vector<VkFence> unusedFences{};
+    };
+}
+
+#endif //VULKANLEARN_STAGINGRING_H
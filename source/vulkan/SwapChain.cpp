@@ -1,4 +1,5 @@
 #include "SwapChain.hpp"
+#include "Descriptor.h"
 
 // std
 #include <array>
@@ -32,7 +33,9 @@ void SwapChain::init() {\
 }
 
 SwapChain::~SwapChain() {
+  // Recreated swap chains can get the same view handles back, cached sets must not outlive the views.
   for (auto imageView : swapChainImageViews) {
+    device.descriptorSets().invalidate(reinterpret_cast<uint64_t>(imageView));
     vkDestroyImageView(device.device(), imageView, nullptr);
   }
   swapChainImageViews.clear();
@@ -43,9 +46,10 @@ SwapChain::~SwapChain() {
   }
 
   for (int i = 0; i < depthImages.size(); i++) {
+    device.descriptorSets().invalidate(reinterpret_cast<uint64_t>(depthImageViews[i]));
     vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
     vkDestroyImage(device.device(), depthImages[i], nullptr);
-    vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+    device.memoryAllocator().free(depthImageMemorys[i]);
   }
 
   for (auto framebuffer : swapChainFramebuffers) {
@@ -327,7 +331,8 @@ void SwapChain::createDepthResources() {
                 imageInfo,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                 depthImages[i],
-                depthImageMemorys[i]);
+                depthImageMemorys[i],
+                MemoryBudget::Category::Depth);
         VkImageViewCreateInfo viewInfo{};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         viewInfo.image = depthImages[i];
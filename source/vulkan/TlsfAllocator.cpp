@@ -0,0 +1,264 @@
+
+#include "TlsfAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+    // Index of the highest and lowest set bit, value must not be 0.
+    uint32_t highestBit(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<uint32_t>(index);
+#else
+        return 63u - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+    }
+
+    uint32_t lowestBit(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return static_cast<uint32_t>(index);
+#else
+        return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+    }
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+namespace rendering {
+
+    TlsfAllocator::TlsfAllocator(uint64_t _capacity, uint64_t _granularity)
+            : capacity{_capacity}, granularity{std::max<uint64_t>(_granularity, 1)} {
+        assert((granularity & (granularity - 1)) == 0 && "Granularity must be a power of two");
+        for (auto &classes: heads) {
+            classes.fill(NONE);
+        }
+        if (capacity > 0) {
+            insertFree(createNode(0, capacity, NONE, NONE));
+        }
+    }
+
+/**
+ * Places a range in the first free range of a large enough size class that still fits it after
+ * alignment and granularity padding. Padding in front and the unused tail stay free.
+ *
+ * @param size Bytes to allocate, must not be 0
+ * @param alignment Power of two the offset must be a multiple of
+ * @param kind Resource kind, decides which neighbours need granularity padding
+ *
+ * @return The allocation, its offset is INVALID when nothing fits
+ */
+    TlsfAllocator::Allocation TlsfAllocator::allocate(uint64_t size, uint64_t alignment, Kind kind) {
+        assert(size > 0 && kind != Kind::Free && "Allocations need a size and a resource kind");
+        assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && "Alignment must be a power of two");
+
+        uint32_t fl, sl;
+        sizeClass(size, fl, sl);
+        uint32_t slMask = slBitmaps[fl] & (~0u << sl);
+        for (;;) {
+            if (slMask == 0) {
+                uint64_t flMask = fl + 1 < FL_COUNT ? flBitmap & (~0ull << (fl + 1)) : 0;
+                if (flMask == 0) {
+                    return {};
+                }
+                fl = lowestBit(flMask);
+                slMask = slBitmaps[fl];
+            }
+            sl = lowestBit(slMask);
+            slMask &= slMask - 1;
+
+            // Only the first class can hold ranges smaller than the request, larger classes
+            // normally fit with their first entry unless alignment gets in the way.
+            for (uint32_t candidate = heads[fl][sl]; candidate != NONE; candidate = nodes[candidate].nextFree) {
+                uint64_t offset = fit(nodes[candidate], size, alignment, kind);
+                if (offset == INVALID) {
+                    continue;
+                }
+
+                removeFree(candidate);
+                Node range = nodes[candidate];
+                if (offset > range.offset) {
+                    uint32_t padding = createNode(range.offset, offset - range.offset, range.previous, candidate);
+                    if (range.previous != NONE) {
+                        nodes[range.previous].next = padding;
+                    }
+                    nodes[candidate].previous = padding;
+                    insertFree(padding);
+                }
+                uint64_t end = offset + size;
+                if (end < range.offset + range.size) {
+                    uint32_t tail = createNode(end, range.offset + range.size - end, candidate, range.next);
+                    if (range.next != NONE) {
+                        nodes[range.next].previous = tail;
+                    }
+                    nodes[candidate].next = tail;
+                    insertFree(tail);
+                }
+
+                Node &allocated = nodes[candidate];
+                allocated.offset = offset;
+                allocated.size = size;
+                allocated.kind = kind;
+                used += size;
+                allocationCount++;
+                return {offset, candidate};
+            }
+        }
+    }
+
+    // Returns an allocation and merges it with free neighbours on both sides.
+    void TlsfAllocator::free(uint32_t handle) {
+        assert(handle < nodes.size() && nodes[handle].kind != Kind::Free && "Freeing a range that is not allocated");
+        Node &range = nodes[handle];
+        range.kind = Kind::Free;
+        used -= range.size;
+        allocationCount--;
+
+        uint32_t next = range.next;
+        if (next != NONE && nodes[next].kind == Kind::Free) {
+            removeFree(next);
+            range.size += nodes[next].size;
+            range.next = nodes[next].next;
+            if (range.next != NONE) {
+                nodes[range.next].previous = handle;
+            }
+            releaseNode(next);
+        }
+        uint32_t previous = nodes[handle].previous;
+        if (previous != NONE && nodes[previous].kind == Kind::Free) {
+            removeFree(previous);
+            Node &merged = nodes[handle];
+            merged.offset = nodes[previous].offset;
+            merged.size += nodes[previous].size;
+            merged.previous = nodes[previous].previous;
+            if (merged.previous != NONE) {
+                nodes[merged.previous].next = handle;
+            }
+            releaseNode(previous);
+        }
+        insertFree(handle);
+    }
+
+    uint64_t TlsfAllocator::getLargestFree() const {
+        if (flBitmap == 0) {
+            return 0;
+        }
+        uint32_t fl = highestBit(flBitmap);
+        uint32_t sl = highestBit(slBitmaps[fl]);
+        uint64_t largest = 0;
+        for (uint32_t node = heads[fl][sl]; node != NONE; node = nodes[node].nextFree) {
+            largest = std::max(largest, nodes[node].size);
+        }
+        return largest;
+    }
+
+    // Sizes below SL_COUNT get a class each, above that every power of two is split into SL_COUNT.
+    void TlsfAllocator::sizeClass(uint64_t size, uint32_t &fl, uint32_t &sl) {
+        if (size < SL_COUNT) {
+            fl = 0;
+            sl = static_cast<uint32_t>(size);
+            return;
+        }
+        uint32_t bit = highestBit(size);
+        fl = bit - SL_BITS + 1;
+        sl = static_cast<uint32_t>(size >> (bit - SL_BITS)) - SL_COUNT;
+    }
+
+    // Offset a free range could hold the request at, or INVALID.
+    uint64_t TlsfAllocator::fit(const Node &node, uint64_t size, uint64_t alignment, Kind kind) const {
+        if (node.size < size) {
+            return INVALID;
+        }
+        uint64_t offset = alignUp(node.offset, alignment);
+        if (node.previous != NONE && conflicts(node.previous, kind)) {
+            const Node &previous = nodes[node.previous];
+            if ((previous.offset + previous.size - 1) / granularity == offset / granularity) {
+                offset = alignUp(offset, granularity);
+            }
+        }
+        uint64_t end = offset + size;
+        if (end > node.offset + node.size) {
+            return INVALID;
+        }
+        if (node.next != NONE && conflicts(node.next, kind) && (end - 1) / granularity == nodes[node.next].offset / granularity) {
+            return INVALID;
+        }
+        return offset;
+    }
+
+    bool TlsfAllocator::conflicts(uint32_t neighbour, Kind kind) const {
+        Kind other = nodes[neighbour].kind;
+        return granularity > 1 && other != Kind::Free && other != kind;
+    }
+
+    uint32_t TlsfAllocator::createNode(uint64_t offset, uint64_t size, uint32_t previous, uint32_t next) {
+        uint32_t index;
+        if (!unusedNodes.empty()) {
+            index = unusedNodes.back();
+            unusedNodes.pop_back();
+        }
+        else {
+            index = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+        }
+        Node &node = nodes[index];
+        node = {};
+        node.offset = offset;
+        node.size = size;
+        node.previous = previous;
+        node.next = next;
+        return index;
+    }
+
+    void TlsfAllocator::releaseNode(uint32_t node) {
+        unusedNodes.push_back(node);
+    }
+
+    void TlsfAllocator::insertFree(uint32_t node) {
+        uint32_t fl, sl;
+        sizeClass(nodes[node].size, fl, sl);
+        nodes[node].kind = Kind::Free;
+        nodes[node].previousFree = NONE;
+        nodes[node].nextFree = heads[fl][sl];
+        if (heads[fl][sl] != NONE) {
+            nodes[heads[fl][sl]].previousFree = node;
+        }
+        heads[fl][sl] = node;
+        flBitmap |= 1ull << fl;
+        slBitmaps[fl] |= 1u << sl;
+        freeRangeCount++;
+    }
+
+    void TlsfAllocator::removeFree(uint32_t node) {
+        uint32_t fl, sl;
+        sizeClass(nodes[node].size, fl, sl);
+        Node &range = nodes[node];
+        if (range.previousFree != NONE) {
+            nodes[range.previousFree].nextFree = range.nextFree;
+        }
+        else {
+            heads[fl][sl] = range.nextFree;
+            if (heads[fl][sl] == NONE) {
+                slBitmaps[fl] &= ~(1u << sl);
+                if (slBitmaps[fl] == 0) {
+                    flBitmap &= ~(1ull << fl);
+                }
+            }
+        }
+        if (range.nextFree != NONE) {
+            nodes[range.nextFree].previousFree = range.previousFree;
+        }
+        range.previousFree = range.nextFree = NONE;
+        freeRangeCount--;
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef VULKANLEARN_TLSFALLOCATOR_H
+#define VULKANLEARN_TLSFALLOCATOR_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace rendering {
+    // Two level segregated fit allocator (Masmano et al. 2004) for the blocks of MemoryAllocator.
+    // Free ranges are binned by size class, a pair of bitmaps finds the first non-empty class at
+    // least as large as a request in constant time. Like FreeListAllocator it only keeps the books.
+    //
+    // Ranges are tagged with the kind of resource they hold. A Linear range (buffer) and an Optimal
+    // range (image) never share a page of `granularity` bytes, which is what Vulkan's
+    // bufferImageGranularity requires of resources in the same VkDeviceMemory. Not thread safe.
+    class TlsfAllocator {
+    public:
+        static constexpr uint64_t INVALID = ~0ull;
+
+        enum class Kind : uint8_t {
+            Free,
+            Linear,  // buffers and linear images
+            Optimal, // optimally tiled images
+        };
+
+        struct Allocation {
+            uint64_t offset = INVALID;
+            uint32_t handle = 0;
+        };
+
+        explicit TlsfAllocator(uint64_t _capacity, uint64_t _granularity = 1);
+
+        Allocation allocate(uint64_t size, uint64_t alignment, Kind kind);
+        void free(uint32_t handle);
+
+        [[nodiscard]] uint64_t getCapacity() const { return capacity; }
+        [[nodiscard]] uint64_t getUsed() const { return used; }
+        [[nodiscard]] uint32_t getAllocationCount() const { return allocationCount; }
+        [[nodiscard]] uint32_t getFreeRangeCount() const { return freeRangeCount; }
+        [[nodiscard]] uint64_t getLargestFree() const;
+        [[nodiscard]] bool empty() const { return allocationCount == 0; }
+
+    private:
+        static constexpr uint32_t NONE = ~0u;
+        static constexpr uint32_t SL_BITS = 5;
+        static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+        static constexpr uint32_t FL_COUNT = 64 - SL_BITS + 1;
+
+        // A range of the block, free or allocated, in a list ordered by offset. Free ranges are also
+        // in the list of their size class. Neighbouring free ranges are always merged.
+        struct Node {
+            uint64_t offset = 0;
+            uint64_t size = 0;
+            uint32_t previous = NONE;
+            uint32_t next = NONE;
+            uint32_t previousFree = NONE;
+            uint32_t nextFree = NONE;
+            Kind kind = Kind::Free;
+        };
+
+        static void sizeClass(uint64_t size, uint32_t& fl, uint32_t& sl);
+        [[nodiscard]] uint64_t fit(const Node& node, uint64_t size, uint64_t alignment, Kind kind) const;
+        [[nodiscard]] bool conflicts(uint32_t neighbour, Kind kind) const;
+
+        uint32_t createNode(uint64_t offset, uint64_t size, uint32_t previous, uint32_t next);
+        void releaseNode(uint32_t node);
+        void insertFree(uint32_t node);
+        void removeFree(uint32_t node);
+
+        uint64_t capacity;
+        uint64_t granularity;
+        uint64_t used = 0;
+        uint32_t allocationCount = 0;
+        uint32_t freeRangeCount = 0;
+
+        std::vector<Node> nodes{};
+        std::vector<uint32_t> unusedNodes{};
+        uint64_t flBitmap = 0;
+        std::array<uint32_t, FL_COUNT> slBitmaps{};
+        std::array<std::array<uint32_t, SL_COUNT>, FL_COUNT> heads{};
+    };
+}
+
+#endif //VULKANLEARN_TLSFALLOCATOR_H
@@ -0,0 +1,193 @@
+
+#include "TransferBatch.h"
+#include "Device.hpp"
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace rendering {
+
+    TransferBatch::TransferBatch(Device &_device) : device{_device}, stagingBatch{_device.stagingRing().open()} {}
+
+    TransferBatch::~TransferBatch() {
+        if (!submitted) {
+            submit();
+        }
+    }
+
+/**
+ * Copies as much of `data` into the staging ring as fits right now and records its copy into the
+ * destination. Never blocks.
+ *
+ * @return Bytes staged from the start of `data`, 0 when the ring is full
+ */
+    VkDeviceSize TransferBatch::stageBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size) {
+        StagingRing &ring = device.stagingRing();
+        VkDeviceSize staged = 0;
+        while (staged < size) {
+            StagingRing::Region region = ring.allocate(stagingBatch, size - staged);
+            if (region.size == 0) {
+                break;
+            }
+            memcpy(region.mapped, static_cast<const char *>(data) + staged, region.size);
+            copyBuffer(ring.getBuffer(), dstBuffer, region.size, region.offset, dstOffset + staged);
+            staged += region.size;
+        }
+        return staged;
+    }
+
+/**
+ * Stages all of `data` and records its copy. When the ring fills up, the copies recorded so far
+ * are submitted and the batch waits for the oldest staging space to free up, so uploads of any
+ * size work, they just take more than one submission.
+ */
+    void TransferBatch::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size) {
+        StagingRing &ring = device.stagingRing();
+        VkDeviceSize uploaded = 0;
+        while (uploaded < size) {
+            VkDeviceSize staged = stageBuffer(dstBuffer, dstOffset + uploaded, static_cast<const char *>(data) + uploaded,
+                                              size - uploaded);
+            uploaded += staged;
+            if (staged > 0) {
+                continue;
+            }
+            if (!empty()) {
+                flush();
+            }
+            else if (!ring.waitForSpace()) {
+                throw std::runtime_error("failed to stage upload, the staging ring is full");
+            }
+        }
+    }
+
+    void TransferBatch::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset,
+                                   VkDeviceSize dstOffset) {
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = srcOffset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(record(), srcBuffer, dstBuffer, 1, &copyRegion);
+        written(dstBuffer, dstOffset, size);
+    }
+
+    // The image must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+    void TransferBatch::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height,
+                                          uint32_t layerCount) {
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = layerCount;
+
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {width, height, 1};
+
+        vkCmdCopyBufferToImage(record(), buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        if (!device.transfers().isDedicated()) {
+            return;
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = device.transfers().getFamily();
+        barrier.dstQueueFamilyIndex = device.transfers().getGraphicsFamily();
+        barrier.image = image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, layerCount};
+        handoff.images.push_back(barrier);
+    }
+
+/**
+ * Makes the copies of this batch visible to the given stages of work submitted to the graphics
+ * queue after the batch completed, e.g. VK_PIPELINE_STAGE_VERTEX_INPUT_BIT with vertex attribute and
+ * index reads. The barrier is recorded at submit. Without it, a dedicated transfer family hands the
+ * data over for all commands and memory reads, the graphics queue makes no guarantees.
+ */
+    void TransferBatch::makeVisible(VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+        handoff.dstStages |= dstStages;
+        handoff.dstAccess |= dstAccess;
+    }
+
+/**
+ * Submits everything recorded in a single vkQueueSubmit. A batch that recorded nothing submits
+ * nothing and returns a token that is already complete.
+ */
+    TransferBatch::Token TransferBatch::submit() {
+        assert(!submitted && "Transfer batch submitted twice");
+        submitted = true;
+        return flush();
+    }
+
+    // Submits what was recorded so far, the batch carries on in a new command buffer.
+    TransferBatch::Token TransferBatch::flush() {
+        if (commandBuffer == VK_NULL_HANDLE) {
+            return {};
+        }
+        // Interleaved uploads, like a model's vertices and indices, leave runs per buffer that only
+        // become contiguous in order.
+        auto &buffers = handoff.buffers;
+        std::sort(buffers.begin(), buffers.end(), [](const VkBufferMemoryBarrier &a, const VkBufferMemoryBarrier &b) {
+            return a.buffer != b.buffer ? a.buffer < b.buffer : a.offset < b.offset;
+        });
+        size_t merged = 0;
+        for (size_t i = 1; i < buffers.size(); i++) {
+            VkBufferMemoryBarrier &last = buffers[merged];
+            if (buffers[i].buffer == last.buffer && buffers[i].offset <= last.offset + last.size) {
+                last.size = std::max(last.offset + last.size, buffers[i].offset + buffers[i].size) - last.offset;
+            }
+            else {
+                buffers[++merged] = buffers[i];
+            }
+        }
+        buffers.resize(std::min(buffers.size(), merged + 1));
+
+        Token token = device.transfers().submit(commandBuffer, handoff, stagingBatch);
+        commandBuffer = VK_NULL_HANDLE;
+        commandCount = 0;
+        handoff.buffers.clear();
+        handoff.images.clear();
+        submitCount++;
+        return token;
+    }
+
+    // Remembers a written buffer range for the ownership transfer, merging it with the previous
+    // range when it continues it, as the chunks of one upload do.
+    void TransferBatch::written(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
+        if (!device.transfers().isDedicated()) {
+            return;
+        }
+        if (!handoff.buffers.empty()) {
+            VkBufferMemoryBarrier &last = handoff.buffers.back();
+            if (last.buffer == buffer && last.offset + last.size == offset) {
+                last.size += size;
+                return;
+            }
+        }
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = device.transfers().getFamily();
+        barrier.dstQueueFamilyIndex = device.transfers().getGraphicsFamily();
+        barrier.buffer = buffer;
+        barrier.offset = offset;
+        barrier.size = size;
+        handoff.buffers.push_back(barrier);
+    }
+
+    // The command buffer to record into, begun on first use.
+    VkCommandBuffer TransferBatch::record() {
+        assert(!submitted && "Recording into a submitted transfer batch");
+        if (commandBuffer == VK_NULL_HANDLE) {
+            commandBuffer = device.transfers().begin();
+        }
+        commandCount++;
+        return commandBuffer;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef VULKANLEARN_TRANSFERBATCH_H
+#define VULKANLEARN_TRANSFERBATCH_H
+
+#include "VulkanCommon.h"
+#include "TransferQueue.h"
+
+namespace rendering {
+    class Device;
+
+    // Records any number of uploads and copies into one command buffer and submits them together,
+    // instead of a command buffer, a submit and a vkQueueWaitIdle per copy. Uploads are staged
+    // through the device's StagingRing. submit() returns a token to poll or wait on with the
+    // device's TransferQueue; nothing in between blocks unless the ring runs out of space.
+    //
+    //     TransferBatch batch{device};
+    //     for (...) batch.uploadBuffer(buffer, offset, data, size);
+    //     TransferBatch::Token token = batch.submit();
+    //     ...
+    //     if (device.transfers().isComplete(token)) ...
+    //
+    // On a device with a dedicated transfer family the batch runs there and the buffer ranges and
+    // images it wrote change hands to the graphics family, see TransferQueue. Resources must be
+    // VK_SHARING_MODE_EXCLUSIVE and not be written by the graphics queue while the batch runs; copy
+    // sources other than the staging ring must not have been written by the graphics queue at all.
+    //
+    // Several batches may be open at once, for example a blocking Device::uploadBuffer while a
+    // caller's batch is still recording: each batch's staging space stays allocated until that
+    // batch's own copies have run. Space behind an open batch's cannot be reused meanwhile, so an
+    // upload that needs more than the rest of the ring throws.
+    //
+    // A batch is submitted at most once. One that goes out of scope unsubmitted submits itself and
+    // drops the token. Use it from the thread that owns the TransferQueue.
+    class TransferBatch {
+    public:
+        using Token = TransferQueue::Token;
+
+        explicit TransferBatch(Device& _device);
+        ~TransferBatch();
+
+        TransferBatch(const TransferBatch&) = delete;
+        TransferBatch &operator = (const TransferBatch&) = delete;
+
+        VkDeviceSize stageBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+        void uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+        void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0,
+                        VkDeviceSize dstOffset = 0);
+        void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
+        void makeVisible(VkPipelineStageFlags dstStages, VkAccessFlags dstAccess);
+
+        Token submit();
+
+        [[nodiscard]] bool empty() const { return commandCount == 0; }
+        [[nodiscard]] uint32_t getCommandCount() const { return commandCount; }
+        // Submissions so far, more than one only when uploads outgrew the staging ring.
+        [[nodiscard]] uint32_t getSubmitCount() const { return submitCount; }
+
+    private:
+        VkCommandBuffer record();
+        void written(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+        Token flush();
+
+        Device& device;
+        uint64_t stagingBatch; // StagingRing::open() id of this batch's staging space
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        TransferQueue::Handoff handoff{};
+        uint32_t commandCount = 0;
+        uint32_t submitCount = 0;
+        bool submitted = false;
+    };
+}
+
+#endif //VULKANLEARN_TRANSFERBATCH_H
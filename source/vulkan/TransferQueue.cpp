@@ -0,0 +1,268 @@
+
+#include "TransferQueue.h"
+#include "Device.hpp"
+#include "StagingRing.h"
+
+#include <limits>
+#include <stdexcept>
+
+namespace rendering {
+
+    TransferQueue::TransferQueue(Device &_device) : device{_device}, queue{_device.transferQueue()} {
+        QueueFamilyIndices families = device.findPhysicalQueueFamilies();
+        transferFamily = families.transferFamily;
+        graphicsFamily = families.graphicsFamily;
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = transferFamily;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        if (vkCreateCommandPool(device.device(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create transfer command pool");
+        }
+        if (isDedicated()) {
+            poolInfo.queueFamilyIndex = graphicsFamily;
+            if (vkCreateCommandPool(device.device(), &poolInfo, nullptr, &acquirePool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create transfer acquire command pool");
+            }
+        }
+    }
+
+    TransferQueue::~TransferQueue() {
+        if (!inFlight.empty()) {
+            device.stagingRing().wait(inFlight.back().serial);
+        }
+        for (const auto &batch: inFlight) {
+            vkDestroySemaphore(device.device(), batch.semaphore, nullptr);
+        }
+        for (const auto &acquire: acquires) {
+            vkWaitForFences(device.device(), 1, &acquire.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+            vkDestroyFence(device.device(), acquire.fence, nullptr);
+            for (VkSemaphore semaphore: acquire.semaphores) {
+                vkDestroySemaphore(device.device(), semaphore, nullptr);
+            }
+        }
+        for (VkSemaphore semaphore: unusedSemaphores) {
+            vkDestroySemaphore(device.device(), semaphore, nullptr);
+        }
+        for (VkFence fence: unusedFences) {
+            vkDestroyFence(device.device(), fence, nullptr);
+        }
+        vkDestroyCommandPool(device.device(), commandPool, nullptr);
+        if (acquirePool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(device.device(), acquirePool, nullptr);
+        }
+    }
+
+    // Returns a command buffer in the recording state, reusing one whose submission completed.
+    VkCommandBuffer TransferQueue::begin() {
+        retire();
+        VkCommandBuffer commandBuffer;
+        if (!unusedCommandBuffers.empty()) {
+            commandBuffer = unusedCommandBuffers.back();
+            unusedCommandBuffers.pop_back();
+        }
+        else {
+            commandBuffer = allocateCommandBuffer(commandPool);
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        return commandBuffer;
+    }
+
+/**
+ * Ends and submits a command buffer from begin(). It completes everything the staging batch staged
+ * in the ring since its previous submission, so all of that must have been copied by this command
+ * buffer.
+ *
+ * @param handoff What the command buffer wrote and who reads it, made visible to the graphics
+ * queue with a memory barrier or, on a dedicated transfer family, an ownership transfer
+ * @param stagingBatch StagingRing batch the command buffer copies from
+ *
+ * @return Token that completes once the GPU has executed the command buffer
+ */
+    TransferQueue::Token TransferQueue::submit(VkCommandBuffer commandBuffer, const Handoff &handoff,
+                                               uint64_t stagingBatch) {
+        InFlight batch{0, commandBuffer};
+        if (!isDedicated()) {
+            if (handoff.dstStages != 0) {
+                VkMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = handoff.dstAccess;
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, handoff.dstStages, 0,
+                                     1, &barrier, 0, nullptr, 0, nullptr);
+            }
+        }
+        else {
+            // Release everything written to the graphics family; retire() records the matching acquire.
+            batch.acquire = handoff;
+            if (batch.acquire.dstStages == 0) {
+                batch.acquire.dstStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+                batch.acquire.dstAccess = VK_ACCESS_MEMORY_READ_BIT;
+            }
+            std::vector<VkBufferMemoryBarrier> buffers = handoff.buffers;
+            std::vector<VkImageMemoryBarrier> images = handoff.images;
+            for (auto &barrier: buffers) {
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+            }
+            for (auto &barrier: images) {
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+            }
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                                 0, nullptr, static_cast<uint32_t>(buffers.size()), buffers.data(),
+                                 static_cast<uint32_t>(images.size()), images.data());
+
+            if (!unusedSemaphores.empty()) {
+                batch.semaphore = unusedSemaphores.back();
+                unusedSemaphores.pop_back();
+            }
+            else {
+                VkSemaphoreCreateInfo semaphoreInfo{};
+                semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+                if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &batch.semaphore) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create transfer semaphore");
+                }
+            }
+        }
+        vkEndCommandBuffer(commandBuffer);
+        // Copies may read buffers the host wrote, which must be flushed before the submit.
+        device.memoryAllocator().flushDirty();
+        StagingRing::Submission staged = device.stagingRing().close(stagingBatch);
+        batch.serial = staged.serial;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        submitInfo.signalSemaphoreCount = batch.semaphore != VK_NULL_HANDLE ? 1 : 0;
+        submitInfo.pSignalSemaphores = &batch.semaphore;
+        if (vkQueueSubmit(queue, 1, &submitInfo, staged.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit transfer batch");
+        }
+        inFlight.push_back(std::move(batch));
+        submitCount++;
+        return {staged.serial};
+    }
+
+    // Hands back a command buffer from begin() that recorded nothing.
+    void TransferQueue::discard(VkCommandBuffer commandBuffer) {
+        vkEndCommandBuffer(commandBuffer);
+        unusedCommandBuffers.push_back(commandBuffer);
+    }
+
+    bool TransferQueue::isComplete(Token token) {
+        retire();
+        return token.serial <= retiredSerial;
+    }
+
+    // Blocks until the token completed, without waiting for anything submitted after it.
+    void TransferQueue::wait(Token token) {
+        device.stagingRing().wait(token.serial);
+        retire();
+    }
+
+/**
+ * Retires batches whose copies finished, oldest first. On a dedicated family their acquires go
+ * to the graphics queue in one command buffer; the semaphores it waits on are signalled already,
+ * so it never holds up rendering.
+ */
+    void TransferQueue::retire() {
+        recycle();
+        StagingRing &ring = device.stagingRing();
+        Acquire acquire{};
+        std::vector<VkPipelineStageFlags> waitStages{};
+        while (!inFlight.empty() && ring.isComplete(inFlight.front().serial)) {
+            InFlight &batch = inFlight.front();
+            if (batch.semaphore != VK_NULL_HANDLE) {
+                if (acquire.commandBuffer == VK_NULL_HANDLE) {
+                    if (!unusedAcquireBuffers.empty()) {
+                        acquire.commandBuffer = unusedAcquireBuffers.back();
+                        unusedAcquireBuffers.pop_back();
+                    }
+                    else {
+                        acquire.commandBuffer = allocateCommandBuffer(acquirePool);
+                    }
+                    VkCommandBufferBeginInfo beginInfo{};
+                    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+                    vkBeginCommandBuffer(acquire.commandBuffer, &beginInfo);
+                }
+                for (auto &barrier: batch.acquire.buffers) {
+                    barrier.srcAccessMask = 0;
+                    barrier.dstAccessMask = batch.acquire.dstAccess;
+                }
+                for (auto &barrier: batch.acquire.images) {
+                    barrier.srcAccessMask = 0;
+                    barrier.dstAccessMask = batch.acquire.dstAccess;
+                }
+                vkCmdPipelineBarrier(acquire.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, batch.acquire.dstStages, 0,
+                                     0, nullptr, static_cast<uint32_t>(batch.acquire.buffers.size()), batch.acquire.buffers.data(),
+                                     static_cast<uint32_t>(batch.acquire.images.size()), batch.acquire.images.data());
+                acquire.semaphores.push_back(batch.semaphore);
+                waitStages.push_back(batch.acquire.dstStages);
+            }
+            retiredSerial = batch.serial;
+            unusedCommandBuffers.push_back(batch.commandBuffer);
+            inFlight.pop_front();
+        }
+        if (acquire.commandBuffer == VK_NULL_HANDLE) {
+            return;
+        }
+        vkEndCommandBuffer(acquire.commandBuffer);
+
+        if (!unusedFences.empty()) {
+            acquire.fence = unusedFences.back();
+            unusedFences.pop_back();
+        }
+        else {
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if (vkCreateFence(device.device(), &fenceInfo, nullptr, &acquire.fence) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create transfer acquire fence");
+            }
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount = static_cast<uint32_t>(acquire.semaphores.size());
+        submitInfo.pWaitSemaphores = acquire.semaphores.data();
+        submitInfo.pWaitDstStageMask = waitStages.data();
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &acquire.commandBuffer;
+        if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, acquire.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit transfer acquire");
+        }
+        acquires.push_back(std::move(acquire));
+    }
+
+    // Takes back the command buffers, semaphores and fences of acquires that finished.
+    void TransferQueue::recycle() {
+        while (!acquires.empty() && vkGetFenceStatus(device.device(), acquires.front().fence) == VK_SUCCESS) {
+            Acquire &acquire = acquires.front();
+            vkResetFences(device.device(), 1, &acquire.fence);
+            unusedFences.push_back(acquire.fence);
+            unusedAcquireBuffers.push_back(acquire.commandBuffer);
+            unusedSemaphores.insert(unusedSemaphores.end(), acquire.semaphores.begin(), acquire.semaphores.end());
+            acquires.pop_front();
+        }
+    }
+
+    VkCommandBuffer TransferQueue::allocateCommandBuffer(VkCommandPool pool) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = pool;
+        allocInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate transfer command buffer");
+        }
+        return commandBuffer;
+    }
+}
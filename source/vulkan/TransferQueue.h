@@ -0,0 +1,93 @@
+#ifndef VULKANLEARN_TRANSFERQUEUE_H
+#define VULKANLEARN_TRANSFERQUEUE_H
+
+#include "VulkanCommon.h"
+
+#include <deque>
+#include <vector>
+
+namespace rendering {
+    class Device;
+
+    // The queue, command pools and completion tracking behind every TransferBatch. Batches run on the
+    // device's dedicated transfer family when it has one, so copies overlap rendering, or on the
+    // graphics queue otherwise. Submissions are signalled with the fences of the device's StagingRing,
+    // so a Token is a ring serial and tokens complete in submission order.
+    //
+    // With a dedicated family, the resources a batch wrote are released to the graphics family at
+    // the end of the batch and acquired by a small graphics queue submission once the copies have
+    // finished, so the graphics queue never waits for the transfer queue. A token completes when that
+    // acquire has been submitted: anything submitted to the graphics queue afterwards sees the data.
+    // Not thread safe, use it from the thread that submits to the graphics queue.
+    class TransferQueue {
+    public:
+        struct Token {
+            uint64_t serial = 0; // 0 for batches that had nothing to submit, always complete
+        };
+
+        // What a batch wrote and which graphics stages read it afterwards.
+        struct Handoff {
+            std::vector<VkBufferMemoryBarrier> buffers{};
+            std::vector<VkImageMemoryBarrier> images{}; // in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+            VkPipelineStageFlags dstStages = 0;         // 0 when nothing declared, see TransferBatch::makeVisible
+            VkAccessFlags dstAccess = 0;
+        };
+
+        explicit TransferQueue(Device& _device);
+        ~TransferQueue();
+
+        TransferQueue(const TransferQueue&) = delete;
+        TransferQueue &operator = (const TransferQueue&) = delete;
+
+        VkCommandBuffer begin();
+        Token submit(VkCommandBuffer commandBuffer, const Handoff& handoff, uint64_t stagingBatch);
+        void discard(VkCommandBuffer commandBuffer);
+
+        bool isComplete(Token token);
+        void wait(Token token);
+
+        [[nodiscard]] VkQueue getQueue() const { return queue; }
+        [[nodiscard]] uint32_t getFamily() const { return transferFamily; }
+        [[nodiscard]] uint32_t getGraphicsFamily() const { return graphicsFamily; }
+        [[nodiscard]] bool isDedicated() const { return transferFamily != graphicsFamily; }
+        [[nodiscard]] uint64_t getSubmitCount() const { return submitCount; }
+
+    private:
+        struct InFlight {
+            uint64_t serial;
+            VkCommandBuffer commandBuffer;
+            // Dedicated family only: signalled by the batch, waited on by its acquire.
+            VkSemaphore semaphore = VK_NULL_HANDLE;
+            Handoff acquire{};
+        };
+
+        struct Acquire {
+            VkFence fence;
+            VkCommandBuffer commandBuffer;
+            std::vector<VkSemaphore> semaphores;
+        };
+
+        void retire();
+        void recycle();
+        VkCommandBuffer allocateCommandBuffer(VkCommandPool pool);
+
+        Device& device;
+        VkQueue queue = VK_NULL_HANDLE;
+        uint32_t transferFamily = 0;
+        uint32_t graphicsFamily = 0;
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandPool acquirePool = VK_NULL_HANDLE; // graphics family, dedicated family only
+
+        std::deque<InFlight> inFlight{}; // submitted, oldest first
+        uint64_t retiredSerial = 0;      // newest batch that finished and, if needed, was acquired
+        std::deque<Acquire> acquires{};  // acquire submissions whose fence has not signalled yet
+
+        std::vector<VkCommandBuffer> unusedCommandBuffers{};
+        std::vector<VkCommandBuffer> unusedAcquireBuffers{};
+        std::vector<VkSemaphore> unusedSemaphores{};
+        std::vector<VkFence> unusedFences{};
+        uint64_t submitCount = 0;
+    };
+}
+
+#endif //VULKANLEARN_TRANSFERQUEUE_H
@@ -0,0 +1,46 @@
+
+#include "VertexTable.h"
+
+namespace rendering {
+
+/**
+ * Sizes the table so `count` keys fit under the 3/4 load factor without growing.
+ *
+ * @param count Expected number of keys, usually the corner count since the unique count is unknown
+ */
+    void VertexTable::reserve(size_t count) {
+        size_t capacity = 16;
+        while (capacity * 3 < count * 4 + 4) {
+            capacity *= 2;
+        }
+        if (capacity > slots.size()) {
+            rehash(capacity);
+        }
+    }
+
+    void VertexTable::clear() {
+        std::fill(slots.begin(), slots.end(), Slot{EMPTY, 0});
+        count = 0;
+    }
+
+    void VertexTable::grow() {
+        rehash(slots.empty() ? 16 : slots.size() * 2);
+    }
+
+    void VertexTable::rehash(size_t capacity) {
+        std::vector<Slot> previous(capacity, Slot{EMPTY, 0});
+        previous.swap(slots);
+
+        size_t mask = slots.size() - 1;
+        for (const auto &slot: previous) {
+            if (slot.id == EMPTY) {
+                continue;
+            }
+            size_t i = slot.tag & mask;
+            while (slots[i].id != EMPTY) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+    }
+}
@@ -0,0 +1,222 @@
+#ifndef VULKANLEARN_VERTEXTABLE_H
+#define VULKANLEARN_VERTEXTABLE_H
+
+#include "Model.h"
+#include "renderingutility.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace rendering {
+    // Flat open addressing set of vertex ids with linear probing. Slots only hold the id and the low
+    // 32 bits of its hash; the vertex contents live with the caller and are compared through a
+    // callback when the hash bits match. That keeps a slot at 8 bytes and avoids one heap node per
+    // unique vertex.
+    class VertexTable {
+    public:
+        static constexpr uint32_t EMPTY = UINT32_MAX;
+
+        void reserve(size_t count);
+        void clear();
+        [[nodiscard]] size_t size() const { return count; }
+
+        // Returns the id already stored for an equal key, or stores `id` and returns it with true.
+        template <typename Equals>
+        std::pair<uint32_t, bool> findOrInsert(uint64_t hash, uint32_t id, Equals&& equals) {
+            if ((count + 1) * 4 > slots.size() * 3) {
+                grow();
+            }
+            auto tag = static_cast<uint32_t>(hash);
+            size_t mask = slots.size() - 1;
+            for (size_t i = tag & mask;; i = (i + 1) & mask) {
+                Slot& slot = slots[i];
+                if (slot.id == EMPTY) {
+                    slot = {id, tag};
+                    count++;
+                    return {id, true};
+                }
+                if (slot.tag == tag && equals(slot.id)) {
+                    return {slot.id, false};
+                }
+            }
+        }
+
+    private:
+        struct Slot {
+            uint32_t id;
+            uint32_t tag;
+        };
+
+        void grow();
+        void rehash(size_t capacity);
+
+        std::vector<Slot> slots{};
+        size_t count = 0;
+    };
+
+    // Vertices are welded by their raw bytes, so -0.0f has to be folded into +0.0f beforehand to keep
+    // the result identical to comparing with glm's operator ==.
+    inline uint64_t hashVertex(const Model::Vertex& vertex) {
+        static_assert(sizeof(Model::Vertex) == 11 * sizeof(float), "Vertex must not contain padding");
+        return hashBytes(&vertex, sizeof(vertex));
+    }
+
+    inline bool sameVertex(const Model::Vertex& a, const Model::Vertex& b) {
+        return memcmp(&a, &b, sizeof(Model::Vertex)) == 0;
+    }
+
+    // Runs fn(begin, end, worker) over `count` items split into contiguous ranges, one per worker.
+    template <typename F>
+    void parallelRanges(size_t count, uint32_t workers, F&& fn) {
+        std::vector<std::thread> threads{};
+        for (uint32_t w = 1; w < workers; w++) {
+            threads.emplace_back([&, w] { fn(count * w / workers, count * (w + 1) / workers, w); });
+        }
+        fn(0, count / workers, 0u);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+/**
+ * Welds `cornerCount` vertices produced by makeVertex(corner) into unique vertices and an index per
+ * corner. Unique vertices are ordered by first occurrence, so serial and sharded runs produce
+ * identical output.
+ *
+ * The sharded path hashes every corner in parallel, buckets corners by the top hash bits so each
+ * shard owns a disjoint set of keys, welds every shard in its own table, and finally numbers the
+ * first occurrences in corner order.
+ *
+ * @param threadCount 0 picks serial for small meshes and all cores otherwise, 1 forces serial, and
+ * anything larger forces the sharded path with that many workers
+ */
+    template <typename MakeVertex>
+    void weldVertices(size_t cornerCount, MakeVertex&& makeVertex, std::vector<Model::Vertex>& vertices,
+                      std::vector<uint32_t>& indices, uint32_t threadCount = 0) {
+        constexpr size_t PARALLEL_THRESHOLD = 1 << 17;
+        if (threadCount == 0) {
+            threadCount = cornerCount < PARALLEL_THRESHOLD ? 1 : std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        vertices.clear();
+        indices.resize(cornerCount);
+
+        if (threadCount == 1) {
+            VertexTable table{};
+            table.reserve(cornerCount);
+            for (size_t corner = 0; corner < cornerCount; corner++) {
+                Model::Vertex vertex = makeVertex(corner);
+                auto [id, inserted] = table.findOrInsert(
+                        hashVertex(vertex), static_cast<uint32_t>(vertices.size()),
+                        [&](uint32_t existing) { return sameVertex(vertices[existing], vertex); });
+                if (inserted) {
+                    vertices.push_back(vertex);
+                }
+                indices[corner] = id;
+            }
+            return;
+        }
+
+        uint32_t shardBits = 1;
+        while ((1u << shardBits) < threadCount) {
+            shardBits++;
+        }
+        const uint32_t shardCount = 1u << shardBits;
+        auto shardOf = [shardBits](uint64_t hash) { return static_cast<uint32_t>(hash >> (64 - shardBits)); };
+
+        // Hash every corner and count how many land in each shard per worker range.
+        std::vector<uint64_t> hashes(cornerCount);
+        std::vector<std::vector<size_t>> shardCounts(threadCount, std::vector<size_t>(shardCount, 0));
+        parallelRanges(cornerCount, threadCount, [&](size_t begin, size_t end, uint32_t worker) {
+            auto& counts = shardCounts[worker];
+            for (size_t corner = begin; corner < end; corner++) {
+                hashes[corner] = hashVertex(makeVertex(corner));
+                counts[shardOf(hashes[corner])]++;
+            }
+        });
+
+        // Scatter corner ids into per shard lists. Worker ranges are visited in order, so every list
+        // stays sorted by corner.
+        std::vector<size_t> shardStart(shardCount + 1, 0);
+        std::vector<std::vector<size_t>> cursors(threadCount, std::vector<size_t>(shardCount));
+        for (uint32_t shard = 0; shard < shardCount; shard++) {
+            size_t offset = shardStart[shard];
+            for (uint32_t worker = 0; worker < threadCount; worker++) {
+                cursors[worker][shard] = offset;
+                offset += shardCounts[worker][shard];
+            }
+            shardStart[shard + 1] = offset;
+        }
+        std::vector<uint32_t> shardCorners(cornerCount);
+        parallelRanges(cornerCount, threadCount, [&](size_t begin, size_t end, uint32_t worker) {
+            auto& cursor = cursors[worker];
+            for (size_t corner = begin; corner < end; corner++) {
+                shardCorners[cursor[shardOf(hashes[corner])]++] = static_cast<uint32_t>(corner);
+            }
+        });
+
+        // Weld each shard independently. indices[] temporarily holds shard local ids.
+        std::vector<std::vector<Model::Vertex>> shardVertices(shardCount);
+        std::vector<uint8_t> isFirst(cornerCount, 0);
+        parallelRanges(shardCount, threadCount, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t shard = begin; shard < end; shard++) {
+                auto& unique = shardVertices[shard];
+                VertexTable table{};
+                table.reserve(shardStart[shard + 1] - shardStart[shard]);
+                for (size_t i = shardStart[shard]; i < shardStart[shard + 1]; i++) {
+                    uint32_t corner = shardCorners[i];
+                    Model::Vertex vertex = makeVertex(corner);
+                    auto [id, inserted] = table.findOrInsert(
+                            hashes[corner], static_cast<uint32_t>(unique.size()),
+                            [&](uint32_t existing) { return sameVertex(unique[existing], vertex); });
+                    if (inserted) {
+                        unique.push_back(vertex);
+                        isFirst[corner] = 1;
+                    }
+                    indices[corner] = id;
+                }
+            }
+        });
+
+        // Number first occurrences in corner order: count per range, prefix, then assign.
+        std::vector<size_t> rangeFirsts(threadCount + 1, 0);
+        parallelRanges(cornerCount, threadCount, [&](size_t begin, size_t end, uint32_t worker) {
+            size_t firsts = 0;
+            for (size_t corner = begin; corner < end; corner++) {
+                firsts += isFirst[corner];
+            }
+            rangeFirsts[worker + 1] = firsts;
+        });
+        for (uint32_t worker = 0; worker < threadCount; worker++) {
+            rangeFirsts[worker + 1] += rangeFirsts[worker];
+        }
+
+        vertices.resize(rangeFirsts[threadCount]);
+        std::vector<std::vector<uint32_t>> globalIds(shardCount);
+        for (uint32_t shard = 0; shard < shardCount; shard++) {
+            globalIds[shard].resize(shardVertices[shard].size());
+        }
+        parallelRanges(cornerCount, threadCount, [&](size_t begin, size_t end, uint32_t worker) {
+            auto next = static_cast<uint32_t>(rangeFirsts[worker]);
+            for (size_t corner = begin; corner < end; corner++) {
+                if (isFirst[corner]) {
+                    uint32_t shard = shardOf(hashes[corner]);
+                    uint32_t local = indices[corner];
+                    globalIds[shard][local] = next;
+                    vertices[next++] = shardVertices[shard][local];
+                }
+            }
+        });
+
+        parallelRanges(cornerCount, threadCount, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t corner = begin; corner < end; corner++) {
+                indices[corner] = globalIds[shardOf(hashes[corner])][indices[corner]];
+            }
+        });
+    }
+}
+
+#endif //VULKANLEARN_VERTEXTABLE_H
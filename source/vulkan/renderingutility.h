@@ -2,6 +2,8 @@
 #ifndef VULKANLEARN_RENDERINGUTILITY_H
 #define VULKANLEARN_RENDERINGUTILITY_H
 
+#include <cstdint>
+#include <cstring>
 #include <functional>
 
 namespace rendering {
@@ -10,6 +12,83 @@ namespace rendering {
         seed ^= std::hash<T>{}(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
         (hashCombine(seed, rest), ...);
     };
+
+    namespace detail {
+        constexpr uint64_t PRIME1 = 11400714785074694791ull;
+        constexpr uint64_t PRIME2 = 14029467366897019727ull;
+        constexpr uint64_t PRIME3 = 1609587929392839161ull;
+        constexpr uint64_t PRIME4 = 9650029242287828579ull;
+        constexpr uint64_t PRIME5 = 2870177450012600261ull;
+
+        inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+        inline uint64_t read64(const unsigned char* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+        inline uint32_t read32(const unsigned char* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+        inline uint64_t round(uint64_t acc, uint64_t input) {
+            acc += input * PRIME2;
+            return rotl(acc, 31) * PRIME1;
+        }
+
+        inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+            acc ^= round(0, value);
+            return acc * PRIME1 + PRIME4;
+        }
+    }
+
+    // 64 bit XXH64 hash of a byte range, used for content keys (mesh cache, registries) where
+    // std::hash over a std::string would mean copying the data first.
+    inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+        using namespace detail;
+        auto p = static_cast<const unsigned char*>(data);
+        const unsigned char* end = p + size;
+        uint64_t h;
+
+        if (size >= 32) {
+            uint64_t v1 = seed + PRIME1 + PRIME2;
+            uint64_t v2 = seed + PRIME2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - PRIME1;
+            const unsigned char* limit = end - 32;
+            do {
+                v1 = detail::round(v1, read64(p));
+                v2 = detail::round(v2, read64(p + 8));
+                v3 = detail::round(v3, read64(p + 16));
+                v4 = detail::round(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = mergeRound(h, v1);
+            h = mergeRound(h, v2);
+            h = mergeRound(h, v3);
+            h = mergeRound(h, v4);
+        } else {
+            h = seed + PRIME5;
+        }
+
+        h += static_cast<uint64_t>(size);
+        for (; p + 8 <= end; p += 8) {
+            h ^= detail::round(0, read64(p));
+            h = rotl(h, 27) * PRIME1 + PRIME4;
+        }
+        if (p + 4 <= end) {
+            h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+            h = rotl(h, 23) * PRIME2 + PRIME3;
+            p += 4;
+        }
+        for (; p < end; p++) {
+            h ^= static_cast<uint64_t>(*p) * PRIME5;
+            h = rotl(h, 11) * PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+    }
 }
 
 #endif //VULKANLEARN_RENDERINGUTILITY_H